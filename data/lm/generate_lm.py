@@ -194,6 +194,11 @@ def main():
         help="To try when such message is returned by kenlm: 'Could not calculate Kneser-Ney discounts [...] rerun with --discount_fallback'",
         action="store_true",
     )
+    parser.add_argument(
+        "--keep_arpa",
+        help="Keep lm_filtered.arpa, from which generate_scorer_package --arpa can build other binary variants",
+        action="store_true",
+    )
 
     args = parser.parse_args()
 
@@ -203,7 +208,8 @@ def main():
     # Delete intermediate files
     os.remove(os.path.join(args.output_dir, "lower.txt.gz"))
     os.remove(os.path.join(args.output_dir, "lm.arpa"))
-    os.remove(os.path.join(args.output_dir, "lm_filtered.arpa"))
+    if not args.keep_arpa:
+        os.remove(os.path.join(args.output_dir, "lm_filtered.arpa"))
 
 
 if __name__ == "__main__":
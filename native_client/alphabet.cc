@@ -47,6 +47,8 @@ Alphabet::init(const char *config_file)
   }
   unsigned int label = 0;
   space_label_ = -2;
+  label_to_str_.clear();
+  str_to_label_.clear();
   for (std::string line; getline_crossplatform(in, line);) {
     if (line.size() == 2 && line[0] == '\\' && line[1] == '#') {
       line = '#';
@@ -60,12 +62,13 @@ Alphabet::init(const char *config_file)
     if (line.length() == 0) {
       continue;
     }
-    label_to_str_[label] = line;
+    label_to_str_.push_back(line);
     str_to_label_[line] = label;
     ++label;
   }
   size_ = label;
   in.close();
+  BuildLabelInfo();
   return 0;
 }
 
@@ -81,9 +84,9 @@ Alphabet::Serialize()
   uint16_t size = size_;
   out.write(reinterpret_cast<char*>(&size), sizeof(size));
 
-  for (auto it = label_to_str_.begin(); it != label_to_str_.end(); ++it) {
-    uint16_t key = it->first;
-    string str = it->second;
+  for (size_t i = 0; i < label_to_str_.size(); ++i) {
+    uint16_t key = i;
+    const string& str = label_to_str_[i];
     uint16_t len = str.length();
     // Then we write the key as uint16_t, followed by the length of the value
     // as uint16_t, followed by `length` bytes (the value itself).
@@ -106,6 +109,8 @@ Alphabet::Deserialize(const char* buffer, const int buffer_size)
   uint16_t size = *(uint16_t*)(buffer + offset);
   offset += sizeof(uint16_t);
   size_ = size;
+  label_to_str_.assign(size, std::string());
+  str_to_label_.clear();
 
   for (int i = 0; i < size; ++i) {
     if (buffer_size - offset < sizeof(uint16_t)) {
@@ -113,6 +118,9 @@ Alphabet::Deserialize(const char* buffer, const int buffer_size)
     }
     uint16_t label = *(uint16_t*)(buffer + offset);
     offset += sizeof(uint16_t);
+    if (label >= size) {
+      return 1;
+    }
 
     if (buffer_size - offset < sizeof(uint16_t)) {
       return 1;
@@ -134,9 +142,25 @@ Alphabet::Deserialize(const char* buffer, const int buffer_size)
     }
   }
 
+  BuildLabelInfo();
   return 0;
 }
 
+void
+Alphabet::BuildLabelInfo()
+{
+  label_info_.resize(label_to_str_.size());
+  for (size_t i = 0; i < label_to_str_.size(); ++i) {
+    const std::string& str = label_to_str_[i];
+    LabelInfo& info = label_info_[i];
+    // An empty label decodes to the terminating NUL, as DecodeSingle(i)[0]
+    // always did.
+    info.first_byte = str.empty() ? 0 : (unsigned char)str[0];
+    info.is_codepoint_boundary = byte_is_codepoint_boundary(info.first_byte);
+    info.utf8_length = utf8_sequence_length(info.first_byte);
+  }
+}
+
 bool
 Alphabet::CanEncodeSingle(const std::string& input) const
 {
@@ -155,12 +179,11 @@ Alphabet::CanEncode(const std::string& input) const
   return true;
 }
 
-std::string
+const std::string&
 Alphabet::DecodeSingle(unsigned int label) const
 {
-  auto it = label_to_str_.find(label);
-  if (it != label_to_str_.end()) {
-    return it->second;
+  if (label < label_to_str_.size()) {
+    return label_to_str_[label];
   } else {
     std::cerr << "Invalid label " << label << std::endl;
     abort();
@@ -183,9 +206,7 @@ std::string
 Alphabet::Decode(const std::vector<unsigned int>& input) const
 {
   std::string word;
-  for (auto ind : input) {
-    word += DecodeSingle(ind);
-  }
+  DecodeAppend(input, word);
   return word;
 }
 
@@ -199,6 +220,14 @@ Alphabet::Decode(const unsigned int* input, int length) const
   return word;
 }
 
+void
+Alphabet::DecodeAppend(const std::vector<unsigned int>& input, std::string& output) const
+{
+  for (auto ind : input) {
+    output += DecodeSingle(ind);
+  }
+}
+
 std::vector<unsigned int>
 Alphabet::Encode(const std::string& input) const
 {
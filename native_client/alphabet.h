@@ -33,6 +33,25 @@ public:
     return label == space_label_;
   }
 
+  // Returns true if the first byte of the label's string starts a UTF-8
+  // codepoint. Label must be in the alphabet.
+  bool IsCodepointBoundary(unsigned int label) const {
+    return label_info_[label].is_codepoint_boundary;
+  }
+
+  // Returns the first byte of the label's string. Label must be in the
+  // alphabet.
+  unsigned char GetFirstByte(unsigned int label) const {
+    return label_info_[label].first_byte;
+  }
+
+  // Returns the length in bytes of the UTF-8 sequence started by the first
+  // byte of the label's string, or 0 if that byte is a continuation byte.
+  // Label must be in the alphabet.
+  unsigned int GetUTF8Length(unsigned int label) const {
+    return label_info_[label].utf8_length;
+  }
+
   unsigned int GetSpaceLabel() const {
     return space_label_;
   }
@@ -45,8 +64,9 @@ public:
   // alphabet.
   virtual bool CanEncode(const std::string& string) const;
 
-  // Decode a single label into a string.
-  std::string DecodeSingle(unsigned int label) const;
+  // Decode a single label into a string. The returned reference is owned by
+  // the alphabet and stays valid for as long as it does.
+  const std::string& DecodeSingle(unsigned int label) const;
 
   // Encode a single character/output class into a label. Character must be in
   // the alphabet, this method will assert that. Use `CanEncodeSingle` to test.
@@ -59,6 +79,10 @@ public:
   // the NumPy library does not have built-in typemaps for std::vector<T>.
   std::string Decode(const unsigned int* input, int length) const;
 
+  // Decode a sequence of labels, appending the result to |output|. Lets hot
+  // paths reuse a single buffer instead of allocating a string per call.
+  void DecodeAppend(const std::vector<unsigned int>& input, std::string& output) const;
+
   // Encode a sequence of character/output classes into a sequence of labels.
   // Characters are assumed to always take a single Unicode codepoint.
   // Characters must be in the alphabet, this method will assert that. Use
@@ -66,9 +90,21 @@ public:
   virtual std::vector<unsigned int> Encode(const std::string& input) const;
 
 protected:
+  // Rebuilds the per-label flags from label_to_str_, must be called whenever
+  // the set of labels changes.
+  void BuildLabelInfo();
+
+  struct LabelInfo {
+    unsigned char first_byte;
+    unsigned char utf8_length;
+    bool is_codepoint_boundary;
+  };
+
   size_t size_;
   unsigned int space_label_;
-  std::unordered_map<unsigned int, std::string> label_to_str_;
+  // Indexed by label, so decoding does not need to hash
+  std::vector<std::string> label_to_str_;
+  std::vector<LabelInfo> label_info_;
   std::unordered_map<std::string, unsigned int> str_to_label_;
 };
 
@@ -78,11 +114,13 @@ public:
   UTF8Alphabet() {
     size_ = 255;
     space_label_ = ' ' - 1;
+    label_to_str_.resize(size_);
     for (size_t i = 0; i < size_; ++i) {
       std::string val(1, i+1);
       label_to_str_[i] = val;
       str_to_label_[val] = i;
     }
+    BuildLabelInfo();
   }
 
   int init(const char*) override {
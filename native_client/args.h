@@ -42,6 +42,12 @@ int extended_stream_size = 0;
 
 char* hot_words = NULL;
 
+int workers = 0;
+
+int prefetch = 0;
+
+bool show_stats = false;
+
 void PrintHelp(const char* bin)
 {
     std::cout <<
@@ -62,6 +68,9 @@ void PrintHelp(const char* bin)
     "\t--stream size\t\t\tRun in stream mode, output intermediate results\n"
     "\t--extended_stream size\t\t\tRun in stream mode using metadata output, output intermediate results\n"
     "\t--hot_words\t\t\tHot-words and their boosts. Word:Boost pairs are comma-separated\n"
+    "\t--workers NUMBER\t\tTranscribe a directory with NUMBER threads sharing the model, output one JSON line per file\n"
+    "\t--prefetch NUMBER\t\tNumber of files decoded ahead of the workers (default: twice the number of workers)\n"
+    "\t--stats\t\t\t\tPrint the time spent in each stage of the pipeline as JSON to stderr\n"
     "\t--help\t\t\t\tShow help\n"
     "\t--version\t\t\tPrint version and exits\n";
     char* version = DS_Version();
@@ -87,6 +96,9 @@ bool ProcessArgs(int argc, char** argv)
             {"stream", required_argument, nullptr, 's'},
             {"extended_stream", required_argument, nullptr, 'S'},
             {"hot_words", required_argument, nullptr, 'w'},
+            {"workers", required_argument, nullptr, 151},
+            {"prefetch", required_argument, nullptr, 152},
+            {"stats", no_argument, nullptr, 153},
             {"version", no_argument, nullptr, 'v'},
             {"help", no_argument, nullptr, 'h'},
             {nullptr, no_argument, nullptr, 0}
@@ -160,6 +172,18 @@ bool ProcessArgs(int argc, char** argv)
             hot_words = optarg;
             break;
 
+        case 151:
+            workers = atoi(optarg);
+            break;
+
+        case 152:
+            prefetch = atoi(optarg);
+            break;
+
+        case 153:
+            show_stats = true;
+            break;
+
         case 'h': // -h or --help
         case '?': // Unrecognized option
         default:
@@ -186,6 +210,16 @@ bool ProcessArgs(int argc, char** argv)
         return false;
     }
 
+    if (workers < 0 || prefetch < 0) {
+        std::cout <<
+        "Number of workers and prefetched files must be positive\n";
+        return false;
+    }
+
+    if (prefetch == 0) {
+        prefetch = 2 * workers;
+    }
+
     return true;
 }
 
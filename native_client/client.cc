@@ -31,6 +31,12 @@
 #ifndef NO_DIR
 #include <dirent.h>
 #include <unistd.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
 #endif // NO_DIR
 #include <vector>
 
@@ -42,12 +48,6 @@ typedef struct {
   double cpu_time_overall;
 } ds_result;
 
-struct meta_word {
-  std::string word;
-  float start_time;
-  float duration;
-};
-
 char*
 CandidateTranscriptToString(const CandidateTranscript* transcript)
 {
@@ -59,65 +59,18 @@ CandidateTranscriptToString(const CandidateTranscript* transcript)
   return strdup(retval.c_str());
 }
 
-std::vector<meta_word>
-CandidateTranscriptToWords(const CandidateTranscript* transcript)
-{
-  std::vector<meta_word> word_list;
-
-  std::string word = "";
-  float word_start_time = 0;
-
-  // Loop through each token
-  for (int i = 0; i < transcript->num_tokens; i++) {
-    const TokenMetadata& token = transcript->tokens[i];
-
-    // Append token to word if it's not a space
-    if (strcmp(token.text, u8" ") != 0) {
-      // Log the start time of the new word
-      if (word.length() == 0) {
-        word_start_time = token.start_time;
-      }
-      word.append(token.text);
-    }
-
-    // Word boundary is either a space or the last token in the array
-    if (strcmp(token.text, u8" ") == 0 || i == transcript->num_tokens-1) {
-      float word_duration = token.start_time - word_start_time;
-
-      if (word_duration < 0) {
-        word_duration = 0;
-      }
-
-      meta_word w;
-      w.word = word;
-      w.start_time = word_start_time;
-      w.duration = word_duration;
-
-      word_list.push_back(w);
-
-      // Reset
-      word = "";
-      word_start_time = 0;
-    }
-  }
-
-  return word_list;
-}
-
 std::string
-CandidateTranscriptToJSON(const CandidateTranscript *transcript)
+WordTranscriptToJSON(const WordTranscript *transcript)
 {
   std::ostringstream out_string;
 
-  std::vector<meta_word> words = CandidateTranscriptToWords(transcript);
-
   out_string << R"("metadata":{"confidence":)" << transcript->confidence << R"(},"words":[)";
 
-  for (int i = 0; i < words.size(); i++) {
-    meta_word w = words[i];
-    out_string << R"({"word":")" << w.word << R"(","time":)" << w.start_time << R"(,"duration":)" << w.duration << "}";
+  for (int i = 0; i < transcript->num_words; i++) {
+    const WordMetadata& w = transcript->words[i];
+    out_string << R"({"word":")" << w.text << R"(","time":)" << w.start_time << R"(,"duration":)" << w.duration << "}";
 
-    if (i < words.size() - 1) {
+    if (i < transcript->num_words - 1) {
       out_string << ",";
     }
   }
@@ -128,22 +81,22 @@ CandidateTranscriptToJSON(const CandidateTranscript *transcript)
 }
 
 char*
-MetadataToJSON(Metadata* result)
+WordMetadataToJSON(WordMetadataList* result)
 {
   std::ostringstream out_string;
   out_string << "{\n";
 
   for (int j=0; j < result->num_transcripts; ++j) {
-    const CandidateTranscript *transcript = &result->transcripts[j];
+    const WordTranscript *transcript = &result->transcripts[j];
 
     if (j == 0) {
-      out_string << CandidateTranscriptToJSON(transcript);
+      out_string << WordTranscriptToJSON(transcript);
 
       if (result->num_transcripts > 1) {
         out_string << ",\n" << R"("alternatives")" << ":[\n";
       }
     } else {
-      out_string << "{" << CandidateTranscriptToJSON(transcript) << "}";
+      out_string << "{" << WordTranscriptToJSON(transcript) << "}";
 
       if (j < result->num_transcripts - 1) {
         out_string << ",\n";
@@ -172,9 +125,9 @@ LocalDsSTT(ModelState* aCtx, const short* aBuffer, size_t aBufferSize,
     res.string = CandidateTranscriptToString(&result->transcripts[0]);
     DS_FreeMetadata(result);
   } else if (json_output) {
-    Metadata *result = DS_SpeechToTextWithMetadata(aCtx, aBuffer, aBufferSize, json_candidate_transcripts);
-    res.string = MetadataToJSON(result);
-    DS_FreeMetadata(result);
+    WordMetadataList *result = DS_SpeechToTextWithWords(aCtx, aBuffer, aBufferSize, json_candidate_transcripts);
+    res.string = WordMetadataToJSON(result);
+    DS_FreeWordMetadata(result);
   } else if (stream_size > 0) {
     StreamingState* ctx;
     int status = DS_CreateStream(aCtx, &ctx);
@@ -401,9 +354,201 @@ GetAudioBuffer(const char* path, int desired_sample_rate)
   return res;
 }
 
+#ifndef NO_SOX
+// State of the libsox effect that feeds decoded audio to a stream as it
+// comes out of the effects chain
+typedef struct {
+  StreamingState* stream;
+  std::vector<short> pending;
+  size_t chunk_size;
+  bool intermediate;
+  bool intermediate_metadata;
+  // Like LocalDsSTT(), the first intermediate result is always printed
+  bool has_last;
+  std::string last;
+  // CPU time spent in DeepSpeech, libsox decoding is left out
+  clock_t ds_clocks;
+} ds_stream_sink;
+
+void
+FeedStreamSink(ds_stream_sink* sink)
+{
+  if (sink->pending.empty()) {
+    return;
+  }
+  clock_t start = clock();
+  DS_FeedAudioContent(sink->stream, sink->pending.data(), sink->pending.size());
+  sink->pending.clear();
+
+  if (!sink->intermediate) {
+    sink->ds_clocks += clock() - start;
+    return;
+  }
+  std::string partial;
+  if (sink->intermediate_metadata) {
+    Metadata* result = DS_IntermediateDecodeWithMetadata(sink->stream, 1);
+    char* text = CandidateTranscriptToString(&result->transcripts[0]);
+    partial = text;
+    free(text);
+    DS_FreeMetadata(result);
+  } else {
+    char* text = DS_IntermediateDecode(sink->stream);
+    partial = text;
+    DS_FreeString(text);
+  }
+  if (!sink->has_last || partial != sink->last) {
+    printf("%s\n", partial.c_str());
+    sink->last = partial;
+    sink->has_last = true;
+  }
+  sink->ds_clocks += clock() - start;
+}
+
+int
+StreamSinkFlow(sox_effect_t* effp, const sox_sample_t* ibuf, sox_sample_t* obuf,
+               size_t* isamp, size_t* osamp)
+{
+  ds_stream_sink* sink = *(ds_stream_sink**)effp->priv;
+  SOX_SAMPLE_LOCALS;
+  for (size_t i = 0; i < *isamp; ++i) {
+    sink->pending.push_back(SOX_SAMPLE_TO_SIGNED_16BIT(ibuf[i], effp->clips));
+    if (sink->pending.size() == sink->chunk_size) {
+      FeedStreamSink(sink);
+    }
+  }
+  // This is the last effect of the chain, nothing is passed on
+  *osamp = 0;
+  return SOX_SUCCESS;
+}
+
+const sox_effect_handler_t*
+StreamSinkHandler()
+{
+  static sox_effect_handler_t handler = {
+    "deepspeech", NULL, SOX_EFF_MCHAN, NULL, NULL, StreamSinkFlow, NULL, NULL,
+    NULL, sizeof(ds_stream_sink*)
+  };
+  return &handler;
+}
+
+// Decode, resample and transcribe a file incrementally: audio is fed to a
+// stream as libsox produces it, so memory use does not depend on the length
+// of the file and intermediate results are printed right away.
+ds_result
+LocalDsSTTStreaming(ModelState* aCtx, const char* path,
+                    bool extended_output, bool json_output)
+{
+  ds_result res = {0};
+
+  clock_t ds_start_time = clock();
+
+  const int desired_sample_rate = DS_GetModelSampleRate(aCtx);
+
+  StreamingState* ctx;
+  int status = DS_CreateStream(aCtx, &ctx);
+  if (status != DS_ERR_OK) {
+    res.string = strdup("");
+    return res;
+  }
+
+  ds_stream_sink sink;
+  sink.stream = ctx;
+  sink.has_last = false;
+  sink.ds_clocks = clock() - ds_start_time;
+  sink.intermediate = !extended_output && !json_output &&
+                      (stream_size > 0 || extended_stream_size > 0);
+  sink.intermediate_metadata = sink.intermediate && stream_size == 0;
+  if (sink.intermediate) {
+    sink.chunk_size = stream_size > 0 ? stream_size : extended_stream_size;
+  } else {
+    // Half a second of audio at a time
+    sink.chunk_size = desired_sample_rate / 2;
+  }
+  sink.pending.reserve(sink.chunk_size);
+
+  sox_format_t* input = sox_open_read(path, NULL, NULL, NULL);
+  assert(input);
+
+  sox_signalinfo_t target_signal = {
+      static_cast<sox_rate_t>(desired_sample_rate), // Rate
+      1, // Channels
+      16, // Precision
+      SOX_UNSPEC, // Length
+      NULL // Effects headroom multiplier
+  };
+
+  if ((int)input->signal.rate < desired_sample_rate) {
+    fprintf(stderr, "Warning: original sample rate (%d) is lower than %dkHz. "
+                    "Up-sampling might produce erratic speech recognition.\n",
+                    desired_sample_rate, (int)input->signal.rate);
+  }
+
+  char* sox_args[10];
+  sox_effects_chain_t* chain = sox_create_effects_chain(&input->encoding, NULL);
+
+  sox_signalinfo_t interm_signal = input->signal;
+
+  sox_effect_t* e = sox_create_effect(sox_find_effect("input"));
+  sox_args[0] = (char*)input;
+  assert(sox_effect_options(e, 1, sox_args) == SOX_SUCCESS);
+  assert(sox_add_effect(chain, e, &interm_signal, &input->signal) ==
+         SOX_SUCCESS);
+  free(e);
+
+  e = sox_create_effect(sox_find_effect("rate"));
+  assert(sox_effect_options(e, 0, NULL) == SOX_SUCCESS);
+  assert(sox_add_effect(chain, e, &interm_signal, &target_signal) ==
+         SOX_SUCCESS);
+  free(e);
+
+  e = sox_create_effect(sox_find_effect("channels"));
+  assert(sox_effect_options(e, 0, NULL) == SOX_SUCCESS);
+  assert(sox_add_effect(chain, e, &interm_signal, &target_signal) ==
+         SOX_SUCCESS);
+  free(e);
+
+  e = sox_create_effect(StreamSinkHandler());
+  *(ds_stream_sink**)e->priv = &sink;
+  assert(sox_add_effect(chain, e, &interm_signal, &target_signal) ==
+         SOX_SUCCESS);
+  free(e);
+
+  sox_flow_effects(chain, NULL, NULL);
+  sox_delete_effects_chain(chain);
+  sox_close(input);
+
+  // Whatever is left is shorter than a chunk
+  FeedStreamSink(&sink);
+
+  clock_t ds_finish_time = clock();
+  if (extended_output || sink.intermediate_metadata) {
+    Metadata *result = DS_FinishStreamWithMetadata(ctx, 1);
+    res.string = CandidateTranscriptToString(&result->transcripts[0]);
+    DS_FreeMetadata(result);
+  } else if (json_output) {
+    WordMetadataList *result = DS_FinishStreamWithWords(ctx, json_candidate_transcripts);
+    res.string = WordMetadataToJSON(result);
+    DS_FreeWordMetadata(result);
+  } else {
+    res.string = DS_FinishStream(ctx);
+  }
+
+  clock_t ds_end_infer = clock();
+
+  res.cpu_time_overall =
+    ((double) (sink.ds_clocks + ds_end_infer - ds_finish_time)) / CLOCKS_PER_SEC;
+
+  return res;
+}
+#endif // NO_SOX
+
 void
 ProcessFile(ModelState* context, const char* path, bool show_times)
 {
+#ifndef NO_SOX
+  ds_result result = LocalDsSTTStreaming(context, path, extended_metadata,
+                                         json_output);
+#else
   ds_audio_buffer audio = GetAudioBuffer(path, DS_GetModelSampleRate(context));
 
   // Pass audio to DeepSpeech
@@ -415,6 +560,7 @@ ProcessFile(ModelState* context, const char* path, bool show_times)
                                 extended_metadata,
                                 json_output);
   free(audio.buffer);
+#endif // NO_SOX
 
   if (result.string) {
     printf("%s\n", result.string);
@@ -443,6 +589,169 @@ SplitStringOnDelim(std::string in_string, std::string delim)
   return out_vector;
 }
 
+#ifndef NO_DIR
+std::string
+JSONEscape(const std::string& in)
+{
+  std::string out;
+  out.reserve(in.size());
+  for (char c : in) {
+    switch (c) {
+    case '"':  out += "\\\""; break;
+    case '\\': out += "\\\\"; break;
+    case '\n': out += "\\n"; break;
+    case '\r': out += "\\r"; break;
+    case '\t': out += "\\t"; break;
+    default:
+      if ((unsigned char)c < 0x20) {
+        char escaped[7];
+        snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned char)c);
+        out += escaped;
+      } else {
+        out += c;
+      }
+    }
+  }
+  return out;
+}
+
+typedef struct {
+  std::string path;
+  ds_audio_buffer audio;
+} ds_batch_item;
+
+// Files decoded by the reader thread and waiting for a worker. The reader
+// blocks once |capacity| files are waiting, so memory use stays bounded.
+class BatchQueue {
+public:
+  explicit BatchQueue(size_t capacity)
+    : capacity_(capacity)
+    , closed_(false)
+  {
+  }
+
+  void push(const ds_batch_item& item)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_full_.wait(lock, [this] { return items_.size() < capacity_; });
+    items_.push_back(item);
+    not_empty_.notify_one();
+  }
+
+  // Returns false once the queue is closed and empty.
+  bool pop(ds_batch_item& item)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_empty_.wait(lock, [this] { return closed_ || !items_.empty(); });
+    if (items_.empty()) {
+      return false;
+    }
+    item = items_.front();
+    items_.pop_front();
+    not_full_.notify_one();
+    return true;
+  }
+
+  void close()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = true;
+    not_empty_.notify_all();
+  }
+
+private:
+  size_t capacity_;
+  bool closed_;
+  std::deque<ds_batch_item> items_;
+  std::mutex mutex_;
+  std::condition_variable not_full_;
+  std::condition_variable not_empty_;
+};
+
+void
+ProcessDirectoryParallel(ModelState* context, const char* dir_path,
+                         int num_workers, int num_prefetch)
+{
+  std::vector<std::string> paths;
+  DIR* wav_dir = opendir(dir_path);
+  assert(wav_dir);
+  struct dirent* entry;
+  while ((entry = readdir(wav_dir)) != NULL) {
+    std::string fname = std::string(entry->d_name);
+    if (fname.find(".wav") == std::string::npos) {
+      continue;
+    }
+    std::ostringstream fullpath;
+    fullpath << dir_path << "/" << fname;
+    paths.push_back(fullpath.str());
+  }
+  closedir(wav_dir);
+
+  const int sample_rate = DS_GetModelSampleRate(context);
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  // A single reader decodes the audio, libsox is not meant to be used from
+  // several threads at once
+  BatchQueue queue(num_prefetch);
+  std::thread reader([&] {
+    for (const std::string& path : paths) {
+      ds_batch_item item;
+      item.path = path;
+      item.audio = GetAudioBuffer(path.c_str(), sample_rate);
+      queue.push(item);
+    }
+    queue.close();
+  });
+
+  std::mutex output_mutex;
+  size_t num_files = 0;
+  double audio_seconds = 0.0;
+
+  std::vector<std::thread> pool;
+  for (int i = 0; i < num_workers; ++i) {
+    pool.emplace_back([&] {
+      ds_batch_item item;
+      while (queue.pop(item)) {
+        const unsigned int num_samples = item.audio.buffer_size / 2;
+        std::chrono::steady_clock::time_point file_start = std::chrono::steady_clock::now();
+        char* text = DS_SpeechToText(context, (const short*)item.audio.buffer, num_samples);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - file_start;
+        free(item.audio.buffer);
+
+        const double duration = (double)num_samples / sample_rate;
+        std::ostringstream line;
+        line << R"({"file":")" << JSONEscape(item.path)
+             << R"(","transcript":")" << JSONEscape(text ? text : "")
+             << R"(","duration":)" << duration
+             << R"(,"inference_time":)" << elapsed.count() << "}";
+        if (text) {
+          DS_FreeString(text);
+        }
+
+        // Results are printed as soon as they are available, so their order
+        // is the completion order
+        std::lock_guard<std::mutex> lock(output_mutex);
+        printf("%s\n", line.str().c_str());
+        fflush(stdout);
+        ++num_files;
+        audio_seconds += duration;
+      }
+    });
+  }
+
+  reader.join();
+  for (std::thread& worker : pool) {
+    worker.join();
+  }
+
+  std::chrono::duration<double> wall = std::chrono::steady_clock::now() - start;
+  fprintf(stderr, "Transcribed %zu files, %.2fs of audio in %.2fs with %d workers "
+                  "(%.2f audio seconds per second)\n",
+          num_files, audio_seconds, wall.count(), num_workers,
+          wall.count() > 0 ? audio_seconds / wall.count() : 0.0);
+}
+#endif // NO_DIR
+
 int
 main(int argc, char **argv)
 {
@@ -522,7 +831,9 @@ main(int argc, char **argv)
 
 #ifndef NO_DIR
     case S_IFDIR:
-        {
+        if (workers > 0) {
+          ProcessDirectoryParallel(ctx, audio, workers, prefetch);
+        } else {
           printf("Running on directory %s\n", audio);
           DIR* wav_dir = opendir(audio);
           assert(wav_dir);
@@ -555,6 +866,16 @@ main(int argc, char **argv)
   sox_quit();
 #endif // NO_SOX
 
+  if (show_stats) {
+    char* stats = DS_GetStatsJSON(ctx, NULL);
+    if (stats) {
+      fprintf(stderr, "%s\n", stats);
+      DS_FreeString(stats);
+    } else {
+      fprintf(stderr, "Statistics are not available in this build.\n");
+    }
+  }
+
   DS_FreeModel(ctx);
 
   return 0;
@@ -228,3 +228,70 @@ def ctc_beam_search_decoder_batch(probs_seq,
         for beam_results in batch_beam_results
     ]
     return batch_beam_results
+
+
+class DecoderPool(swigwrapper.DecoderPool):
+    """Pool of decoding threads kept alive across batches.
+
+    Creating a pool once and calling :func:`decode_batch` for every batch
+    avoids starting and joining threads on each call, as
+    :func:`ctc_beam_search_decoder_batch` does.
+
+    :param num_processes: Number of decoding threads.
+    :type num_processes: int
+    """
+    def __init__(self, num_processes):
+        super(DecoderPool, self).__init__(num_processes)
+
+    def decode_batch(self,
+                     probs_seq,
+                     seq_lengths,
+                     alphabet,
+                     beam_size,
+                     cutoff_prob=1.0,
+                     cutoff_top_n=40,
+                     scorer=None,
+                     hot_words=dict(),
+                     num_results=1):
+        """Decode a batch with the pool's threads. Parameters and return
+        value are the same as for :func:`ctc_beam_search_decoder_batch`,
+        minus num_processes.
+        """
+        batch_beam_results = super(DecoderPool, self).decode_batch(probs_seq, seq_lengths, alphabet, beam_size, cutoff_prob, cutoff_top_n, scorer, hot_words, num_results)
+        batch_beam_results = [
+            [(res.confidence, alphabet.Decode(res.tokens)) for res in beam_results]
+            for beam_results in batch_beam_results
+        ]
+        return batch_beam_results
+
+    def decode_batch_flat(self,
+                          probs,
+                          seq_lengths,
+                          alphabet,
+                          beam_size,
+                          cutoff_prob=1.0,
+                          cutoff_top_n=40,
+                          scorer=None,
+                          hot_words=dict(),
+                          num_results=1):
+        """Decode a batch of float32 probabilities with the pool's threads,
+        without holding the GIL. The array is used in place: any strides are
+        accepted as long as the classes of a timestep are contiguous.
+
+        :param probs: Probabilities of shape [batch, time, classes].
+        :type probs: numpy.ndarray of float32
+        :param seq_lengths: Number of timesteps of each utterance.
+        :type seq_lengths: numpy.ndarray of int32
+
+        Other parameters are the same as for :func:`decode_batch`.
+
+        :return: Tuple of arrays (confidences, offsets, tokens, timesteps).
+                 confidences has shape [batch, num_results]. Result r of
+                 utterance b is made of tokens[offsets[i]:offsets[i+1]] with
+                 i = b*num_results+r, and timesteps likewise. Missing results
+                 have a confidence of -inf and no tokens.
+        :rtype: tuple
+        """
+        result = super(DecoderPool, self).decode_batch_flat(probs, seq_lengths, alphabet, beam_size, cutoff_prob, cutoff_top_n, scorer, hot_words, num_results)
+        confidences = result.confidences_array().reshape(result.batch_size, result.num_results)
+        return confidences, result.offsets_array(), result.tokens_array(), result.timesteps_array()
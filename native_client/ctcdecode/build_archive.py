@@ -47,6 +47,9 @@ CTC_DECODER_FILES = [
     'scorer.cpp',
     'path_trie.cpp',
     'decoder_utils.cpp',
+    'lm_score_cache.cpp',
+    'snapshot.cpp',
+    'word_id_map.cpp',
     'workspace_status.cc',
     '../alphabet.cc',
 ]
@@ -12,6 +12,14 @@
 #include "fst/fstlib.h"
 #include "path_trie.h"
 
+const size_t DecoderState::kNoQuery;
+
+// Histogram of the adaptive beam: distances to the best prefix are counted
+// in bins of PRUNE_BIN_WIDTH nats, prefixes further than the last bin carry
+// a negligible share of the probability mass.
+static const size_t PRUNE_BINS = 64;
+static const float PRUNE_BIN_WIDTH = 0.25f;
+
 
 int
 DecoderState::init(const Alphabet& alphabet,
@@ -19,20 +27,55 @@ DecoderState::init(const Alphabet& alphabet,
                    double cutoff_prob,
                    size_t cutoff_top_n,
                    std::shared_ptr<Scorer> ext_scorer,
-                   std::unordered_map<std::string, float> hot_words)
+                   const std::unordered_map<std::string, float>& hot_words)
 {
   // assign special ids
   abs_time_step_ = 0;
   space_id_ = alphabet.GetSpaceLabel();
   blank_id_ = alphabet.GetSize();
 
+  // A state initialized again with the same scorer keeps its copy of the
+  // dictionary
+  bool same_dictionary = dictionary_ && ext_scorer == ext_scorer_;
+
   beam_size_ = beam_size;
   cutoff_prob_ = cutoff_prob;
   cutoff_top_n_ = cutoff_top_n;
   ext_scorer_ = ext_scorer;
   hot_words_ = hot_words;
-  start_expanding_ = false;
+  blank_skip_threshold_ = 0.0;
+  skipped_frames_ = 0;
+  commit_prefixes_ = false;
+
+  if (!same_dictionary) {
+    matcher_.reset();
+    dictionary_.reset();
+    word_ids_.reset();
+    if (ext_scorer && (bool)(ext_scorer_->dictionary)) {
+      // no need for std::make_shared<>() since Copy() does 'new' behind the doors
+      dictionary_ = std::shared_ptr<PathTrie::FstType>(ext_scorer->dictionary->Copy(true));
+      matcher_ = std::make_shared<fst::SortedMatcher<PathTrie::FstType>>(*dictionary_, fst::MATCH_INPUT);
+      // The copy has the same states and arcs, so the word ids apply to it
+      word_ids_ = ext_scorer->word_ids;
+    }
+  }
 
+  lm_cache_hits_ = 0;
+  lm_cache_misses_ = 0;
+  lm_lookahead_.reset();
+  greedy_ = false;
+  timing_ = TIMING_TOKENS;
+  beam_threshold_ = 0.0f;
+  adaptive_coverage_ = 0.0f;
+  adaptive_min_size_ = 1;
+  extension_cutoff_ = true;
+  reset();
+  return 0;
+}
+
+void
+DecoderState::init_root()
+{
   // init prefixes' root
   PathTrie *root = new PathTrie;
   root->score = root->log_prob_b_prev = 0.0;
@@ -40,15 +83,43 @@ DecoderState::init(const Alphabet& alphabet,
   prefix_root_->timesteps = &timestep_tree_root_;
   prefixes_.push_back(root);
 
-  if (ext_scorer && (bool)(ext_scorer_->dictionary)) {
-    // no need for std::make_shared<>() since Copy() does 'new' behind the doors
-    auto dict_ptr = std::shared_ptr<PathTrie::FstType>(ext_scorer->dictionary->Copy(true));
-    root->set_dictionary(dict_ptr);
-    auto matcher = std::make_shared<fst::SortedMatcher<PathTrie::FstType>>(*dict_ptr, fst::MATCH_INPUT);
-    root->set_matcher(matcher);
+  if (dictionary_) {
+    root->set_dictionary(dictionary_);
+    root->set_matcher(matcher_);
+    if (word_ids_) {
+      root->set_word_ids(word_ids_);
+    }
+    if (lm_lookahead_) {
+      root->set_lm_lookahead(lm_lookahead_);
+    }
   }
+}
 
-  return 0;
+void
+DecoderState::reset()
+{
+  start_expanding_ = false;
+  trailing_blank_frames_ = 0;
+  committed_ = Output();
+  committed_log_probs_.clear();
+  lm_cache_.clear();
+
+  best_path_nodes_.clear();
+  best_path_serials_.clear();
+  best_timestep_nodes_.clear();
+  best_output_ = Output();
+
+  greedy_last_label_ = blank_id_;
+  greedy_log_prob_ = 0.0;
+  greedy_path_ = Output();
+  greedy_log_probs_.clear();
+
+  // The trie only points into the timestep tree, so it can go first
+  prefixes_.clear();
+  prefix_root_.reset();
+  timestep_tree_root_.children.clear();
+
+  init_root();
 }
 
 void
@@ -56,16 +127,72 @@ DecoderState::next(const double *probs,
                    int time_dim,
                    int class_dim)
 {
+  next_impl(probs, time_dim, class_dim, class_dim);
+}
+
+void
+DecoderState::next(const float *probs,
+                   int time_dim,
+                   int class_dim,
+                   ptrdiff_t row_stride)
+{
+  next_impl(probs, time_dim, class_dim, row_stride);
+}
+
+template<typename T>
+void
+DecoderState::next_impl(const T *probs,
+                        int time_dim,
+                        int class_dim,
+                        ptrdiff_t row_stride)
+{
+  if (greedy_) {
+    next_greedy(probs, time_dim, class_dim, row_stride);
+    return;
+  }
+
+  switch (timing_) {
+  case TIMING_TOKENS:
+    next_beam<TIMING_TOKENS>(probs, time_dim, class_dim, row_stride);
+    break;
+  case TIMING_WORDS:
+    next_beam<TIMING_WORDS>(probs, time_dim, class_dim, row_stride);
+    break;
+  case TIMING_NONE:
+    next_beam<TIMING_NONE>(probs, time_dim, class_dim, row_stride);
+    break;
+  }
+
+  if (commit_prefixes_) {
+    commit_common_prefix();
+  }
+}
+
+template<TimingMode Mode, typename T>
+void
+DecoderState::next_beam(const T *probs,
+                        int time_dim,
+                        int class_dim,
+                        ptrdiff_t row_stride)
+{
+  DS_STATS_TIMER(extend_timer, stats_, STATS_STAGE_EXTEND);
+
   // prefix search over time
   for (size_t rel_time_step = 0; rel_time_step < time_dim; ++rel_time_step, ++abs_time_step_) {
-    auto *prob = &probs[rel_time_step*class_dim];
+    const T *prob = &probs[rel_time_step*row_stride];
+    // All arithmetic on probabilities is done in double precision, so float
+    // input decodes exactly like the same values converted to double
+    const double prob_blank = prob[blank_id_];
 
     // At the start of the decoding process, we delay beam expansion so that
     // timings on the first letters is not incorrect. As soon as we see a
     // timestep with blank probability lower than 0.999, we start expanding
     // beams.
-    if (prob[blank_id_] < 0.999) {
+    if (prob_blank < 0.999) {
       start_expanding_ = true;
+      trailing_blank_frames_ = 0;
+    } else if (start_expanding_) {
+      ++trailing_blank_frames_;
     }
 
     // If not expanding yet, just continue to next timestep.
@@ -73,36 +200,120 @@ DecoderState::next(const double *probs,
       continue;
     }
 
+    // Near-certain blanks can't extend any prefix, so only the blank
+    // transition is applied.
+    if (blank_skip_threshold_ > 0.0 && prob_blank >= blank_skip_threshold_) {
+      apply_blank_frame(log(prob_blank + NUM_FLT_MIN));
+      ++skipped_frames_;
+      continue;
+    }
+
+    // Extensions scoring below min_cutoff can't make it into the beam, so
+    // they are skipped when use_cutoff is set
     float min_cutoff = -NUM_FLT_INF;
-    bool full_beam = false;
-    if (ext_scorer_) {
+    bool use_cutoff = false;
+    if (ext_scorer_ || beam_threshold_ > 0.0f) {
       size_t num_prefixes = std::min(prefixes_.size(), beam_size_);
       std::partial_sort(prefixes_.begin(),
                         prefixes_.begin() + num_prefixes,
                         prefixes_.end(),
                         prefix_compare);
 
-      min_cutoff = prefixes_[num_prefixes - 1]->score +
-                   std::log(prob[blank_id_]) - std::max(0.0, ext_scorer_->beta);
-      full_beam = (num_prefixes == beam_size_);
+      // Largest amount an extension can score above its prefix followed by
+      // the character: the word insertion bonus, plus with look-ahead the
+      // look-ahead of the prefix, which a word end replaces with a language
+      // model score that can be higher
+      double max_gain = ext_scorer_ ? std::max(0.0, ext_scorer_->beta) : 0.0;
+      if (ext_scorer_ && lm_lookahead_) {
+        double max_refund = 0.0;
+        for (size_t i = 0; i < num_prefixes; ++i) {
+          max_refund = std::max(max_refund, -prefixes_[i]->lm_lookahead * ext_scorer_->alpha);
+        }
+        max_gain += max_refund;
+      }
+      if (ext_scorer_ && num_prefixes == beam_size_) {
+        min_cutoff = prefixes_[num_prefixes - 1]->score +
+                     std::log(prob_blank) - max_gain;
+        use_cutoff = extension_cutoff_;
+      }
+      // The best prefix followed by a blank stays within the best score of
+      // the timestep, and prune_prefixes() drops what's further than
+      // beam_threshold_ from it
+      if (beam_threshold_ > 0.0f) {
+        float threshold_cutoff = prefixes_[0]->score + std::log(prob_blank) -
+                                 beam_threshold_ - max_gain;
+        min_cutoff = std::max(min_cutoff, threshold_cutoff);
+        use_cutoff = true;
+      }
     }
 
     std::vector<std::pair<size_t, float>> log_prob_idx =
         get_pruned_log_probs(prob, class_dim, cutoff_prob_, cutoff_top_n_);
+
+    // Candidates are visited twice. The first pass extends the prefixes in
+    // the trie and queues the word boundaries to score, which are then sent
+    // to the language model together, and the second pass combines the
+    // probabilities. Prefix scores don't change during a timestep, so both
+    // passes visit the same candidates in the same order.
+    DS_STATS_START(extend_timer);
+    expansions_.clear();
+    num_lm_requests_ = 0;
+    for (size_t index = 0; index < log_prob_idx.size(); index++) {
+      auto c = log_prob_idx[index].first;
+      auto log_prob_c = log_prob_idx[index].second;
+
+      for (size_t i = 0; i < prefixes_.size() && i < beam_size_; ++i) {
+        auto prefix = prefixes_[i];
+        if (use_cutoff && log_prob_c + prefix->score < min_cutoff) {
+          break;
+        }
+        if (prefix->score == -NUM_FLT_INF || c == blank_id_) {
+          continue;
+        }
+
+        // get new prefix
+        Expansion expansion;
+        expansion.prefix_new = prefix->get_path_trie(c, log_prob_c);
+        expansion.lm_request = -1;
+
+        if (expansion.prefix_new != nullptr && ext_scorer_) {
+          // skip scoring the space in word based LMs
+          PathTrie* prefix_to_score;
+          if (ext_scorer_->is_utf8_mode()) {
+            prefix_to_score = expansion.prefix_new;
+          } else {
+            prefix_to_score = prefix;
+          }
+
+          if (ext_scorer_->is_scoring_boundary(prefix_to_score, c)) {
+            expansion.lm_request = add_lm_request(prefix_to_score, expansion.prefix_new);
+          }
+        }
+        expansions_.push_back(expansion);
+      }
+    }
+    DS_STATS_STOP(extend_timer);
+    DS_STATS_ADD(stats_, STATS_COUNTER_FST_LOOKUPS, expansions_.size());
+
+    if (num_lm_requests_ > 0) {
+      resolve_lm_requests();
+    }
+
     // loop over class dim
+    size_t next_expansion = 0;
     for (size_t index = 0; index < log_prob_idx.size(); index++) {
       auto c = log_prob_idx[index].first;
       auto log_prob_c = log_prob_idx[index].second;
 
       for (size_t i = 0; i < prefixes_.size() && i < beam_size_; ++i) {
         auto prefix = prefixes_[i];
-        if (full_beam && log_prob_c + prefix->score < min_cutoff) {
+        if (use_cutoff && log_prob_c + prefix->score < min_cutoff) {
           break;
         }
         if (prefix->score == -NUM_FLT_INF) {
           continue;
         }
-        assert(prefix->timesteps != nullptr);
+        assert(Mode != TIMING_TOKENS || prefix->timesteps != nullptr);
 
         // blank
         if (c == blank_id_) {
@@ -113,7 +324,11 @@ DecoderState::next(const double *probs,
           // the blank label comes last, so we can compare log_prob_nb_cur with log_p
           if (prefix->log_prob_nb_cur < log_p) {
             // keep current timesteps
-            prefix->previous_timesteps = nullptr;
+            if (Mode == TIMING_TOKENS) {
+              prefix->previous_timesteps = nullptr;
+            } else if (Mode == TIMING_WORDS) {
+              prefix->has_new_timestep = false;
+            }
           }
           prefix->log_prob_b_cur =
               log_sum_exp(prefix->log_prob_b_cur, log_p);
@@ -128,14 +343,19 @@ DecoderState::next(const double *probs,
           // combine current path with previous ones with the same prefix
           if (prefix->log_prob_nb_cur < log_p) {
             // keep current timesteps
-            prefix->previous_timesteps = nullptr;
+            if (Mode == TIMING_TOKENS) {
+              prefix->previous_timesteps = nullptr;
+            } else if (Mode == TIMING_WORDS) {
+              prefix->has_new_timestep = false;
+            }
           }
           prefix->log_prob_nb_cur = log_sum_exp(
               prefix->log_prob_nb_cur, log_p);
         }
 
-        // get new prefix
-        auto prefix_new = prefix->get_path_trie(c, log_prob_c);
+        // new prefix, from the first pass
+        const Expansion& expansion = expansions_[next_expansion++];
+        PathTrie* prefix_new = expansion.prefix_new;
 
         if (prefix_new != nullptr) {
           // compute probability of current path
@@ -148,48 +368,31 @@ DecoderState::next(const double *probs,
             log_p = log_prob_c + prefix->score;
           }
 
+          // language model look-ahead, cancelled out at word boundaries. Both
+          // are 0 when look-ahead is disabled.
           if (ext_scorer_) {
-            // skip scoring the space in word based LMs
-            PathTrie* prefix_to_score;
-            if (ext_scorer_->is_utf8_mode()) {
-              prefix_to_score = prefix_new;
-            } else {
-              prefix_to_score = prefix;
-            }
+            log_p += (prefix_new->lm_lookahead - prefix->lm_lookahead) * ext_scorer_->alpha;
+          }
 
-            // language model scoring
-            if (ext_scorer_->is_scoring_boundary(prefix_to_score, c)) {
-              float score = 0.0;
-              std::vector<std::string> ngram;
-              ngram = ext_scorer_->make_ngram(prefix_to_score);
-
-              float hot_boost = 0.0;
-              if (!hot_words_.empty()) {
-                std::unordered_map<std::string, float>::iterator iter;
-                // increase prob of prefix for every word
-                // that matches a word in the hot-words list
-                for (std::string word : ngram) {
-                  iter = hot_words_.find(word);
-                  if ( iter != hot_words_.end() ) {
-                    // increase the log_cond_prob(prefix|LM)
-                    hot_boost += iter->second;
-                  }
-                }
-              }
-
-              bool bos = ngram.size() < ext_scorer_->get_max_order();
-              score = ( ext_scorer_->get_log_cond_prob(ngram, bos) + hot_boost ) * ext_scorer_->alpha;
-              log_p += score;
-              log_p += ext_scorer_->beta;
-            }
+          // language model scoring
+          if (expansion.lm_request >= 0) {
+            const LMRequest& request = lm_requests_[expansion.lm_request];
+            float score = ( request.log_prob + request.hot_boost ) * ext_scorer_->alpha;
+            log_p += score;
+            log_p += ext_scorer_->beta;
           }
 
           // combine current path with previous ones with the same prefix
           if (prefix_new->log_prob_nb_cur < log_p) {
             // record data needed to update timesteps
             // the actual update will be done if nothing better is found
-            prefix_new->previous_timesteps = prefix->timesteps;
-            prefix_new->new_timestep = abs_time_step_;
+            if (Mode == TIMING_TOKENS) {
+              prefix_new->previous_timesteps = prefix->timesteps;
+              prefix_new->new_timestep = abs_time_step_;
+            } else if (Mode == TIMING_WORDS) {
+              prefix_new->new_timestep = abs_time_step_;
+              prefix_new->has_new_timestep = true;
+            }
           }
           prefix_new->log_prob_nb_cur =
               log_sum_exp(prefix_new->log_prob_nb_cur, log_p);
@@ -199,71 +402,1073 @@ DecoderState::next(const double *probs,
 
     // update log probs
     prefixes_.clear();
-    prefix_root_->iterate_to_vec(prefixes_);
-
-    // only preserve top beam_size prefixes
-    if (prefixes_.size() > beam_size_) {
-      std::nth_element(prefixes_.begin(),
-                       prefixes_.begin() + beam_size_,
-                       prefixes_.end(),
-                       prefix_compare);
-      for (size_t i = beam_size_; i < prefixes_.size(); ++i) {
-        prefixes_[i]->remove();
+    prefix_root_->iterate_to_vec<Mode>(prefixes_);
+
+    prune_prefixes();
+  }  // end of loop over time
+}
+
+void
+DecoderState::prune_prefixes()
+{
+  size_t num_kept = std::min(prefixes_.size(), beam_size_);
+
+  if ((beam_threshold_ > 0.0f || adaptive_coverage_ > 0.0f) && !prefixes_.empty()) {
+    float best = -NUM_FLT_INF;
+    for (const PathTrie* prefix : prefixes_) {
+      best = std::max(best, prefix->score);
+    }
+
+    if (best > -NUM_FLT_INF) {
+      // One pass over the prefixes fills the histogram of their distances
+      // to the best one, the last bin takes the ones too far to count
+      size_t histogram[PRUNE_BINS + 1] = {0};
+      size_t num_within_threshold = 0;
+      for (const PathTrie* prefix : prefixes_) {
+        float distance = best - prefix->score;
+        if (distance <= beam_threshold_) {
+          ++num_within_threshold;
+        }
+        size_t bin = PRUNE_BINS;
+        if (distance < PRUNE_BINS * PRUNE_BIN_WIDTH) {
+          bin = static_cast<size_t>(distance / PRUNE_BIN_WIDTH);
+        }
+        ++histogram[bin];
       }
 
-      // Remove the elements from std::vector
-      prefixes_.resize(beam_size_);
+      if (beam_threshold_ > 0.0f) {
+        num_kept = std::min(num_kept, num_within_threshold);
+      }
+
+      if (adaptive_coverage_ > 0.0f) {
+        // Probability mass of each bin relative to the best prefix
+        double bin_mass[PRUNE_BINS];
+        double total_mass = 0.0;
+        for (size_t bin = 0; bin < PRUNE_BINS; ++bin) {
+          bin_mass[bin] = histogram[bin] * std::exp(-(bin + 0.5) * PRUNE_BIN_WIDTH);
+          total_mass += bin_mass[bin];
+        }
+
+        // Keep whole bins, best first, until they hold the requested share
+        // of the mass
+        double mass = 0.0;
+        size_t num_covering = 0;
+        for (size_t bin = 0; bin < PRUNE_BINS && mass < adaptive_coverage_ * total_mass; ++bin) {
+          mass += bin_mass[bin];
+          num_covering += histogram[bin];
+        }
+        num_kept = std::min(num_kept, std::max(num_covering, adaptive_min_size_));
+      }
     }
-  }  // end of loop over time
+  }
+
+  // only preserve top num_kept prefixes
+  if (prefixes_.size() > num_kept) {
+    std::nth_element(prefixes_.begin(),
+                     prefixes_.begin() + num_kept,
+                     prefixes_.end(),
+                     prefix_compare);
+    for (size_t i = num_kept; i < prefixes_.size(); ++i) {
+      prefixes_[i]->remove();
+    }
+
+    // Remove the elements from std::vector
+    prefixes_.resize(num_kept);
+  }
 }
 
-std::vector<Output>
-DecoderState::decode(size_t num_results) const
+template<typename T>
+void
+DecoderState::next_greedy(const T *probs,
+                          int time_dim,
+                          int class_dim,
+                          ptrdiff_t row_stride)
+{
+  for (size_t rel_time_step = 0; rel_time_step < time_dim; ++rel_time_step, ++abs_time_step_) {
+    const T *prob = &probs[rel_time_step*row_stride];
+    const double prob_blank = prob[blank_id_];
+
+    // Same bookkeeping as the beam search, for endpointing
+    if (prob_blank < 0.999) {
+      start_expanding_ = true;
+      trailing_blank_frames_ = 0;
+    } else if (start_expanding_) {
+      ++trailing_blank_frames_;
+    }
+
+    int label = blank_id_;
+    double prob_label = prob_blank;
+    if (blank_skip_threshold_ > 0.0 && prob_blank >= blank_skip_threshold_) {
+      ++skipped_frames_;
+    } else {
+      // Most probable class, the first one on ties. The classes of a
+      // timestep are contiguous, so this is a single pass over a short row.
+      label = 0;
+      T best = prob[0];
+      for (int c = 1; c < class_dim; ++c) {
+        if (prob[c] > best) {
+          best = prob[c];
+          label = c;
+        }
+      }
+      prob_label = best;
+    }
+
+    const float log_prob = log(prob_label + NUM_FLT_MIN);
+    greedy_log_prob_ += log_prob;
+
+    // Blanks separate tokens, a label repeated without one is the same token
+    if (label != blank_id_ && label != greedy_last_label_) {
+      greedy_path_.tokens.push_back(label);
+      greedy_path_.timesteps.push_back(abs_time_step_);
+      greedy_log_probs_.push_back(log_prob);
+    }
+    greedy_last_label_ = label;
+  }
+
+  // No other hypothesis can take over the best path, all of it is final
+  if (commit_prefixes_) {
+    committed_.tokens.insert(committed_.tokens.end(),
+                             greedy_path_.tokens.begin(),
+                             greedy_path_.tokens.end());
+    committed_.timesteps.insert(committed_.timesteps.end(),
+                                greedy_path_.timesteps.begin(),
+                                greedy_path_.timesteps.end());
+    committed_log_probs_.insert(committed_log_probs_.end(),
+                                greedy_log_probs_.begin(),
+                                greedy_log_probs_.end());
+    greedy_path_.tokens.clear();
+    greedy_path_.timesteps.clear();
+    greedy_log_probs_.clear();
+  }
+}
+
+void
+DecoderState::apply_blank_frame(float log_prob_blank)
+{
+  // Same update as a timestep where blank is the only candidate: prefixes
+  // can't be extended or merged, so their order, and thus the beam, is kept.
+  for (PathTrie* prefix : prefixes_) {
+    if (prefix->score == -NUM_FLT_INF) {
+      continue;
+    }
+    prefix->score += log_prob_blank;
+    prefix->log_prob_b_prev = prefix->score;
+    prefix->log_prob_nb_prev = -NUM_FLT_INF;
+  }
+}
+
+void
+DecoderState::skip_blank_frames(size_t num_frames)
+{
+  abs_time_step_ += num_frames;
+  if (num_frames > 0) {
+    greedy_last_label_ = blank_id_;
+  }
+  if (start_expanding_ && num_frames > 0) {
+    apply_blank_frame(0.0);
+    trailing_blank_frames_ += num_frames;
+    skipped_frames_ += num_frames;
+  }
+}
+
+void
+DecoderState::set_blank_skip_threshold(double threshold)
+{
+  blank_skip_threshold_ = threshold;
+}
+
+size_t
+DecoderState::get_skipped_frames() const
+{
+  return skipped_frames_;
+}
+
+void
+DecoderState::set_prefix_commitment(bool enable)
+{
+  commit_prefixes_ = enable;
+}
+
+size_t
+DecoderState::get_trailing_blank_frames() const
+{
+  return trailing_blank_frames_;
+}
+
+void
+DecoderState::set_lm_cache_size(size_t slots)
+{
+  lm_cache_.set_slots(slots);
+}
+
+size_t
+DecoderState::get_lm_cache_hits() const
+{
+  return lm_cache_hits_;
+}
+
+size_t
+DecoderState::get_lm_cache_misses() const
+{
+  return lm_cache_misses_;
+}
+
+bool
+DecoderState::set_lm_lookahead(bool enable)
+{
+  std::shared_ptr<const std::vector<float>> scores;
+  if (enable) {
+    if (!dictionary_ || !ext_scorer_->lm_lookahead) {
+      return false;
+    }
+    scores = ext_scorer_->lm_lookahead;
+  }
+  if (scores != lm_lookahead_) {
+    lm_lookahead_ = scores;
+    // Prefix scores include the look-ahead of the previous setting
+    reset();
+  }
+  return true;
+}
+
+bool
+DecoderState::set_greedy(bool enable)
+{
+  if (enable && ext_scorer_) {
+    return false;
+  }
+  greedy_ = enable;
+  return true;
+}
+
+void
+DecoderState::set_timing_mode(TimingMode mode)
+{
+  if (mode != timing_) {
+    timing_ = mode;
+    // Prefixes only carry the timing information of the previous mode
+    reset();
+  }
+}
+
+void
+DecoderState::set_extension_cutoff(bool enable)
+{
+  extension_cutoff_ = enable;
+}
+
+void
+DecoderState::set_beam_threshold(float threshold)
+{
+  beam_threshold_ = std::max(0.0f, threshold);
+}
+
+void
+DecoderState::set_adaptive_beam(float coverage, size_t min_size)
+{
+  adaptive_coverage_ = std::max(0.0f, coverage);
+  adaptive_min_size_ = std::max<size_t>(1, min_size);
+}
+
+void
+DecoderState::set_stats(StatsCollector* stats)
+{
+  stats_ = stats;
+}
+
+Output
+DecoderState::take_committed()
+{
+  Output committed;
+  std::swap(committed, committed_);
+  committed_log_probs_.clear();
+  committed.confidence = 0.0;
+  return committed;
+}
+
+void
+DecoderState::save(SnapshotWriter& writer) const
+{
+  // What load() checks against the state it's given
+  writer.put<int32_t>(blank_id_);
+  writer.put<int32_t>(space_id_);
+  writer.put<uint8_t>(ext_scorer_ != nullptr);
+  writer.put<uint64_t>(dictionary_ ? dictionary_->NumStates() : 0);
+
+  writer.put<uint64_t>(beam_size_);
+  writer.put(cutoff_prob_);
+  writer.put<uint64_t>(cutoff_top_n_);
+  writer.put(blank_skip_threshold_);
+  writer.put<uint8_t>(commit_prefixes_);
+  writer.put<uint8_t>(lm_lookahead_ != nullptr);
+  writer.put<uint8_t>(greedy_);
+  writer.put<int32_t>(timing_);
+  writer.put(beam_threshold_);
+  writer.put(adaptive_coverage_);
+  writer.put<uint64_t>(adaptive_min_size_);
+
+  writer.put<int32_t>(abs_time_step_);
+  writer.put<uint8_t>(start_expanding_);
+  writer.put<uint64_t>(trailing_blank_frames_);
+  writer.put<uint64_t>(skipped_frames_);
+  writer.put_output(committed_);
+  writer.put_vector(committed_log_probs_);
+  writer.put<int32_t>(greedy_last_label_);
+  writer.put(greedy_log_prob_);
+  writer.put_output(greedy_path_);
+  writer.put_vector(greedy_log_probs_);
+
+  // Timestep tree nodes the prefixes point to along with their ancestors,
+  // parents first, as the index of the parent and the timestep. The root is
+  // index 0, nodes no prefix leads to are left out.
+  std::vector<PathTrie*> trie_nodes;
+  prefix_root_->get_all_nodes(trie_nodes);
+  std::unordered_map<const TimestepTreeNode*, uint32_t> timestep_ids{{&timestep_tree_root_, 0}};
+  std::vector<const TimestepTreeNode*> timestep_nodes;
+  std::vector<const TimestepTreeNode*> chain;
+  for (const PathTrie* node : trie_nodes) {
+    chain.clear();
+    for (const TimestepTreeNode* t = node->timesteps;
+         t != nullptr && timestep_ids.find(t) == timestep_ids.end();
+         t = t->parent) {
+      chain.push_back(t);
+    }
+    for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+      timestep_ids[*it] = timestep_nodes.size() + 1;
+      timestep_nodes.push_back(*it);
+    }
+  }
+  writer.put<uint32_t>(timestep_nodes.size());
+  for (const TimestepTreeNode* t : timestep_nodes) {
+    writer.put(timestep_ids[t->parent]);
+    writer.put(t->data);
+  }
+
+  // The trie, then the prefixes in the beam as indices of its nodes in the
+  // order they were written, keeping the order of prefixes_ so decoding
+  // breaks ties the same way.
+  std::vector<const PathTrie*> saved_nodes;
+  prefix_root_->save(writer, timestep_ids, saved_nodes);
+  std::unordered_map<const PathTrie*, uint32_t> node_ids;
+  for (size_t i = 0; i < saved_nodes.size(); ++i) {
+    node_ids[saved_nodes[i]] = i;
+  }
+  writer.put<uint32_t>(prefixes_.size());
+  for (const PathTrie* prefix : prefixes_) {
+    writer.put(node_ids[prefix]);
+  }
+}
+
+// Whether all tokens of an output are labels of the alphabet.
+static bool
+valid_tokens(const Output& output, int blank_id)
+{
+  for (unsigned int token : output.tokens) {
+    if (token >= (unsigned int)blank_id) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool
+DecoderState::load(SnapshotReader& reader)
+{
+  int32_t blank_id, space_id;
+  uint8_t has_scorer;
+  uint64_t num_dictionary_states;
+  reader.get(blank_id);
+  reader.get(space_id);
+  reader.get(has_scorer);
+  reader.get(num_dictionary_states);
+  if (reader.failed()) {
+    return false;
+  }
+  if (blank_id != blank_id_ || space_id != space_id_ ||
+      (bool)has_scorer != (ext_scorer_ != nullptr) ||
+      num_dictionary_states != (uint64_t)(dictionary_ ? dictionary_->NumStates() : 0)) {
+    return false;
+  }
+
+  uint64_t beam_size, cutoff_top_n, adaptive_min_size;
+  double cutoff_prob, blank_skip_threshold;
+  uint8_t commit_prefixes, lookahead, greedy;
+  int32_t timing;
+  float beam_threshold, adaptive_coverage;
+  reader.get(beam_size);
+  reader.get(cutoff_prob);
+  reader.get(cutoff_top_n);
+  reader.get(blank_skip_threshold);
+  reader.get(commit_prefixes);
+  reader.get(lookahead);
+  reader.get(greedy);
+  reader.get(timing);
+  reader.get(beam_threshold);
+  reader.get(adaptive_coverage);
+  reader.get(adaptive_min_size);
+  if (reader.failed()) {
+    return false;
+  }
+  if (beam_size != beam_size_) {
+    // the beam width is a setting of the model, not of the stream
+    return false;
+  }
+  if (timing < TIMING_TOKENS || timing > TIMING_NONE ||
+      (greedy && ext_scorer_)) {
+    return reader.fail();
+  }
+  // Values the setters and the API reject or clamp
+  if (!(cutoff_prob >= 0.0 && cutoff_prob <= 1.0) ||
+      std::isnan(blank_skip_threshold) ||
+      !(beam_threshold >= 0.0f) ||
+      !(adaptive_coverage >= 0.0f && adaptive_coverage <= 1.0f)) {
+    return reader.fail();
+  }
+  if (lookahead && (!dictionary_ || !ext_scorer_->lm_lookahead)) {
+    // saved with look-ahead scores this scorer doesn't have
+    return false;
+  }
+  cutoff_prob_ = cutoff_prob;
+  cutoff_top_n_ = cutoff_top_n;
+  blank_skip_threshold_ = blank_skip_threshold;
+  beam_threshold_ = beam_threshold;
+  adaptive_coverage_ = adaptive_coverage;
+  commit_prefixes_ = commit_prefixes;
+  greedy_ = greedy;
+  timing_ = (TimingMode)timing;
+  adaptive_min_size_ = std::max<size_t>(1, adaptive_min_size);
+  lm_lookahead_ = lookahead ? ext_scorer_->lm_lookahead : nullptr;
+  reset();
+
+  uint8_t start_expanding = 0;
+  uint64_t trailing_blank_frames = 0, skipped_frames = 0;
+  reader.get(abs_time_step_);
+  reader.get(start_expanding);
+  reader.get(trailing_blank_frames);
+  reader.get(skipped_frames);
+  reader.get_output(committed_);
+  reader.get_vector(committed_log_probs_);
+  reader.get(greedy_last_label_);
+  reader.get(greedy_log_prob_);
+  reader.get_output(greedy_path_);
+  reader.get_vector(greedy_log_probs_);
+  if (reader.failed()) {
+    return false;
+  }
+  start_expanding_ = start_expanding;
+  trailing_blank_frames_ = trailing_blank_frames;
+  skipped_frames_ = skipped_frames;
+  if (!valid_tokens(committed_, blank_id_) || !valid_tokens(greedy_path_, blank_id_) ||
+      committed_log_probs_.size() != committed_.tokens.size() ||
+      greedy_log_probs_.size() != greedy_path_.tokens.size() ||
+      greedy_last_label_ < 0 || greedy_last_label_ > blank_id_) {
+    return reader.fail();
+  }
+
+  uint32_t num_timesteps;
+  reader.get(num_timesteps);
+  std::vector<TimestepTreeNode*> timesteps{&timestep_tree_root_};
+  std::unordered_map<const TimestepTreeNode*, unsigned int> timestep_depths{{&timestep_tree_root_, 0}};
+  for (uint32_t i = 0; i < num_timesteps && !reader.failed(); ++i) {
+    uint32_t parent_id;
+    unsigned int timestep;
+    reader.get(parent_id);
+    reader.get(timestep);
+    if (parent_id >= timesteps.size()) {
+      return reader.fail();
+    }
+    TimestepTreeNode* node = add_child(timesteps[parent_id], timestep);
+    timestep_depths[node] = timestep_depths[node->parent] + 1;
+    timesteps.push_back(node);
+  }
+
+  // The root from reset() already has the dictionary and look-ahead scores
+  std::vector<PathTrie*> nodes;
+  if (!prefix_root_->load(reader, timesteps, lm_lookahead_, nodes)) {
+    return false;
+  }
+  if (!prefix_root_->is_empty()) {
+    return reader.fail();
+  }
+  for (size_t i = 1; i < nodes.size(); ++i) {
+    if (nodes[i]->character >= (unsigned int)blank_id_) {
+      return reader.fail();
+    }
+  }
+  // With TIMING_TOKENS, each prefix has one timestep per character since
+  // the root
+  for (const PathTrie* node : nodes) {
+    if (timing_ == TIMING_TOKENS && node->timesteps != nullptr &&
+        timestep_depths[node->timesteps] != node->depth - prefix_root_->depth) {
+      return reader.fail();
+    }
+  }
+
+  uint32_t num_prefixes;
+  reader.get(num_prefixes);
+  prefixes_.clear();
+  for (uint32_t i = 0; i < num_prefixes && !reader.failed(); ++i) {
+    uint32_t id;
+    reader.get(id);
+    if (id >= nodes.size() || !nodes[id]->exists() ||
+        (timing_ == TIMING_TOKENS && nodes[id]->timesteps == nullptr)) {
+      return reader.fail();
+    }
+    prefixes_.push_back(nodes[id]);
+  }
+  if (prefixes_.empty()) {
+    return reader.fail();
+  }
+  return !reader.failed();
+}
+
+// Map a node of the timestep tree to the equivalent node in the tree re-rooted
+// after committing num_committed timesteps. level is the number of timesteps
+// from the root to tree_node.
+static TimestepTreeNode*
+remap_timesteps(TimestepTreeNode* tree_node,
+                size_t level,
+                size_t num_committed,
+                TimestepTreeNode* new_root,
+                std::unordered_map<const TimestepTreeNode*, TimestepTreeNode*>& remapped)
 {
-  std::vector<PathTrie*> prefixes_copy = prefixes_;
-  std::unordered_map<const PathTrie*, float> scores;
-  for (PathTrie* prefix : prefixes_copy) {
-    scores[prefix] = prefix->score;
+  std::vector<TimestepTreeNode*> chain;
+  TimestepTreeNode* mapped = new_root;
+  for (; level > num_committed; --level) {
+    auto it = remapped.find(tree_node);
+    if (it != remapped.end()) {
+      mapped = it->second;
+      break;
+    }
+    chain.push_back(tree_node);
+    tree_node = tree_node->parent;
   }
 
-  // score the last word of each prefix that doesn't end with space
+  for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+    TimestepTreeNode* child = nullptr;
+    for (auto const& c : mapped->children) {
+      if (c->data == (*it)->data) {
+        child = c.get();
+        break;
+      }
+    }
+    if (child == nullptr) {
+      child = add_child(mapped, (*it)->data);
+    }
+    remapped[*it] = child;
+    mapped = child;
+  }
+  return mapped;
+}
+
+void
+DecoderState::commit_common_prefix()
+{
+  PathTrie* root = prefix_root_.get();
+  PathTrie* common = root->get_common_ancestor();
+  if (common == root) {
+    return;
+  }
+
+  PathTrie* new_root;
   if (ext_scorer_) {
-    for (size_t i = 0; i < beam_size_ && i < prefixes_copy.size(); ++i) {
-      PathTrie* prefix = prefixes_copy[i];
-      PathTrie* prefix_boundary = ext_scorer_->is_utf8_mode() ? prefix : prefix->parent;
-      if (prefix_boundary && !ext_scorer_->is_scoring_boundary(prefix_boundary, prefix->character)) {
-        float score = 0.0;
-        std::vector<std::string> ngram = ext_scorer_->make_ngram(prefix);
-        bool bos = ngram.size() < ext_scorer_->get_max_order();
-        score = ext_scorer_->get_log_cond_prob(ngram, bos) * ext_scorer_->alpha;
-        score += ext_scorer_->beta;
-        scores[prefix] += score;
+    // The scorer looks back at most max_order words (or codepoints in UTF-8
+    // mode) from the prefix it scores, so they have to stay in the trie. In
+    // UTF-8 mode label L stands for byte L+1, see UTF8Alphabet.
+    size_t units = 0;
+    PathTrie* node = common;
+    for (; node != root; node = node->parent) {
+      bool unit_start = ext_scorer_->is_utf8_mode()
+                        ? byte_is_codepoint_boundary(node->character + 1)
+                        : node->character == space_id_;
+      if (unit_start && ++units == ext_scorer_->get_max_order()) {
+        break;
+      }
+    }
+    if (node == root) {
+      return;
+    }
+    new_root = node->parent;
+  } else {
+    // An existing node can still be extended by a repeated character, so it
+    // has to stay in the beam
+    new_root = common->exists() ? common->parent : common;
+  }
+  if (new_root == root) {
+    return;
+  }
+
+  // Different beams can have different timesteps for the committed
+  // characters, use the ones of the best beam
+  std::vector<unsigned int> timesteps;
+  if (timing_ == TIMING_TOKENS) {
+    PathTrie* best = *std::min_element(prefixes_.begin(), prefixes_.end(), prefix_compare);
+    if (best->timesteps == nullptr) {
+      return;
+    }
+    timesteps = get_history(best->timesteps, &timestep_tree_root_);
+  } else {
+    append_node_timesteps(new_root, timesteps);
+  }
+
+  std::vector<unsigned int> tokens;
+  std::vector<float> log_probs;
+  for (PathTrie* node = new_root; node != root; node = node->parent) {
+    tokens.push_back(node->character);
+    log_probs.push_back(node->log_prob_c);
+  }
+  std::reverse(tokens.begin(), tokens.end());
+  std::reverse(log_probs.begin(), log_probs.end());
+  size_t num_committed = tokens.size();
+  assert(timesteps.size() >= num_committed);
+
+  committed_.tokens.insert(committed_.tokens.end(), tokens.begin(), tokens.end());
+  committed_log_probs_.insert(committed_log_probs_.end(), log_probs.begin(), log_probs.end());
+  committed_.timesteps.insert(committed_.timesteps.end(),
+                              timesteps.begin(),
+                              timesteps.begin() + num_committed);
+
+  if (timing_ == TIMING_TOKENS) {
+    // Rebuild the timestep tree without the committed part. The old tree is
+    // kept alive until all nodes have been remapped.
+    auto old_timestep_children = std::move(timestep_tree_root_.children);
+    timestep_tree_root_.children.clear();
+
+    std::unordered_map<const TimestepTreeNode*, TimestepTreeNode*> remapped;
+    std::vector<PathTrie*> nodes;
+    new_root->get_all_nodes(nodes);
+    for (PathTrie* node : nodes) {
+      assert(node->previous_timesteps == nullptr);
+      if (node->timesteps != nullptr) {
+        node->timesteps = remap_timesteps(node->timesteps,
+                                          node->depth - root->depth,
+                                          num_committed,
+                                          &timestep_tree_root_,
+                                          remapped);
+      }
+    }
+    old_timestep_children.clear();
+  }
+
+  // Drop the committed characters from the prefix trie
+  new_root->make_root();
+  new_root->timesteps = &timestep_tree_root_;
+  prefix_root_.reset(new_root);
+
+  // Cached nodes might have been freed
+  best_path_nodes_.clear();
+  best_path_serials_.clear();
+  best_timestep_nodes_.clear();
+  best_output_ = Output();
+}
+
+double
+DecoderState::get_lm_log_prob(const std::vector<std::string>& ngram, bool bos) const
+{
+  double log_prob;
+  LMScoreCache::make_key(ngram, bos, lm_key_);
+  if (lm_cache_.lookup(lm_key_, &log_prob)) {
+    ++lm_cache_hits_;
+    DS_STATS_ADD(stats_, STATS_COUNTER_LM_CACHE_HITS, 1);
+    return log_prob;
+  }
+  ++lm_cache_misses_;
+  DS_STATS_ADD(stats_, STATS_COUNTER_LM_CACHE_MISSES, 1);
+  log_prob = ext_scorer_->get_log_cond_prob(ngram, bos);
+  lm_cache_.insert(lm_key_, log_prob);
+  return log_prob;
+}
+
+int
+DecoderState::add_lm_request(PathTrie* prefix_to_score, PathTrie* word_end)
+{
+  if (num_lm_requests_ == lm_requests_.size()) {
+    lm_requests_.emplace_back();
+  }
+  LMRequest& request = lm_requests_[num_lm_requests_];
+
+  // Hot-words are matched on strings
+  request.use_ids = word_end->ends_word && hot_words_.empty();
+  if (request.use_ids) {
+    request.num_ids = ext_scorer_->make_ngram_ids(word_end, request.ids);
+    request.hot_boost = 0.0;
+    request.bos = request.num_ids < ext_scorer_->get_max_order();
+    LMScoreCache::make_key(request.ids, request.num_ids, request.bos, request.key);
+    return (int)num_lm_requests_++;
+  }
+
+  request.ngram = ext_scorer_->make_ngram(prefix_to_score);
+
+  request.hot_boost = 0.0;
+  if (!hot_words_.empty()) {
+    // increase prob of prefix for every word
+    // that matches a word in the hot-words list
+    for (const std::string& word : request.ngram) {
+      auto iter = hot_words_.find(word);
+      if (iter != hot_words_.end()) {
+        // increase the log_cond_prob(prefix|LM)
+        request.hot_boost += iter->second;
       }
     }
   }
 
-  using namespace std::placeholders;
-  size_t num_returned = std::min(prefixes_copy.size(), num_results);
-  std::partial_sort(prefixes_copy.begin(),
-                    prefixes_copy.begin() + num_returned,
-                    prefixes_copy.end(),
-                    std::bind(prefix_compare_external, _1, _2, scores));
+  request.bos = request.ngram.size() < ext_scorer_->get_max_order();
+  LMScoreCache::make_key(request.ngram, request.bos, request.key);
+  return (int)num_lm_requests_++;
+}
+
+void
+DecoderState::resolve_lm_requests()
+{
+  // Requests for the same n-gram are frequent within a timestep, as several
+  // characters can end the same word. Only the first of them goes to the
+  // language model, the others count as cache hits.
+  size_t hits = 0;
+  lm_queries_.clear();
+  lm_pending_.clear();
+  for (size_t r = 0; r < num_lm_requests_; ++r) {
+    LMRequest& request = lm_requests_[r];
+    if (lm_cache_.lookup(request.key, &request.log_prob)) {
+      request.query = kNoQuery;
+      ++hits;
+      continue;
+    }
+
+    auto pending = lm_pending_.find(request.key.hash);
+    if (pending != lm_pending_.end() &&
+        lm_requests_[pending->second].key == request.key) {
+      request.query = lm_requests_[pending->second].query;
+      ++hits;
+      continue;
+    }
+
+    request.query = lm_queries_.size();
+    lm_queries_.emplace_back();
+    LMQuery& query = lm_queries_.back();
+    query.words = request.use_ids ? nullptr : &request.ngram;
+    query.ids = request.ids;
+    query.num_ids = request.num_ids;
+    query.bos = request.bos;
+    lm_pending_.emplace(request.key.hash, r);
+  }
+
+  lm_cache_hits_ += hits;
+  lm_cache_misses_ += lm_queries_.size();
+  DS_STATS_ADD(stats_, STATS_COUNTER_LM_CACHE_HITS, hits);
+  DS_STATS_ADD(stats_, STATS_COUNTER_LM_CACHE_MISSES, lm_queries_.size());
+  if (lm_queries_.empty()) {
+    return;
+  }
+
+  {
+    DS_STATS_SCOPE(stats_, STATS_STAGE_LM_QUERY);
+    ext_scorer_->get_log_cond_probs(lm_queries_.data(), lm_queries_.size());
+  }
+
+  // Queries were created in request order, the first request of each one
+  // adds the score to the cache
+  size_t next_query = 0;
+  for (size_t r = 0; r < num_lm_requests_; ++r) {
+    LMRequest& request = lm_requests_[r];
+    if (request.query == kNoQuery) {
+      continue;
+    }
+    request.log_prob = lm_queries_[request.query].log_prob;
+    if (request.query == next_query) {
+      lm_cache_.insert(request.key, request.log_prob);
+      ++next_query;
+    }
+  }
+}
+
+float
+DecoderState::get_partial_word_score(PathTrie* prefix) const
+{
+  if (!prefix->partial_word_scored) {
+    PathTrie* prefix_boundary = ext_scorer_->is_utf8_mode() ? prefix : prefix->parent;
+    prefix->has_partial_word = prefix_boundary &&
+      !ext_scorer_->is_scoring_boundary(prefix_boundary, prefix->character);
+    if (prefix->has_partial_word) {
+      std::vector<std::string> ngram = ext_scorer_->make_ngram(prefix);
+      bool bos = ngram.size() < ext_scorer_->get_max_order();
+      prefix->partial_word_log_prob = get_lm_log_prob(ngram, bos);
+    }
+    prefix->partial_word_scored = true;
+  }
+
+  if (!prefix->has_partial_word) {
+    return 0.0;
+  }
+
+  // alpha and beta can change during decoding, so they are not cached
+  float score = prefix->partial_word_log_prob * ext_scorer_->alpha;
+  score += ext_scorer_->beta;
+  return score;
+}
+
+void
+DecoderState::update_best_output(const PathTrie* prefix) const
+{
+  // Walk up until we find a node that is still part of the cached path. The
+  // serial guards against a freed node whose memory got reused for a new node
+  // at the same depth.
+  const unsigned int root_depth = prefix_root_->depth;
+  std::vector<const PathTrie*> new_nodes;
+  const PathTrie* node = prefix;
+  while (node->depth > root_depth) {
+    size_t idx = node->depth - root_depth - 1;
+    if (idx < best_path_nodes_.size() &&
+        best_path_nodes_[idx] == node &&
+        best_path_serials_[idx] == node->serial) {
+      break;
+    }
+    new_nodes.push_back(node);
+    node = node->parent;
+  }
+
+  best_path_nodes_.resize(node->depth - root_depth);
+  best_path_serials_.resize(node->depth - root_depth);
+  best_output_.tokens.resize(node->depth - root_depth);
+  for (auto it = new_nodes.rbegin(); it != new_nodes.rend(); ++it) {
+    best_path_nodes_.push_back(*it);
+    best_path_serials_.push_back((*it)->serial);
+    best_output_.tokens.push_back((*it)->character);
+  }
+
+  // Same for the timesteps, which can change independently of the characters.
+  // Timestep tree nodes are never freed during decoding, so pointers are
+  // enough to identify them.
+  std::vector<const TimestepTreeNode*> new_timesteps;
+  const TimestepTreeNode* timestep = prefix->timesteps;
+  size_t timestep_depth = prefix->depth - root_depth;
+  while (timestep != &timestep_tree_root_) {
+    assert(timestep_depth > 0);
+    if (timestep_depth <= best_timestep_nodes_.size() &&
+        best_timestep_nodes_[timestep_depth - 1] == timestep) {
+      break;
+    }
+    new_timesteps.push_back(timestep);
+    timestep = timestep->parent;
+    --timestep_depth;
+  }
+
+  best_timestep_nodes_.resize(timestep_depth);
+  best_output_.timesteps.resize(timestep_depth);
+  for (auto it = new_timesteps.rbegin(); it != new_timesteps.rend(); ++it) {
+    best_timestep_nodes_.push_back(*it);
+    best_output_.timesteps.push_back((*it)->data);
+  }
+}
+
+void
+DecoderState::append_node_timesteps(const PathTrie* prefix,
+                                    std::vector<unsigned int>& timesteps) const
+{
+  const unsigned int root_depth = prefix_root_->depth;
+  const size_t offset = timesteps.size();
+  timesteps.resize(offset + prefix->depth - root_depth, 0);
+  if (timing_ == TIMING_WORDS) {
+    // A node can move to a later alignment after being extended, don't let
+    // it end up after its descendants
+    unsigned int next = std::numeric_limits<unsigned int>::max();
+    for (const PathTrie* node = prefix; node->depth > root_depth; node = node->parent) {
+      next = std::min(next, node->char_timestep);
+      timesteps[offset + node->depth - root_depth - 1] = next;
+    }
+  }
+}
+
+std::vector<std::pair<float, PathTrie*>>
+DecoderState::get_top_prefixes(size_t num_results) const
+{
+  std::vector<std::pair<float, PathTrie*>> scored_prefixes;
+  scored_prefixes.reserve(prefixes_.size());
+  {
+    // The partial words are scored as one run of the LM stage
+    DS_STATS_SCOPE(ext_scorer_ ? stats_ : nullptr, STATS_STAGE_LM_QUERY);
+    for (size_t i = 0; i < prefixes_.size(); ++i) {
+      float score = prefixes_[i]->score;
+      // score the last word of each prefix that doesn't end with space
+      if (ext_scorer_ && i < beam_size_) {
+        score += get_partial_word_score(prefixes_[i]);
+        // which replaces its look-ahead
+        score -= prefixes_[i]->lm_lookahead * ext_scorer_->alpha;
+      }
+      scored_prefixes.push_back(std::make_pair(score, prefixes_[i]));
+    }
+  }
+
+  size_t num_returned = std::min(scored_prefixes.size(), num_results);
+  std::partial_sort(scored_prefixes.begin(),
+                    scored_prefixes.begin() + num_returned,
+                    scored_prefixes.end(),
+                    prefix_compare_external);
+  scored_prefixes.resize(num_returned);
+  return scored_prefixes;
+}
+
+Output
+DecoderState::get_output(const std::pair<float, PathTrie*>& scored_prefix,
+                         bool best) const
+{
+  Output output;
+  output.tokens = committed_.tokens;
+  output.timesteps = committed_.timesteps;
+  if (timing_ != TIMING_TOKENS) {
+    scored_prefix.second->get_path_vec(output.tokens);
+    append_node_timesteps(scored_prefix.second, output.timesteps);
+  } else if (best) {
+    update_best_output(scored_prefix.second);
+    output.tokens.insert(output.tokens.end(),
+                         best_output_.tokens.begin(),
+                         best_output_.tokens.end());
+    output.timesteps.insert(output.timesteps.end(),
+                            best_output_.timesteps.begin(),
+                            best_output_.timesteps.end());
+  } else {
+    scored_prefix.second->get_path_vec(output.tokens);
+    std::vector<unsigned int> timesteps = get_history(scored_prefix.second->timesteps, &timestep_tree_root_);
+    output.timesteps.insert(output.timesteps.end(), timesteps.begin(), timesteps.end());
+  }
+  assert(output.tokens.size() == output.timesteps.size());
+  output.confidence = scored_prefix.first;
+  return output;
+}
+
+Output
+DecoderState::get_greedy_output() const
+{
+  Output output;
+  output.tokens = committed_.tokens;
+  output.tokens.insert(output.tokens.end(),
+                       greedy_path_.tokens.begin(),
+                       greedy_path_.tokens.end());
+  output.timesteps = committed_.timesteps;
+  output.timesteps.insert(output.timesteps.end(),
+                          greedy_path_.timesteps.begin(),
+                          greedy_path_.timesteps.end());
+  output.confidence = greedy_log_prob_;
+  return output;
+}
+
+std::vector<Output>
+DecoderState::decode(size_t num_results) const
+{
+  if (greedy_) {
+    return std::vector<Output>(num_results > 0 ? 1 : 0, get_greedy_output());
+  }
+
+  std::vector<std::pair<float, PathTrie*>> scored_prefixes = get_top_prefixes(num_results);
 
   std::vector<Output> outputs;
-  outputs.reserve(num_returned);
+  outputs.reserve(scored_prefixes.size());
+  for (size_t i = 0; i < scored_prefixes.size(); ++i) {
+    outputs.push_back(get_output(scored_prefixes[i], i == 0));
+  }
 
-  for (size_t i = 0; i < num_returned; ++i) {
-    Output output;
-    prefixes_copy[i]->get_path_vec(output.tokens);
-    output.timesteps  = get_history(prefixes_copy[i]->timesteps, &timestep_tree_root_);
-    assert(output.tokens.size() == output.timesteps.size());
-    output.confidence = scores[prefixes_copy[i]];
-    outputs.push_back(output);
+  return outputs;
+}
+
+std::vector<Output>
+DecoderState::decode_words(size_t num_results) const
+{
+  std::vector<Output> outputs;
+  if (greedy_) {
+    if (num_results > 0) {
+      std::vector<float> log_probs = committed_log_probs_;
+      log_probs.insert(log_probs.end(), greedy_log_probs_.begin(), greedy_log_probs_.end());
+      outputs.push_back(get_greedy_output());
+      fill_words(outputs.back(), log_probs);
+    }
+    return outputs;
+  }
+
+  std::vector<std::pair<float, PathTrie*>> scored_prefixes = get_top_prefixes(num_results);
+
+  outputs.reserve(scored_prefixes.size());
+  for (size_t i = 0; i < scored_prefixes.size(); ++i) {
+    outputs.push_back(get_output(scored_prefixes[i], i == 0));
+    fill_words(outputs.back(),
+               get_token_log_probs(scored_prefixes[i].second, outputs.back().tokens.size()));
   }
 
   return outputs;
 }
 
+std::vector<float>
+DecoderState::get_token_log_probs(const PathTrie* prefix, size_t num_tokens) const
+{
+  std::vector<float> log_probs = committed_log_probs_;
+  const size_t num_committed = log_probs.size();
+  const unsigned int root_depth = prefix_root_->depth;
+  log_probs.resize(num_tokens);
+  for (const PathTrie* node = prefix; node->depth > root_depth; node = node->parent) {
+    log_probs[num_committed + node->depth - root_depth - 1] = node->log_prob_c;
+  }
+  return log_probs;
+}
+
+void
+DecoderState::fill_words(Output& output, const std::vector<float>& log_probs) const
+{
+  std::vector<int> token_words(output.tokens.size(), -1);
+  bool in_word = false;
+  for (size_t i = 0; i < output.tokens.size(); ++i) {
+    if (output.tokens[i] == space_id_) {
+      if (in_word) {
+        output.words.back().end_timestep = output.timesteps[i];
+        in_word = false;
+      }
+      continue;
+    }
+    if (!in_word) {
+      output.words.push_back({static_cast<unsigned int>(i), 0, output.timesteps[i], 0, 0.0, 0.0});
+      in_word = true;
+    }
+    WordOutput& word = output.words.back();
+    ++word.num_tokens;
+    word.acoustic_score += log_probs[i];
+    token_words[i] = output.words.size() - 1;
+  }
+  if (in_word) {
+    output.words.back().end_timestep = output.timesteps.back() + 1;
+  }
+
+  if (!ext_scorer_ || output.words.empty()) {
+    return;
+  }
+
+  // Score every unit of the language model (words, or codepoints in UTF-8
+  // mode) the same way the decoder does, then add them up per word.
+  std::vector<std::string> units = ext_scorer_->split_labels_into_scored_units(output.tokens);
+  const size_t max_order = ext_scorer_->get_max_order();
+  std::vector<double> unit_scores(units.size());
+  for (size_t k = 0; k < units.size(); ++k) {
+    auto begin = units.begin() + (k + 1 > max_order ? k + 1 - max_order : 0);
+    unit_scores[k] = ext_scorer_->get_log_cond_prob(begin, units.begin() + k + 1,
+                                                    k + 1 < max_order);
+  }
+
+  if (ext_scorer_->is_utf8_mode()) {
+    // In UTF-8 mode label L stands for byte L+1, see UTF8Alphabet
+    size_t unit = 0;
+    for (size_t i = 0; i < output.tokens.size() && unit < units.size(); ++i) {
+      if (!byte_is_codepoint_boundary(output.tokens[i] + 1)) {
+        continue;
+      }
+      if (token_words[i] >= 0) {
+        output.words[token_words[i]].lm_score += unit_scores[unit];
+      }
+      ++unit;
+    }
+  } else {
+    for (size_t w = 0; w < output.words.size() && w < units.size(); ++w) {
+      output.words[w].lm_score = unit_scores[w];
+    }
+  }
+}
+
 std::vector<Output> ctc_beam_search_decoder(
     const double *probs,
     int time_dim,
@@ -273,7 +1478,7 @@ std::vector<Output> ctc_beam_search_decoder(
     double cutoff_prob,
     size_t cutoff_top_n,
     std::shared_ptr<Scorer> ext_scorer,
-    std::unordered_map<std::string, float> hot_words,
+    const std::unordered_map<std::string, float>& hot_words,
     size_t num_results)
 {
   VALID_CHECK_EQ(alphabet.GetSize()+1, class_dim, "Number of output classes in acoustic model does not match number of labels in the alphabet file. Alphabet file must be the same one that was used to train the acoustic model.");
@@ -297,34 +1502,148 @@ ctc_beam_search_decoder_batch(
     double cutoff_prob,
     size_t cutoff_top_n,
     std::shared_ptr<Scorer> ext_scorer,
-    std::unordered_map<std::string, float> hot_words,
+    const std::unordered_map<std::string, float>& hot_words,
     size_t num_results)
 {
   VALID_CHECK_GT(num_processes, 0, "num_processes must be nonnegative!");
+  DecoderPool pool(num_processes);
+  return pool.decode_batch(probs, batch_size, time_dim, class_dim,
+                           seq_lengths, seq_lengths_size, alphabet, beam_size,
+                           cutoff_prob, cutoff_top_n, ext_scorer, hot_words,
+                           num_results);
+}
+
+DecoderPool::DecoderPool(size_t num_threads)
+  : num_threads_(num_threads)
+{
+  VALID_CHECK_GT(num_threads, 0, "num_threads must be positive!");
+  pool_.reset(new ThreadPool(num_threads));
+}
+
+DecoderPool::~DecoderPool() = default;
+
+std::vector<std::vector<Output>>
+DecoderPool::decode_batch(
+    const double *probs,
+    int batch_size,
+    int time_dim,
+    int class_dim,
+    const int* seq_lengths,
+    int seq_lengths_size,
+    const Alphabet &alphabet,
+    size_t beam_size,
+    double cutoff_prob,
+    size_t cutoff_top_n,
+    std::shared_ptr<Scorer> ext_scorer,
+    const std::unordered_map<std::string, float>& hot_words,
+    size_t num_results)
+{
   VALID_CHECK_EQ(batch_size, seq_lengths_size, "must have one sequence length per batch element");
-  // thread pool
-  ThreadPool pool(num_processes);
-
-  // enqueue the tasks of decoding
-  std::vector<std::future<std::vector<Output>>> res;
-  for (size_t i = 0; i < batch_size; ++i) {
-    res.emplace_back(pool.enqueue(ctc_beam_search_decoder,
-                                  &probs[i*time_dim*class_dim],
-                                  seq_lengths[i],
-                                  class_dim,
-                                  alphabet,
-                                  beam_size,
-                                  cutoff_prob,
-                                  cutoff_top_n,
-                                  ext_scorer,
-                                  hot_words,
-                                  num_results));
+
+  // Queue the longest utterances first, a stable sort keeps batch order
+  // between utterances of the same length
+  std::vector<int> order(batch_size);
+  for (int i = 0; i < batch_size; ++i) {
+    order[i] = i;
+  }
+  std::stable_sort(order.begin(), order.end(), [seq_lengths](int a, int b) {
+    return seq_lengths[a] > seq_lengths[b];
+  });
+
+  // The tasks only hold references to the inputs, which is safe because we
+  // wait for all of them below before returning
+  std::vector<std::future<std::vector<Output>>> res(batch_size);
+  for (int i : order) {
+    const double* utterance_probs = &probs[(size_t)i*time_dim*class_dim];
+    int utterance_length = seq_lengths[i];
+    res[i] = pool_->enqueue([=, &alphabet, &ext_scorer, &hot_words]() {
+      return ctc_beam_search_decoder(utterance_probs, utterance_length,
+                                     class_dim, alphabet, beam_size,
+                                     cutoff_prob, cutoff_top_n, ext_scorer,
+                                     hot_words, num_results);
+    });
+  }
+
+  for (auto& r : res) {
+    r.wait();
   }
 
   // get decoding results
   std::vector<std::vector<Output>> batch_results;
-  for (size_t i = 0; i < batch_size; ++i) {
+  batch_results.reserve(batch_size);
+  for (int i = 0; i < batch_size; ++i) {
     batch_results.emplace_back(res[i].get());
   }
   return batch_results;
 }
+
+BatchOutput
+DecoderPool::decode_batch_flat(
+    const float* probs,
+    int batch_size,
+    int time_dim,
+    int class_dim,
+    ptrdiff_t batch_stride,
+    ptrdiff_t time_stride,
+    const int* seq_lengths,
+    int seq_lengths_size,
+    const Alphabet &alphabet,
+    size_t beam_size,
+    double cutoff_prob,
+    size_t cutoff_top_n,
+    std::shared_ptr<Scorer> ext_scorer,
+    const std::unordered_map<std::string, float>& hot_words,
+    size_t num_results)
+{
+  VALID_CHECK_EQ(batch_size, seq_lengths_size, "must have one sequence length per batch element");
+  VALID_CHECK_EQ(alphabet.GetSize()+1, class_dim, "Number of output classes in acoustic model does not match number of labels in the alphabet file. Alphabet file must be the same one that was used to train the acoustic model.");
+
+  std::vector<int> order(batch_size);
+  for (int i = 0; i < batch_size; ++i) {
+    VALID_CHECK(seq_lengths[i] <= time_dim, "sequence length larger than time dimension");
+    order[i] = i;
+  }
+  std::stable_sort(order.begin(), order.end(), [seq_lengths](int a, int b) {
+    return seq_lengths[a] > seq_lengths[b];
+  });
+
+  std::vector<std::future<std::vector<Output>>> res(batch_size);
+  for (int i : order) {
+    const float* utterance_probs = probs + i*batch_stride;
+    int utterance_length = seq_lengths[i];
+    res[i] = pool_->enqueue([=, &alphabet, &ext_scorer, &hot_words]() {
+      DecoderState state;
+      state.init(alphabet, beam_size, cutoff_prob, cutoff_top_n, ext_scorer, hot_words);
+      state.next(utterance_probs, utterance_length, class_dim, time_stride);
+      return state.decode(num_results);
+    });
+  }
+
+  for (auto& r : res) {
+    r.wait();
+  }
+
+  BatchOutput batch_output;
+  batch_output.batch_size = batch_size;
+  batch_output.num_results = num_results;
+  batch_output.confidences.reserve(batch_size*num_results);
+  batch_output.offsets.reserve(batch_size*num_results + 1);
+  batch_output.offsets.push_back(0);
+  for (int i = 0; i < batch_size; ++i) {
+    std::vector<Output> outputs = res[i].get();
+    for (size_t j = 0; j < num_results; ++j) {
+      if (j < outputs.size()) {
+        const Output& output = outputs[j];
+        batch_output.confidences.push_back(output.confidence);
+        batch_output.tokens.insert(batch_output.tokens.end(),
+                                   output.tokens.begin(), output.tokens.end());
+        batch_output.timesteps.insert(batch_output.timesteps.end(),
+                                      output.timesteps.begin(), output.timesteps.end());
+      } else {
+        batch_output.confidences.push_back(-std::numeric_limits<double>::infinity());
+      }
+      batch_output.offsets.push_back(batch_output.tokens.size());
+    }
+  }
+  return batch_output;
+}
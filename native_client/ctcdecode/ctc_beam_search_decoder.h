@@ -1,6 +1,7 @@
 #ifndef CTC_BEAM_SEARCH_DECODER_H_
 #define CTC_BEAM_SEARCH_DECODER_H_
 
+#include <cstddef>
 #include <memory>
 #include <string>
 #include <vector>
@@ -8,6 +9,11 @@
 #include "scorer.h"
 #include "output.h"
 #include "alphabet.h"
+#include "lm_score_cache.h"
+#include "snapshot.h"
+#include "stats.h"
+
+class ThreadPool;
 
 class DecoderState {
   int abs_time_step_;
@@ -17,6 +23,10 @@ class DecoderState {
   double cutoff_prob_;
   size_t cutoff_top_n_;
   bool start_expanding_;
+  size_t trailing_blank_frames_;
+  double blank_skip_threshold_;
+  size_t skipped_frames_;
+  bool commit_prefixes_;
 
   std::shared_ptr<Scorer> ext_scorer_;
   std::vector<PathTrie*> prefixes_;
@@ -24,6 +34,158 @@ class DecoderState {
   TimestepTreeNode timestep_tree_root_{nullptr, 0};
   std::unordered_map<std::string, float> hot_words_;
 
+  // Per-state copy of the scorer's dictionary, shared by all trie nodes
+  std::shared_ptr<PathTrie::FstType> dictionary_;
+  std::shared_ptr<fst::SortedMatcher<PathTrie::FstType>> matcher_;
+  std::shared_ptr<const WordIdMap> word_ids_;
+
+  // Scorer's look-ahead scores when enabled, null otherwise
+  std::shared_ptr<const std::vector<float>> lm_lookahead_;
+
+  // Where LM queries and FST lookups are timed, if not null
+  StatsCollector* stats_ = nullptr;
+
+  // Scores of the n-grams queried since the last reset()
+  mutable LMScoreCache lm_cache_;
+  mutable LMScoreCache::Key lm_key_;
+  mutable size_t lm_cache_hits_ = 0;
+  mutable size_t lm_cache_misses_ = 0;
+
+  // Language model query for a word boundary reached during a timestep, with
+  // the words as ids when the trie has them, as strings otherwise
+  struct LMRequest {
+    std::vector<std::string> ngram;
+    lm::WordIndex ids[KENLM_MAX_ORDER];
+    size_t num_ids = 0;
+    bool use_ids;
+    bool bos;
+    float hot_boost;
+    LMScoreCache::Key key;
+    double log_prob;
+    size_t query;  // index in lm_queries_, or kNoQuery when cached
+  };
+
+  // Prefix extension found by the first pass over a timestep's candidates
+  struct Expansion {
+    PathTrie* prefix_new;
+    int lm_request;  // index in lm_requests_, -1 if nothing to score
+  };
+
+  static const size_t kNoQuery = (size_t)-1;
+
+  // Work buffers of next_impl(), kept across timesteps to reuse their
+  // allocations. Only the first num_lm_requests_ requests are current.
+  std::vector<Expansion> expansions_;
+  std::vector<LMRequest> lm_requests_;
+  size_t num_lm_requests_ = 0;
+  std::vector<LMQuery> lm_queries_;
+  std::unordered_map<uint64_t, size_t> lm_pending_;
+
+  // Copy of the best hypothesis returned by the last call to decode(), along
+  // with the trie and timestep nodes it was built from. Consecutive calls
+  // mostly share the beginning of the best path, so only the part below the
+  // last node still in common needs to be walked again.
+  mutable std::vector<const PathTrie*> best_path_nodes_;
+  mutable std::vector<uint64_t> best_path_serials_;
+  mutable std::vector<const TimestepTreeNode*> best_timestep_nodes_;
+  mutable Output best_output_;
+
+  // Characters committed by commit_common_prefix() and not yet retrieved by
+  // take_committed().
+  Output committed_;
+  std::vector<float> committed_log_probs_;
+
+  // Best path decoding, see set_greedy(). greedy_path_ holds the tokens
+  // found since the last reset() and not committed yet, greedy_log_probs_ the
+  // log probability of each of them, and greedy_log_prob_ the log probability
+  // of the whole path.
+  bool greedy_ = false;
+  int greedy_last_label_;
+  double greedy_log_prob_;
+  Output greedy_path_;
+  std::vector<float> greedy_log_probs_;
+
+  // Timing information tracked by next(), see set_timing_mode()
+  TimingMode timing_ = TIMING_TOKENS;
+
+  // Score and adaptive beams, see set_beam_threshold() and
+  // set_adaptive_beam(). 0 disables them.
+  float beam_threshold_ = 0.0f;
+  float adaptive_coverage_ = 0.0f;
+  size_t adaptive_min_size_ = 1;
+
+  // Whether next() skips extensions that can't enter the beam, see
+  // set_extension_cutoff()
+  bool extension_cutoff_ = true;
+
+  // Create a fresh prefix trie root, attached to the timestep tree root.
+  void init_root();
+
+  // Advance all prefixes by one timestep where only blank is possible.
+  void apply_blank_frame(float log_prob_blank);
+
+  // Shared implementation of the next() overloads.
+  template<typename T>
+  void next_impl(const T *probs, int time_dim, int class_dim, ptrdiff_t row_stride);
+
+  // Beam search over the given timesteps, tracking the timing information
+  // of Mode. Each mode gets its own instantiation, so the search loop doesn't
+  // test it.
+  template<TimingMode Mode, typename T>
+  void next_beam(const T *probs, int time_dim, int class_dim, ptrdiff_t row_stride);
+
+  // Drop the prefixes outside of the beam size, the score beam and the
+  // adaptive beam, at the end of a timestep.
+  void prune_prefixes();
+
+  // Best path counterpart of next_impl().
+  template<typename T>
+  void next_greedy(const T *probs, int time_dim, int class_dim, ptrdiff_t row_stride);
+
+  // Build the output of the best path, with the committed tokens first.
+  Output get_greedy_output() const;
+
+  // Return the language model log probability of an n-gram, from the cache
+  // if possible.
+  double get_lm_log_prob(const std::vector<std::string>& ngram, bool bos) const;
+
+  // Queue the scoring of the word boundary ending at prefix_to_score for the
+  // current timestep, returning the index of the request. word_end is the
+  // new prefix, which holds the id of the word if it completes one.
+  int add_lm_request(PathTrie* prefix_to_score, PathTrie* word_end);
+
+  // Score all queued requests: from the cache when possible, the rest in a
+  // single batch to the scorer with duplicates sent only once.
+  void resolve_lm_requests();
+
+  // Return the score contribution of the unfinished last word of a prefix.
+  float get_partial_word_score(PathTrie* prefix) const;
+
+  // Return the best num_results prefixes with their final score, in
+  // descending order.
+  std::vector<std::pair<float, PathTrie*>> get_top_prefixes(size_t num_results) const;
+
+  // Build the output for a prefix, best is true for the top prefix.
+  Output get_output(const std::pair<float, PathTrie*>& scored_prefix, bool best) const;
+
+  // Get the acoustic log probability of each token of an output of
+  // num_tokens tokens built from prefix, committed ones first.
+  std::vector<float> get_token_log_probs(const PathTrie* prefix, size_t num_tokens) const;
+
+  // Group the tokens of an output into words, given their log probabilities.
+  void fill_words(Output& output, const std::vector<float>& log_probs) const;
+
+  // Bring best_output_ in sync with the given prefix.
+  void update_best_output(const PathTrie* prefix) const;
+
+  // Append the timesteps of the uncommitted tokens of prefix, when not
+  // tracked with TIMING_TOKENS.
+  void append_node_timesteps(const PathTrie* prefix, std::vector<unsigned int>& timesteps) const;
+
+  // Move the characters all beams agree on out of the prefix trie and the
+  // timestep tree, keeping enough context for the scorer.
+  void commit_common_prefix();
+
 public:
   DecoderState() = default;
   ~DecoderState() = default;
@@ -32,7 +194,8 @@ public:
   DecoderState(const DecoderState&) = delete;
   DecoderState& operator=(DecoderState&) = delete;
 
-  /* Initialize CTC beam search decoder
+  /* Initialize CTC beam search decoder. A state can be initialized again to
+   * decode new input, reusing its allocations.
    *
    * Parameters:
    *     alphabet: The alphabet.
@@ -50,7 +213,13 @@ public:
            double cutoff_prob,
            size_t cutoff_top_n,
            std::shared_ptr<Scorer> ext_scorer,
-           std::unordered_map<std::string, float> hot_words);
+           const std::unordered_map<std::string, float>& hot_words);
+
+  /* Drop all hypotheses and start decoding a new utterance, keeping the
+   * configuration given to init(). Absolute timesteps keep increasing, so
+   * timings of later results stay relative to the start of the input.
+  */
+  void reset();
 
   /* Send data to the decoder
    *
@@ -64,6 +233,40 @@ public:
             int time_dim,
             int class_dim);
 
+  /* Send single precision data to the decoder, whose rows are row_stride
+   * elements apart. Decodes exactly like the same values converted to double.
+  */
+  void next(const float *probs,
+            int time_dim,
+            int class_dim,
+            ptrdiff_t row_stride);
+
+  /* Advance the decoder by timesteps known to be blank, e.g. silence for
+   * which the acoustic model was not run.
+   *
+   * Parameters:
+   *     num_frames: Number of timesteps to skip.
+  */
+  void skip_blank_frames(size_t num_frames);
+
+  /* Set the blank probability above which a timestep only gets the blank
+   * transition instead of a full beam search step. The result is unchanged
+   * when such timesteps have no other candidate.
+   *
+   * Parameters:
+   *     threshold: Blank probability threshold, 0 to disable (default).
+  */
+  void set_blank_skip_threshold(double threshold);
+
+  /* Get the number of timesteps that did not go through a full beam search
+   * step, either skipped with skip_blank_frames() or above the blank skip
+   * threshold.
+   *
+   * Return:
+   *     The number of skipped timesteps.
+  */
+  size_t get_skipped_frames() const;
+
   /* Get up to num_results transcriptions from current decoder state.
    *
    * Parameters:
@@ -74,6 +277,172 @@ public:
    *     in descending order.
   */
   std::vector<Output> decode(size_t num_results=1) const;
+
+  /* Get up to num_results transcriptions from current decoder state, along
+   * with their words and per-word acoustic and language model scores.
+   *
+   * Parameters:
+   *     num_results: Number of beams to return.
+   *
+   * Return:
+   *     A vector of decoding results in descending order of score, each with
+   *     its words filled.
+  */
+  std::vector<Output> decode_words(size_t num_results=1) const;
+
+  /* Get the number of consecutive timesteps, up to the last one sent to
+   * next(), whose blank probability was at least 0.999. Timesteps before the
+   * first non-blank one are not counted.
+   *
+   * Return:
+   *     The length of the trailing run of blank timesteps.
+  */
+  size_t get_trailing_blank_frames() const;
+
+  /* Enable or disable prefix commitment. When enabled, the beginning of the
+   * transcription that is shared by all beams is considered final: it is
+   * removed from the prefix trie and timestep tree after every call to next(),
+   * so memory use and decoding cost stay bounded on arbitrarily long input.
+   * Committed characters are prepended to the results of decode() until they
+   * are retrieved with take_committed().
+   *
+   * Parameters:
+   *     enable: Whether to commit common prefixes.
+  */
+  void set_prefix_commitment(bool enable);
+
+  /* Enable or disable language model look-ahead. When enabled, each
+   * character added to a word is scored with the best unigram probability of
+   * the words it can still become, so beams spelling unlikely words are
+   * pruned before they reach a word boundary, where the look-ahead is
+   * replaced with the actual language model score. Disabled by init(),
+   * changing the setting calls reset().
+   *
+   * Parameters:
+   *     enable: Whether to use look-ahead.
+   *
+   * Return:
+   *     False if enabling failed because there is no scorer or it has no
+   *     look-ahead scores.
+  */
+  bool set_lm_lookahead(bool enable);
+
+  /* Enable or disable best path decoding. When enabled, next() only keeps the
+   * most probable class of each timestep and collapses repeats and blanks, as
+   * in greedy CTC decoding, without building a prefix trie. decode() and
+   * decode_words() then return a single result whose confidence is the log
+   * probability of the path. Disabled by init(), call before next().
+   *
+   * Parameters:
+   *     enable: Whether to decode the best path only.
+   *
+   * Return:
+   *     False if enabling failed because an external scorer is set, which
+   *     best path decoding can't use.
+  */
+  bool set_greedy(bool enable);
+
+  /* Set the timing information tracked by next(), see TimingMode. Anything
+   * but TIMING_TOKENS saves the timestep tree and its allocations on every
+   * timestep, TIMING_NONE saves all timing work. Reset to TIMING_TOKENS by
+   * init(), changing the mode calls reset().
+   *
+   * Parameters:
+   *     mode: Timing information to track.
+  */
+  void set_timing_mode(TimingMode mode);
+
+  /* Enable or disable skipping the extensions of a timestep that score too
+   * low to enter the beam. Skipping them doesn't change the results, so this
+   * is only useful to check that it doesn't. Enabled by init().
+   *
+   * Parameters:
+   *     enable: Whether to skip extensions.
+  */
+  void set_extension_cutoff(bool enable);
+
+  /* Set a score beam: at the end of each timestep, prefixes scoring more than
+   * threshold below the best one are dropped, even if the beam isn't full,
+   * and extensions that can't reach it are not tried. A tight beam saves
+   * most of the work on timesteps the acoustic model is sure of. Disabled by
+   * init().
+   *
+   * Parameters:
+   *     threshold: Largest score difference to the best prefix, in natural
+   *                log units, 0 to disable.
+  */
+  void set_beam_threshold(float threshold);
+
+  /* Set an adaptive beam: at the end of each timestep, only the best
+   * prefixes holding coverage of the probability mass of the beam are kept,
+   * so the beam shrinks when one prefix dominates and widens up to the beam
+   * size when many are close. The mass is estimated from a histogram of the
+   * scores, without sorting the prefixes. Disabled by init().
+   *
+   * Parameters:
+   *     coverage: Share of the probability mass to keep, e.g. 0.999, 0 to
+   *               disable.
+   *     min_size: Fewest prefixes kept by the adaptive beam.
+  */
+  void set_adaptive_beam(float coverage, size_t min_size);
+
+  /* Time the LM queries and FST lookups made by next() in a collector. The
+   * collector is kept by init() and reset().
+   *
+   * Parameters:
+   *     stats: Collector to record into, null to stop recording.
+  */
+  void set_stats(StatsCollector* stats);
+
+  /* Set the number of entries of the language model score cache, which is
+   * cleared by init() and reset(). The size is rounded up to a power of two,
+   * zero disables the cache.
+   *
+   * Parameters:
+   *     slots: Number of cached n-grams (default 4096).
+  */
+  void set_lm_cache_size(size_t slots);
+
+  /* Get the number of language model queries answered by the score cache
+   * since init().
+  */
+  size_t get_lm_cache_hits() const;
+
+  /* Get the number of language model queries that missed the score cache
+   * since init(), and went to the language model.
+  */
+  size_t get_lm_cache_misses() const;
+
+  /* Retrieve the characters committed since the last call.
+   *
+   * Return:
+   *     The committed tokens and their timesteps. Confidence is not set.
+  */
+  Output take_committed();
+
+  /* Write the decoding state to a snapshot: the prefix trie, the timestep
+   * tree, committed characters and the settings changed since init(). The
+   * language model score cache and statistics are not part of it.
+   *
+   * Parameters:
+   *     writer: Snapshot to append to.
+  */
+  void save(SnapshotWriter& writer) const;
+
+  /* Restore the decoding state from a snapshot written by save(), into a
+   * state initialized with the same alphabet, beam size, scorer and
+   * hot-words. Decoding then continues exactly as it would have in the saved
+   * state.
+   *
+   * Parameters:
+   *     reader: Snapshot to read from.
+   *
+   * Return:
+   *     False on failure, with reader.failed() set if the snapshot is
+   *     invalid, unset if it was saved with another alphabet, beam size or
+   *     scorer. The state has to be initialized again after a failure.
+  */
+  bool load(SnapshotReader& reader);
 };
 
 
@@ -107,10 +476,12 @@ std::vector<Output> ctc_beam_search_decoder(
     double cutoff_prob,
     size_t cutoff_top_n,
     std::shared_ptr<Scorer> ext_scorer,
-    std::unordered_map<std::string, float> hot_words,
+    const std::unordered_map<std::string, float>& hot_words,
     size_t num_results=1);
 
-/* CTC Beam Search Decoder for batch data
+/* CTC Beam Search Decoder for batch data. Creates a DecoderPool for the
+ * duration of the call, callers decoding many batches should keep a
+ * DecoderPool around instead.
  * Parameters:
  *     probs: 3-D vector where each element is a 2-D vector that can be used
  *                by ctc_beam_search_decoder().
@@ -143,7 +514,80 @@ ctc_beam_search_decoder_batch(
     double cutoff_prob,
     size_t cutoff_top_n,
     std::shared_ptr<Scorer> ext_scorer,
-    std::unordered_map<std::string, float> hot_words,
+    const std::unordered_map<std::string, float>& hot_words,
     size_t num_results=1);
 
+/* Pool of decoding threads that stays alive across batches, so that decoding
+ * many small batches does not pay for starting and joining threads every time.
+ * A pool can be shared by several callers, batches submitted concurrently are
+ * decoded in the order their utterances were queued.
+*/
+class DecoderPool {
+  std::unique_ptr<ThreadPool> pool_;
+  size_t num_threads_;
+
+public:
+  /* Parameters:
+   *     num_threads: Number of decoding threads, must be positive.
+  */
+  explicit DecoderPool(size_t num_threads);
+  ~DecoderPool();
+
+  DecoderPool(const DecoderPool&) = delete;
+  DecoderPool& operator=(const DecoderPool&) = delete;
+
+  size_t num_threads() const { return num_threads_; }
+
+  /* Decode a batch with the pool's threads. The alphabet, scorer and hot-words
+   * are shared by all utterances rather than copied for each of them, and the
+   * longest utterances are queued first so that a long utterance picked up
+   * last does not leave the other threads idle at the end of the batch.
+   *
+   * Parameters and return value are the same as for
+   * ctc_beam_search_decoder_batch(), minus num_processes.
+  */
+  std::vector<std::vector<Output>> decode_batch(
+      const double* probs,
+      int batch_size,
+      int time_dim,
+      int class_dim,
+      const int* seq_lengths,
+      int seq_lengths_size,
+      const Alphabet &alphabet,
+      size_t beam_size,
+      double cutoff_prob,
+      size_t cutoff_top_n,
+      std::shared_ptr<Scorer> ext_scorer,
+      const std::unordered_map<std::string, float>& hot_words,
+      size_t num_results=1);
+
+  /* Decode a batch of single precision probabilities, laid out with arbitrary
+   * strides as long as the classes of a timestep are contiguous, and return
+   * the results flattened into a BatchOutput. Intended for bindings that
+   * hand over arrays without copying them and decode without holding an
+   * interpreter lock.
+   *
+   * Parameters:
+   *     batch_stride: Distance between utterances, in elements.
+   *     time_stride: Distance between timesteps of an utterance, in elements.
+   *     Others are the same as for decode_batch().
+  */
+  BatchOutput decode_batch_flat(
+      const float* probs,
+      int batch_size,
+      int time_dim,
+      int class_dim,
+      ptrdiff_t batch_stride,
+      ptrdiff_t time_stride,
+      const int* seq_lengths,
+      int seq_lengths_size,
+      const Alphabet &alphabet,
+      size_t beam_size,
+      double cutoff_prob,
+      size_t cutoff_top_n,
+      std::shared_ptr<Scorer> ext_scorer,
+      const std::unordered_map<std::string, float>& hot_words,
+      size_t num_results=1);
+};
+
 #endif  // CTC_BEAM_SEARCH_DECODER_H_
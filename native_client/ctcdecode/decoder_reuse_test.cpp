@@ -0,0 +1,141 @@
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "alphabet.h"
+#include "ctc_beam_search_decoder.h"
+
+/* Reuse of a decoder state on another thread, the way DS_FreeStream() pools
+ * a stream and DS_CreateStream() hands it out again: the timestep tree of a
+ * state comes from a pool of the thread that decoded, so reset() on that
+ * thread must free all of it. The state is then reused and destroyed on
+ * another thread after the first one exited, and must decode like a new one.
+ * Build with -fsanitize=address to catch nodes left behind.
+ */
+
+namespace {
+
+int failures = 0;
+
+void
+expect(bool condition, const char* what)
+{
+  if (!condition && ++failures <= 10) {
+    fprintf(stderr, "check failed: %s\n", what);
+  }
+}
+
+// Alphabet of a space, the lowercase letters and an apostrophe, in the
+// serialization format of util/text.py
+Alphabet
+make_alphabet(const std::string& labels)
+{
+  std::string buffer;
+  auto put_u16 = [&buffer](uint16_t value) {
+    buffer.append(reinterpret_cast<const char*>(&value), sizeof(value));
+  };
+  put_u16(labels.size());
+  for (size_t i = 0; i < labels.size(); ++i) {
+    put_u16(i);
+    put_u16(1);
+    buffer.push_back(labels[i]);
+  }
+  Alphabet alphabet;
+  alphabet.Deserialize(buffer.data(), buffer.size());
+  return alphabet;
+}
+
+// Softmax rows of random logits favoring the blank, the last class
+std::vector<float>
+make_probs(size_t num_steps, size_t class_dim, unsigned int seed)
+{
+  std::mt19937 rng(seed);
+  std::normal_distribution<float> logits(0.f, 2.5f);
+  std::vector<float> probs(num_steps * class_dim);
+  for (size_t t = 0; t < num_steps; ++t) {
+    float* row = &probs[t * class_dim];
+    float sum = 0.f;
+    for (size_t c = 0; c < class_dim; ++c) {
+      row[c] = std::exp(logits(rng) + (c == class_dim - 1 ? 3.f : 0.f));
+      sum += row[c];
+    }
+    for (size_t c = 0; c < class_dim; ++c) {
+      row[c] /= sum;
+    }
+  }
+  return probs;
+}
+
+bool
+same_outputs(const std::vector<Output>& a, const std::vector<Output>& b)
+{
+  if (a.size() != b.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < a.size(); ++i) {
+    if (a[i].confidence != b[i].confidence || a[i].tokens != b[i].tokens ||
+        a[i].timesteps != b[i].timesteps) {
+      return false;
+    }
+  }
+  return true;
+}
+
+const std::unordered_map<std::string, float> no_hot_words;
+
+std::vector<Output>
+decode(DecoderState& state,
+       const Alphabet& alphabet,
+       TimingMode mode,
+       const std::vector<float>& probs)
+{
+  const size_t class_dim = alphabet.GetSize() + 1;
+  state.init(alphabet, 16, 1.0, 20, nullptr, no_hot_words);
+  state.set_timing_mode(mode);
+  state.next(probs.data(), probs.size() / class_dim, class_dim, class_dim);
+  return state.decode(4);
+}
+
+void
+check_reuse(const Alphabet& alphabet, TimingMode mode, const char* name)
+{
+  const size_t class_dim = alphabet.GetSize() + 1;
+  const std::vector<float> first = make_probs(150, class_dim, 5);
+  const std::vector<float> second = make_probs(150, class_dim, 6);
+
+  DecoderState* state = new DecoderState();
+  std::thread([&]() {
+    decode(*state, alphabet, mode, first);
+    state->reset();
+  }).join();
+
+  std::thread([&]() {
+    const std::vector<Output> reused = decode(*state, alphabet, mode, second);
+    delete state;
+
+    DecoderState fresh;
+    expect(same_outputs(reused, decode(fresh, alphabet, mode, second)), name);
+  }).join();
+}
+
+} // namespace
+
+int
+main()
+{
+  const Alphabet alphabet = make_alphabet(" abcdefghijklmnopqrstuvwxyz'");
+
+  check_reuse(alphabet, TIMING_TOKENS, "reused state decodes like a new one");
+  check_reuse(alphabet, TIMING_WORDS, "reused state decodes words like a new one");
+
+  if (failures > 0) {
+    fprintf(stderr, "%d checks failed\n", failures);
+    return 1;
+  }
+  printf("Decoder states reused across threads\n");
+  return 0;
+}
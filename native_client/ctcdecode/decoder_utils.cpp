@@ -4,8 +4,27 @@
 #include <cmath>
 #include <limits>
 
+namespace {
+
+struct LogAddTable {
+  float values[LOG_ADD_RANGE * LOG_ADD_STEPS + 1];
+
+  LogAddTable() {
+    for (int i = 0; i <= LOG_ADD_RANGE * LOG_ADD_STEPS; ++i) {
+      values[i] = std::log1p(std::exp(-static_cast<double>(i) / LOG_ADD_STEPS));
+    }
+  }
+};
+
+const LogAddTable log_add_table;
+
+}  // namespace
+
+const float* const LOG_ADD_TABLE = log_add_table.values;
+
+template<typename T>
 std::vector<std::pair<size_t, float>> get_pruned_log_probs(
-    const double *prob_step,
+    const T *prob_step,
     size_t class_dim,
     double cutoff_prob,
     size_t cutoff_top_n) {
@@ -31,13 +50,33 @@ std::vector<std::pair<size_t, float>> get_pruned_log_probs(
         prob_idx.begin(), prob_idx.begin() + cutoff_len);
   }
   std::vector<std::pair<size_t, float>> log_prob_idx;
+#ifdef DS_FAST_LOG_MATH
+  // Take the logs in a loop over contiguous floats, which vectorizes
+  std::vector<float> log_probs(cutoff_len);
+  for (size_t i = 0; i < cutoff_len; ++i) {
+    log_probs[i] = static_cast<float>(prob_idx[i].second) + NUM_FLT_MIN;
+  }
+  for (size_t i = 0; i < cutoff_len; ++i) {
+    log_probs[i] = fast_log(log_probs[i]);
+  }
+  log_prob_idx.reserve(cutoff_len);
+  for (size_t i = 0; i < cutoff_len; ++i) {
+    log_prob_idx.push_back(std::pair<int, float>(prob_idx[i].first, log_probs[i]));
+  }
+#else
   for (size_t i = 0; i < cutoff_len; ++i) {
     log_prob_idx.push_back(std::pair<int, float>(
         prob_idx[i].first, log(prob_idx[i].second + NUM_FLT_MIN)));
   }
+#endif
   return log_prob_idx;
 }
 
+template std::vector<std::pair<size_t, float>> get_pruned_log_probs<float>(
+    const float*, size_t, double, size_t);
+template std::vector<std::pair<size_t, float>> get_pruned_log_probs<double>(
+    const double*, size_t, double, size_t);
+
 size_t get_utf8_str_len(const std::string &str) {
   size_t str_len = 0;
   for (char c : str) {
@@ -107,15 +146,16 @@ bool prefix_compare(const PathTrie *x, const PathTrie *y) {
   }
 }
 
-bool prefix_compare_external(const PathTrie *x, const PathTrie *y, const std::unordered_map<const PathTrie*, float>& scores) {
-  if (scores.at(x) == scores.at(y)) {
-    if (x->character == y->character) {
+bool prefix_compare_external(const std::pair<float, PathTrie*> &x,
+                             const std::pair<float, PathTrie*> &y) {
+  if (x.first == y.first) {
+    if (x.second->character == y.second->character) {
       return false;
     } else {
-      return (x->character < y->character);
+      return (x.second->character < y.second->character);
     }
   } else {
-    return scores.at(x) > scores.at(y);
+    return x.first > y.first;
   }
 }
 
@@ -136,27 +176,39 @@ void add_word_to_fst(const std::vector<unsigned int> &word,
   dictionary->SetFinal(dst, fst::StdArc::Weight::One());
 }
 
-bool add_word_to_dictionary(
+bool word_to_dictionary_labels(
     const std::string &word,
     const std::unordered_map<std::string, int> &char_map,
     bool utf8,
     int SPACE_ID,
-    fst::StdVectorFst *dictionary) {
+    std::vector<unsigned int> *labels) {
   auto characters = utf8 ? split_into_bytes(word) : split_into_codepoints(word);
 
-  std::vector<unsigned int> int_word;
-
+  labels->clear();
   for (auto &c : characters) {
     auto int_c = char_map.find(c);
     if (int_c != char_map.end()) {
-      int_word.push_back(int_c->second);
+      labels->push_back(int_c->second);
     } else {
-      return false;  // return without adding
+      return false;
     }
   }
 
   if (!utf8) {
-    int_word.push_back(SPACE_ID);
+    labels->push_back(SPACE_ID);
+  }
+  return true;
+}
+
+bool add_word_to_dictionary(
+    const std::string &word,
+    const std::unordered_map<std::string, int> &char_map,
+    bool utf8,
+    int SPACE_ID,
+    fst::StdVectorFst *dictionary) {
+  std::vector<unsigned int> int_word;
+  if (!word_to_dictionary_labels(word, char_map, utf8, SPACE_ID, &int_word)) {
+    return false;  // return without adding
   }
 
   add_word_to_fst(int_word, dictionary);
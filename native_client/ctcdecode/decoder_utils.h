@@ -1,6 +1,9 @@
 #ifndef DECODER_UTILS_H_
 #define DECODER_UTILS_H_
 
+#include <cmath>
+#include <cstdint>
+#include <cstring>
 #include <utility>
 #include <vector>
 
@@ -42,6 +45,45 @@ bool pair_comp_second_rev(const std::pair<T1, T2> &a,
   return a.second > b.second;
 }
 
+/* Approximate log domain arithmetic, used by the beam search instead of
+ * std::log and std::exp when built with DS_FAST_LOG_MATH. fast_log1p_exp is
+ * within 2e-6 of the exact value, below the rounding of the float scores it
+ * is added to once their magnitude exceeds 16. fast_log is within three float
+ * ulps.
+ */
+
+// log(1 + exp(-d)) sampled every 1/LOG_ADD_STEPS for d in [0, LOG_ADD_RANGE]
+const int LOG_ADD_RANGE = 16;
+const int LOG_ADD_STEPS = 128;
+extern const float* const LOG_ADD_TABLE;
+
+// log(1 + exp(-d)) for d >= 0, linearly interpolated from LOG_ADD_TABLE. Past
+// LOG_ADD_RANGE the result is below 1.2e-7 and rounds to 0.
+inline float fast_log1p_exp(float d) {
+  if (!(d < LOG_ADD_RANGE)) return 0.f;
+  float pos = d * LOG_ADD_STEPS;
+  int i = static_cast<int>(pos);
+  float frac = pos - i;
+  return LOG_ADD_TABLE[i] + frac * (LOG_ADD_TABLE[i + 1] - LOG_ADD_TABLE[i]);
+}
+
+// Natural log of a positive normal float, without branches so that loops of
+// it vectorize.
+inline float fast_log(float x) {
+  // Split x into m * 2^e with m in [sqrt(1/2), sqrt(2))
+  uint32_t bits;
+  std::memcpy(&bits, &x, sizeof(bits));
+  int32_t e = static_cast<int32_t>(bits - 0x3f3504f3) >> 23;
+  bits -= static_cast<uint32_t>(e) << 23;
+  float m;
+  std::memcpy(&m, &bits, sizeof(m));
+  // log(m) = 2 atanh(s) with |s| <= 0.172, the series converges fast
+  float s = (m - 1.f) / (m + 1.f);
+  float z = s * s;
+  float series = 1.f + z * (1.f / 3 + z * (1.f / 5 + z * (1.f / 7 + z * (1.f / 9))));
+  return 2.f * s * series + e * 0.693147180559945f;
+}
+
 // Return the sum of two probabilities in log scale
 template <typename T>
 T log_sum_exp(const T &x, const T &y) {
@@ -49,12 +91,18 @@ T log_sum_exp(const T &x, const T &y) {
   if (x <= num_min) return y;
   if (y <= num_min) return x;
   T xmax = std::max(x, y);
+#ifdef DS_FAST_LOG_MATH
+  return xmax + fast_log1p_exp(std::abs(x - y));
+#else
   return std::log(std::exp(x - xmax) + std::exp(y - xmax)) + xmax;
+#endif
 }
 
-// Get pruned probability vector for each time step's beam search
+// Get pruned probability vector for each time step's beam search, instantiated
+// for float and double
+template<typename T>
 std::vector<std::pair<size_t, float>> get_pruned_log_probs(
-    const double *prob_step,
+    const T *prob_step,
     size_t class_dim,
     double cutoff_prob,
     size_t cutoff_top_n);
@@ -62,7 +110,10 @@ std::vector<std::pair<size_t, float>> get_pruned_log_probs(
 // Functor for prefix comparsion
 bool prefix_compare(const PathTrie *x, const PathTrie *y);
 
-bool prefix_compare_external(const PathTrie *x, const PathTrie *y, const std::unordered_map<const PathTrie*, float>& scores);
+// Functor for comparison of (score, prefix) pairs, used when the score differs
+// from the one stored in the prefix
+bool prefix_compare_external(const std::pair<float, PathTrie*> &x,
+                             const std::pair<float, PathTrie*> &y);
 
 /* Get length of utf8 encoding string
  * See: http://stackoverflow.com/a/4063229
@@ -95,6 +146,30 @@ inline bool byte_is_codepoint_boundary(unsigned char c) {
   return (c & 0xC0) != 0x80;
 }
 
+// Returns the length in bytes of the UTF-8 sequence starting with byte |c|,
+// or 0 if |c| cannot start a sequence.
+inline int utf8_sequence_length(unsigned char c) {
+  if ((c >> 3) == 0x1E) {
+    return 4;
+  } else if ((c >> 4) == 0x0E) {
+    return 3;
+  } else if ((c >> 5) == 0x06) {
+    return 2;
+  } else if ((c >> 7) == 0x00) {
+    return 1;
+  }
+  return 0;
+}
+
+// Convert a word in string to the labels of its path in the dictionary,
+// returning false if it has characters missing from char_map
+bool word_to_dictionary_labels(
+    const std::string &word,
+    const std::unordered_map<std::string, int> &char_map,
+    bool utf8,
+    int SPACE_ID,
+    std::vector<unsigned int> *labels);
+
 // Add a word in string to dictionary
 bool add_word_to_dictionary(
     const std::string &word,
@@ -0,0 +1,130 @@
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "decoder_utils.h"
+
+/* Checks the approximate log domain arithmetic of decoder_utils.h against
+ * the exact computation, within the bounds documented there: 2e-6 for
+ * fast_log1p_exp and three float ulps for fast_log. log_sum_exp and
+ * get_pruned_log_probs are checked the same way in the configuration they
+ * were built with, run with --define=log_math=fast to cover the approximate
+ * beam search.
+ */
+
+namespace {
+
+int failures = 0;
+
+void
+expect_near(const char* what, double input, double actual, double expected, double tolerance)
+{
+  if (!(std::abs(actual - expected) <= tolerance)) {
+    if (++failures <= 10) {
+      fprintf(stderr, "%s(%.9g) = %.9g, expected %.9g within %.3g\n",
+              what, input, actual, expected, tolerance);
+    }
+  }
+}
+
+// Distance between a float and the next one away from zero
+double
+ulp(float x)
+{
+  x = std::abs(x);
+  return std::nextafter(x, std::numeric_limits<float>::infinity()) - x;
+}
+
+void
+check_log1p_exp()
+{
+  for (int i = 0; i <= 20 * 4096; ++i) {
+    const float d = i / 4096.f;
+    expect_near("fast_log1p_exp", d, fast_log1p_exp(d),
+                std::log1p(std::exp(-(double)d)), 2e-6);
+  }
+  expect_near("fast_log1p_exp", INFINITY, fast_log1p_exp(INFINITY), 0., 0.);
+}
+
+void
+check_log()
+{
+  // Every 97th float from the smallest normal one to the largest one
+  for (uint32_t bits = 0x00800000; bits < 0x7f800000; bits += 97) {
+    float x;
+    memcpy(&x, &bits, sizeof(x));
+    const float expected = std::log((double)x);
+    expect_near("fast_log", x, fast_log(x), expected, 3 * ulp(expected));
+  }
+}
+
+void
+check_log_sum_exp()
+{
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<float> scores(-200.f, 0.f);
+  std::uniform_real_distribution<float> offsets(-20.f, 20.f);
+  for (int i = 0; i < 1000000; ++i) {
+    const float x = scores(rng);
+    const float y = x + offsets(rng);
+    const double xmax = std::max<double>(x, y);
+    const double expected = xmax + std::log(std::exp(x - xmax) + std::exp(y - xmax));
+    // Adding the correction to xmax rounds to the float scores' precision
+    expect_near("log_sum_exp", y - x, log_sum_exp(x, y), expected,
+                2e-6 + ulp(expected));
+  }
+  expect_near("log_sum_exp", 0., log_sum_exp(-NUM_FLT_INF, -3.f), -3., 0.);
+  expect_near("log_sum_exp", 0., log_sum_exp(-3.f, -NUM_FLT_INF), -3., 0.);
+}
+
+void
+check_pruned_log_probs()
+{
+  std::mt19937 rng(2);
+  std::uniform_real_distribution<float> exponents(-30.f, 0.f);
+  const size_t class_dim = 64;
+  std::vector<float> probs(class_dim);
+  for (int i = 0; i < 10000; ++i) {
+    for (float& prob : probs) {
+      prob = std::pow(10.f, exponents(rng));
+    }
+    probs[i % class_dim] = 1.f;
+    probs[(i + 1) % class_dim] = 0.f;
+    std::vector<std::pair<size_t, float>> log_probs =
+      get_pruned_log_probs(probs.data(), class_dim, 1.0, class_dim);
+    if (log_probs.size() != class_dim) {
+      ++failures;
+      fprintf(stderr, "get_pruned_log_probs returned %zu classes, expected %zu\n",
+              log_probs.size(), class_dim);
+      return;
+    }
+    for (const auto& log_prob : log_probs) {
+      const float expected = std::log((double)probs[log_prob.first] + NUM_FLT_MIN);
+      expect_near("get_pruned_log_probs", probs[log_prob.first], log_prob.second,
+                  expected, 3 * ulp(expected));
+    }
+  }
+}
+
+}  // namespace
+
+int
+main()
+{
+  check_log1p_exp();
+  check_log();
+  check_log_sum_exp();
+  check_pruned_log_probs();
+  if (failures > 0) {
+    fprintf(stderr, "%d checks failed\n", failures);
+    return 1;
+  }
+#ifdef DS_FAST_LOG_MATH
+  printf("Approximate log math within bounds, beam search uses it\n");
+#else
+  printf("Approximate log math within bounds, beam search uses std::log\n");
+#endif
+  return 0;
+}
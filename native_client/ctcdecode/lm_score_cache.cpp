@@ -0,0 +1,109 @@
+#include "lm_score_cache.h"
+
+const size_t LMScoreCache::kDefaultSlots;
+const size_t LMScoreCache::kMaxProbes;
+
+LMScoreCache::LMScoreCache(size_t slots)
+{
+  set_slots(slots);
+}
+
+void
+LMScoreCache::set_slots(size_t slots)
+{
+  size_t size = 0;
+  if (slots > 0) {
+    size = 1;
+    while (size < slots) {
+      size <<= 1;
+    }
+  }
+  slots_.clear();
+  slots_.resize(size);
+  slots_.shrink_to_fit();
+  mask_ = size ? size - 1 : 0;
+  generation_ = 1;
+}
+
+void
+LMScoreCache::clear()
+{
+  if (++generation_ == 0) {
+    // Wrapped around, slots of old generations could look current again
+    for (Slot& slot : slots_) {
+      slot.generation = 0;
+    }
+    generation_ = 1;
+  }
+}
+
+void
+LMScoreCache::make_key(const std::vector<std::string>& ngram, bool bos, Key& key)
+{
+  // Words can't contain NUL, so it separates them unambiguously
+  key.text.assign(1, bos ? '\1' : '\0');
+  for (const std::string& word : ngram) {
+    key.text += word;
+    key.text += '\0';
+  }
+  hash_key(key);
+}
+
+void
+LMScoreCache::make_key(const uint32_t* ids, size_t num_ids, bool bos, Key& key)
+{
+  key.text.assign(1, bos ? '\3' : '\2');
+  key.text.append(reinterpret_cast<const char*>(ids), num_ids * sizeof(uint32_t));
+  hash_key(key);
+}
+
+void
+LMScoreCache::hash_key(Key& key)
+{
+  // FNV-1a
+  uint64_t hash = 14695981039346656037ULL;
+  for (char c : key.text) {
+    hash = (hash ^ (unsigned char)c) * 1099511628211ULL;
+  }
+  key.hash = hash;
+}
+
+bool
+LMScoreCache::lookup(const Key& key, double* score) const
+{
+  if (slots_.empty()) {
+    return false;
+  }
+  for (size_t i = 0; i < kMaxProbes; ++i) {
+    const Slot& slot = slots_[(key.hash + i) & mask_];
+    if (slot.generation != generation_) {
+      break;
+    }
+    if (slot.key == key) {
+      *score = slot.score;
+      return true;
+    }
+  }
+  return false;
+}
+
+void
+LMScoreCache::insert(const Key& key, double score)
+{
+  if (slots_.empty()) {
+    return;
+  }
+  // Lookups stop at the first empty slot, so fill the first one. If the run
+  // is full, evict its first entry.
+  Slot* target = &slots_[key.hash & mask_];
+  for (size_t i = 0; i < kMaxProbes; ++i) {
+    Slot& slot = slots_[(key.hash + i) & mask_];
+    if (slot.generation != generation_) {
+      target = &slot;
+      break;
+    }
+  }
+  target->key = key;
+  target->generation = generation_;
+  target->score = score;
+}
@@ -0,0 +1,88 @@
+#ifndef LM_SCORE_CACHE_H_
+#define LM_SCORE_CACHE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/* Bounded cache of language model conditional log probabilities, keyed on the
+ * scored n-gram (its context words and the new word) and the begin of
+ * sentence flag. Beams reaching the same word boundary on consecutive
+ * timesteps then cost one hash probe instead of a walk through the language
+ * model.
+ *
+ * Open addressing with linear probing over a power of two number of slots.
+ * A lookup looks at no more than kMaxProbes slots, and an insertion that
+ * finds them all taken evicts the first one, so the cost of both is bounded
+ * and the cache never grows. clear() only bumps a generation number, slots
+ * of older generations count as empty.
+ *
+ * Usage:
+ *     LMScoreCache::Key key;
+ *     LMScoreCache::make_key(ngram, bos, key);
+ *     double score;
+ *     if (!cache.lookup(key, &score)) {
+ *       score = scorer.get_log_cond_prob(ngram, bos);
+ *       cache.insert(key, score);
+ *     }
+ */
+class LMScoreCache {
+public:
+  static const size_t kDefaultSlots = 4096;
+  static const size_t kMaxProbes = 8;
+
+  // Serialized n-gram and its hash
+  struct Key {
+    std::string text;
+    uint64_t hash = 0;
+
+    bool operator==(const Key& other) const {
+      return hash == other.hash && text == other.text;
+    }
+  };
+
+  explicit LMScoreCache(size_t slots = kDefaultSlots);
+
+  // Build the key of an n-gram, reusing the storage of key.
+  static void make_key(const std::vector<std::string>& ngram, bool bos, Key& key);
+
+  // Build the key of an n-gram given as language model word ids. It never
+  // equals the key of an n-gram given as strings.
+  static void make_key(const uint32_t* ids, size_t num_ids, bool bos, Key& key);
+
+  /* Change the number of slots, rounded up to a power of two. Drops all
+   * entries. Zero disables the cache: lookups always miss.
+  */
+  void set_slots(size_t slots);
+  size_t get_slots() const { return slots_.size(); }
+
+  // Drop all entries, in constant time.
+  void clear();
+
+  /* Look an n-gram up.
+   *
+   * Return:
+   *     Whether the n-gram was found, in which case its score is stored in
+   *     score.
+  */
+  bool lookup(const Key& key, double* score) const;
+
+  // Add the score of an n-gram that lookup() did not find.
+  void insert(const Key& key, double score);
+
+private:
+  static void hash_key(Key& key);
+
+  struct Slot {
+    Key key;
+    uint32_t generation = 0;  // 0 is never current, empty slot
+    double score = 0.;
+  };
+
+  std::vector<Slot> slots_;
+  size_t mask_ = 0;
+  uint32_t generation_ = 1;
+};
+
+#endif  // LM_SCORE_CACHE_H_
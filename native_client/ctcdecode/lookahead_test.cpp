@@ -0,0 +1,276 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "alphabet.h"
+#include "ctc_beam_search_decoder.h"
+#include "scorer.h"
+
+#include "lm/model.hh"
+
+/* Skipping the extensions that can't enter the beam must not drop prefixes
+ * from it with LM look-ahead enabled. The language model is built so that
+ * words following a known word score far above the unigram estimate of the
+ * look-ahead, which is the case where a word end gains the most over its
+ * prefix. Each timestep of random input is decoded from the same state with
+ * and without the cutoff and the beams are compared.
+ */
+
+namespace {
+
+const size_t kBeamSize = 8;
+
+int failures = 0;
+
+void
+expect(bool condition, const char* what)
+{
+  if (!condition && ++failures <= 10) {
+    fprintf(stderr, "check failed: %s\n", what);
+  }
+}
+
+// Alphabet of a space and the given letters, in the serialization format of
+// util/text.py
+Alphabet
+make_alphabet(const std::string& labels)
+{
+  std::string buffer;
+  auto put_u16 = [&buffer](uint16_t value) {
+    buffer.append(reinterpret_cast<const char*>(&value), sizeof(value));
+  };
+  put_u16(labels.size());
+  for (size_t i = 0; i < labels.size(); ++i) {
+    put_u16(i);
+    put_u16(1);
+    buffer.push_back(labels[i]);
+  }
+  Alphabet alphabet;
+  alphabet.Deserialize(buffer.data(), buffer.size());
+  return alphabet;
+}
+
+std::string
+temp_path(const char* name)
+{
+  const char* dir = getenv("TEST_TMPDIR");
+  return std::string(dir ? dir : "/tmp") + "/lookahead_test_" + name;
+}
+
+// Bigram ARPA model over random words where every bigram is much more likely
+// than its second word alone
+std::vector<std::string>
+write_arpa(const std::string& path, const std::string& letters)
+{
+  std::mt19937 rng(5);
+  std::uniform_int_distribution<size_t> letter(0, letters.size() - 1);
+  std::uniform_int_distribution<size_t> length(1, 4);
+  std::uniform_real_distribution<float> unigram(-5.f, -3.f);
+  std::uniform_real_distribution<float> bigram(-0.8f, -0.1f);
+
+  std::unordered_set<std::string> unique;
+  std::vector<std::string> words;
+  while (words.size() < 60) {
+    std::string word;
+    for (size_t i = length(rng); i > 0; --i) {
+      word.push_back(letters[letter(rng)]);
+    }
+    if (unique.insert(word).second) {
+      words.push_back(word);
+    }
+  }
+
+  std::vector<std::pair<std::string, std::string>> bigrams;
+  for (size_t i = 0; i < words.size(); ++i) {
+    for (size_t j = i % 3; j < words.size(); j += 3) {
+      bigrams.emplace_back(words[i], words[j]);
+    }
+  }
+
+  std::ofstream out(path);
+  out << "\\data\\\n"
+      << "ngram 1=" << words.size() + 3 << "\n"
+      << "ngram 2=" << bigrams.size() << "\n\n"
+      << "\\1-grams:\n"
+      << "-5\t<unk>\t0\n"
+      << "-99\t<s>\t0\n"
+      << "-2\t</s>\t0\n";
+  for (const std::string& word : words) {
+    out << unigram(rng) << "\t" << word << "\t0\n";
+  }
+  out << "\n\\2-grams:\n";
+  for (const auto& pair : bigrams) {
+    out << bigram(rng) << "\t" << pair.first << " " << pair.second << "\n";
+  }
+  out << "\n\\end\\\n";
+  return words;
+}
+
+std::shared_ptr<Scorer>
+make_scorer(const Alphabet& alphabet, const std::string& letters)
+{
+  const std::string arpa_path = temp_path("lm.arpa");
+  const std::string binary_path = temp_path("lm.binary");
+  const std::vector<std::string> words = write_arpa(arpa_path, letters);
+  {
+    // Scorer packages don't store the vocabulary of the model, the dictionary
+    // follows it instead
+    lm::ngram::Config config;
+    config.write_mmap = binary_path.c_str();
+    config.include_vocab = false;
+    config.messages = nullptr;
+    lm::ngram::ProbingModel model(arpa_path.c_str(), config);
+  }
+
+  std::shared_ptr<Scorer> scorer(new Scorer());
+  scorer->set_alphabet(alphabet);
+  scorer->set_utf8_mode(false);
+  scorer->reset_params(2.0, 0.5);
+  if (scorer->load_lm(binary_path) != DS_ERR_SCORER_NO_TRIE) {
+    return nullptr;
+  }
+  scorer->fill_dictionary(std::unordered_set<std::string>(words.begin(), words.end()));
+  remove(arpa_path.c_str());
+  remove(binary_path.c_str());
+  return scorer;
+}
+
+// Softmax rows of random logits favoring the blank, the last class
+std::vector<float>
+make_probs(size_t num_steps, size_t class_dim, unsigned int seed)
+{
+  std::mt19937 rng(seed);
+  std::normal_distribution<float> logits(0.f, 2.5f);
+  std::vector<float> probs(num_steps * class_dim);
+  for (size_t t = 0; t < num_steps; ++t) {
+    float* row = &probs[t * class_dim];
+    float sum = 0.f;
+    for (size_t c = 0; c < class_dim; ++c) {
+      row[c] = std::exp(logits(rng) + (c == class_dim - 1 ? 1.f : 0.f));
+      sum += row[c];
+    }
+    for (size_t c = 0; c < class_dim; ++c) {
+      row[c] /= sum;
+    }
+  }
+  return probs;
+}
+
+const std::unordered_map<std::string, float> no_hot_words;
+
+// Copy of state, with the extension cutoff enabled or not
+void
+copy_state(const DecoderState& state,
+           const Alphabet& alphabet,
+           std::shared_ptr<Scorer> scorer,
+           bool cutoff,
+           DecoderState& copy)
+{
+  SnapshotWriter writer;
+  state.save(writer);
+  const std::string snapshot = writer.data();
+  SnapshotReader reader(snapshot.data(), snapshot.size());
+  copy.init(alphabet, kBeamSize, 1.0, alphabet.GetSize() + 1, scorer, no_hot_words);
+  expect(copy.load(reader) && reader.done(), "decoder state copies");
+  copy.set_extension_cutoff(cutoff);
+}
+
+bool
+find_output(const std::vector<Output>& outputs, const Output& expected, float tolerance)
+{
+  for (const Output& output : outputs) {
+    if (output.tokens == expected.tokens &&
+        std::fabs(output.confidence - expected.confidence) <= tolerance) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Whether the beam after a timestep decoded with the cutoff holds the new
+// prefixes of the beam decoded without it. The cutoff also skips a little
+// probability a prefix can get from the others, at most log(2), which can
+// swap the last prefixes of the beam, so prefixes that were already in the
+// beam before may be missing and scores are compared with that tolerance.
+bool
+same_beam(const std::vector<Output>& before,
+          const std::vector<Output>& with_cutoff,
+          const std::vector<Output>& without)
+{
+  const float tolerance = std::log(2.f);
+  for (const Output& expected : without) {
+    if (!find_output(with_cutoff, expected, tolerance) &&
+        !find_output(before, expected, std::numeric_limits<float>::infinity())) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Decode probs one timestep at a time, checking each step from the same
+// state with and without the cutoff
+void
+check_steps(const Alphabet& alphabet,
+            std::shared_ptr<Scorer> scorer,
+            const std::vector<float>& probs,
+            float beam_threshold,
+            const char* name)
+{
+  const size_t class_dim = alphabet.GetSize() + 1;
+  DecoderState state;
+  state.init(alphabet, kBeamSize, 1.0, class_dim, scorer, no_hot_words);
+  state.set_lm_lookahead(true);
+  state.set_beam_threshold(beam_threshold);
+
+  for (size_t t = 0; t < probs.size() / class_dim; ++t) {
+    const float* step = &probs[t * class_dim];
+    DecoderState with_cutoff, without;
+    copy_state(state, alphabet, scorer, true, with_cutoff);
+    copy_state(state, alphabet, scorer, false, without);
+    with_cutoff.next(step, 1, class_dim, class_dim);
+    without.next(step, 1, class_dim, class_dim);
+    if (!same_beam(state.decode(kBeamSize),
+                   with_cutoff.decode(kBeamSize),
+                   without.decode(kBeamSize))) {
+      expect(false, name);
+      return;
+    }
+    state.next(step, 1, class_dim, class_dim);
+  }
+}
+
+} // namespace
+
+int
+main()
+{
+  const std::string letters = "abcdef";
+  const Alphabet alphabet = make_alphabet(" " + letters);
+  std::shared_ptr<Scorer> scorer = make_scorer(alphabet, letters);
+  if (!scorer) {
+    fprintf(stderr, "could not build the language model\n");
+    return 1;
+  }
+
+  const size_t class_dim = alphabet.GetSize() + 1;
+  for (unsigned int seed = 1; seed <= 20; ++seed) {
+    const std::vector<float> probs = make_probs(60, class_dim, seed);
+    check_steps(alphabet, scorer, probs, 0.f, "cutoff at the end of the beam");
+    check_steps(alphabet, scorer, probs, 10.f, "cutoff from the beam threshold");
+  }
+
+  if (failures > 0) {
+    fprintf(stderr, "%d checks failed\n", failures);
+    return 1;
+  }
+  printf("Extension cutoff keeps the look-ahead results\n");
+  return 0;
+}
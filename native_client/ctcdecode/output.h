@@ -3,6 +3,36 @@
 
 #include <vector>
 
+/* Timing information tracked by the beam search:
+ *  - TIMING_TOKENS: the timestep of every token of every prefix, exact for
+ *    each hypothesis.
+ *  - TIMING_WORDS: one timestep per prefix trie node, from the best path to
+ *    that node. Later tokens can have been aligned differently, so token
+ *    timesteps are approximate, but close enough for the start and end of
+ *    words.
+ *  - TIMING_NONE: no timing at all, timesteps are 0.
+ */
+enum TimingMode {
+  TIMING_TOKENS,
+  TIMING_WORDS,
+  TIMING_NONE
+};
+
+/* Struct for a word of the beam search output. The word is made of num_tokens
+ * tokens starting at first_token in Output::tokens. end_timestep is the
+ * timestep of the space following the word, or the one after its last token.
+ * acoustic_score is the sum of the log probabilities of its tokens, and
+ * lm_score the log probability given by the language model, 0 without one.
+ */
+struct WordOutput {
+    unsigned int first_token;
+    unsigned int num_tokens;
+    unsigned int start_timestep;
+    unsigned int end_timestep;
+    double acoustic_score;
+    double lm_score;
+};
+
 /* Struct for the beam search output, containing the tokens based on the vocabulary indices, and the timesteps
  * for each token in the beam search output
  */
@@ -10,6 +40,23 @@ struct Output {
     double confidence;
     std::vector<unsigned int> tokens;
     std::vector<unsigned int> timesteps;
+    // Only filled by DecoderState::decode_words()
+    std::vector<WordOutput> words;
+};
+
+/* Struct for the beam search output of a whole batch, flattened into a few
+ * arrays. Result r of utterance b has confidence confidences[b*num_results+r]
+ * and spans tokens and timesteps from offsets[b*num_results+r] up to
+ * offsets[b*num_results+r+1]. Utterances with fewer than num_results results
+ * are padded with empty results of confidence -infinity.
+ */
+struct BatchOutput {
+    int batch_size;
+    int num_results;
+    std::vector<double> confidences;
+    std::vector<unsigned int> offsets;
+    std::vector<unsigned int> tokens;
+    std::vector<unsigned int> timesteps;
 };
 
 #endif  // OUTPUT_H_
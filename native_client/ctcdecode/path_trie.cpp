@@ -1,6 +1,7 @@
 #include "path_trie.h"
 
 #include <algorithm>
+#include <atomic>
 #include <limits>
 #include <memory>
 #include <utility>
@@ -8,6 +9,16 @@
 
 #include "decoder_utils.h"
 
+static std::atomic<uint64_t> next_serial(0);
+
+// Timestep id of nodes that don't point into the timestep tree, in snapshots
+static const uint32_t NO_TIMESTEPS = (uint32_t)-1;
+
+// Node flags in snapshots
+static const uint8_t SNAPSHOT_EXISTS = 1;
+static const uint8_t SNAPSHOT_ENDS_WORD = 2;
+static const uint8_t SNAPSHOT_LM_LOOKAHEAD = 4;
+
 PathTrie::PathTrie() {
   log_prob_b_prev = -NUM_FLT_INF;
   log_prob_nb_prev = -NUM_FLT_INF;
@@ -18,6 +29,8 @@ PathTrie::PathTrie() {
 
   ROOT_ = -1;
   character = ROOT_;
+  depth = 0;
+  serial = next_serial.fetch_add(1, std::memory_order_relaxed);
   exists_ = true;
   parent = nullptr;
 
@@ -66,24 +79,13 @@ PathTrie* PathTrie::get_path_trie(unsigned int new_char, float cur_log_prob_c, b
       } else {
         PathTrie* new_path = new PathTrie;
         new_path->character = new_char;
+        new_path->depth = depth + 1;
         new_path->parent = this;
         new_path->dictionary_ = dictionary_;
         new_path->has_dictionary_ = true;
         new_path->matcher_ = matcher_;
         new_path->log_prob_c = cur_log_prob_c;
-
-        // set spell checker state
-        // check to see if next state is final
-        auto FSTZERO = fst::TropicalWeight::Zero();
-        auto final_weight = dictionary_->Final(matcher_->Value().nextstate);
-        bool is_final = (final_weight != FSTZERO);
-        if (is_final && reset) {
-          // restart spell checker at the start state
-          new_path->dictionary_state_ = dictionary_->Start();
-        } else {
-          // go to next state
-          new_path->dictionary_state_ = matcher_->Value().nextstate;
-        }
+        follow_matched_arc(new_path, reset);
 
         children_.push_back(std::make_pair(new_char, new_path));
         return new_path;
@@ -91,6 +93,7 @@ PathTrie* PathTrie::get_path_trie(unsigned int new_char, float cur_log_prob_c, b
     } else {
       PathTrie* new_path = new PathTrie;
       new_path->character = new_char;
+      new_path->depth = depth + 1;
       new_path->parent = this;
       new_path->log_prob_c = cur_log_prob_c;
       children_.push_back(std::make_pair(new_char, new_path));
@@ -99,6 +102,39 @@ PathTrie* PathTrie::get_path_trie(unsigned int new_char, float cur_log_prob_c, b
   }
 }
 
+void PathTrie::follow_matched_arc(PathTrie* child, bool reset) const {
+  // set spell checker state
+  // check to see if next state is final
+  auto FSTZERO = fst::TropicalWeight::Zero();
+  auto final_weight = dictionary_->Final(matcher_->Value().nextstate);
+  bool is_final = (final_weight != FSTZERO);
+  if (is_final && reset) {
+    // restart spell checker at the start state
+    child->dictionary_state_ = dictionary_->Start();
+  } else {
+    // go to next state
+    child->dictionary_state_ = matcher_->Value().nextstate;
+  }
+
+  if (word_ids_) {
+    uint32_t rank = word_rank_ + word_ids_->arc_offset(dictionary_state_,
+                                                       matcher_->Position());
+    child->word_ids_ = word_ids_;
+    if (is_final) {
+      child->ends_word = true;
+      child->word_id = word_ids_->ids[rank];
+    }
+    child->word_rank_ = (is_final && reset) ? 0 : rank;
+  }
+
+  if (lm_lookahead_) {
+    child->lm_lookahead_ = lm_lookahead_;
+    child->lm_lookahead = (is_final && reset)
+                          ? 0.0
+                          : (*lm_lookahead_)[matcher_->Value().nextstate];
+  }
+}
+
 void PathTrie::get_path_vec(std::vector<unsigned int>& output) {
   // Recursive call: recurse back until stop condition, then append data in
   // correct order as we walk back down the stack in the lines below.
@@ -119,7 +155,7 @@ PathTrie* PathTrie::get_prev_grapheme(std::vector<unsigned int>& output,
   }
   // Recursive call: recurse back until stop condition, then append data in
   // correct order as we walk back down the stack in the lines below.
-  if (!byte_is_codepoint_boundary(alphabet.DecodeSingle(character)[0])) {
+  if (!alphabet.IsCodepointBoundary(character)) {
     stop = parent->get_prev_grapheme(output, alphabet);
   }
   output.push_back(character);
@@ -129,8 +165,8 @@ PathTrie* PathTrie::get_prev_grapheme(std::vector<unsigned int>& output,
 int PathTrie::distance_to_codepoint_boundary(unsigned char *first_byte,
                                              const Alphabet& alphabet)
 {
-  if (byte_is_codepoint_boundary(alphabet.DecodeSingle(character)[0])) {
-    *first_byte = (unsigned char)character + 1;
+  if (alphabet.IsCodepointBoundary(character)) {
+    *first_byte = alphabet.GetFirstByte(character);
     return 1;
   }
   if (parent != nullptr && parent->character != ROOT_) {
@@ -156,11 +192,12 @@ PathTrie* PathTrie::get_prev_word(std::vector<unsigned int>& output,
   return stop;
 }
 
+template<TimingMode Mode>
 void PathTrie::iterate_to_vec(std::vector<PathTrie*>& output) {
   // previous_timesteps might point to ancestors' timesteps
   // therefore, children must be uptaded first
   for (auto child : children_) {
-    child.second->iterate_to_vec(output);
+    child.second->iterate_to_vec<Mode>(output);
   }
   if (exists_) {
     log_prob_b_prev = log_prob_b_cur;
@@ -171,24 +208,70 @@ void PathTrie::iterate_to_vec(std::vector<PathTrie*>& output) {
 
     score = log_sum_exp(log_prob_b_prev, log_prob_nb_prev);
 
-    if (previous_timesteps != nullptr) {
-      timesteps = nullptr;
-      for (auto const& child : previous_timesteps->children) {
-        if (child->data == new_timestep) {
-            timesteps = child.get();
-            break;
+    if (Mode == TIMING_TOKENS) {
+      if (previous_timesteps != nullptr) {
+        timesteps = nullptr;
+        for (auto const& child : previous_timesteps->children) {
+          if (child->data == new_timestep) {
+              timesteps = child.get();
+              break;
+          }
+        }
+        if (timesteps == nullptr) {
+            timesteps = add_child(previous_timesteps, new_timestep);
         }
       }
-      if (timesteps == nullptr) {
-          timesteps = add_child(previous_timesteps, new_timestep);
+      previous_timesteps = nullptr;
+    } else if (Mode == TIMING_WORDS) {
+      if (has_new_timestep) {
+        char_timestep = new_timestep;
       }
+      has_new_timestep = false;
     }
-    previous_timesteps = nullptr;
 
     output.push_back(this);
   }
 }
 
+template void PathTrie::iterate_to_vec<TIMING_TOKENS>(std::vector<PathTrie*>& output);
+template void PathTrie::iterate_to_vec<TIMING_WORDS>(std::vector<PathTrie*>& output);
+template void PathTrie::iterate_to_vec<TIMING_NONE>(std::vector<PathTrie*>& output);
+
+void PathTrie::get_all_nodes(std::vector<PathTrie*>& output) {
+  std::vector<PathTrie*> stack(1, this);
+  while (!stack.empty()) {
+    PathTrie* node = stack.back();
+    stack.pop_back();
+    output.push_back(node);
+    for (auto child = node->children_.rbegin(); child != node->children_.rend(); ++child) {
+      stack.push_back(child->second);
+    }
+  }
+}
+
+PathTrie* PathTrie::get_common_ancestor() {
+  // Leaves always exist, so a non-existing node with a single child only
+  // leads to existing nodes through that child
+  PathTrie* node = this;
+  while (!node->exists_ && node->children_.size() == 1) {
+    node = node->children_[0].second;
+  }
+  return node;
+}
+
+void PathTrie::make_root() {
+  if (parent != nullptr) {
+    for (auto child = parent->children_.begin(); child != parent->children_.end(); ++child) {
+      if (child->second == this) {
+        parent->children_.erase(child);
+        break;
+      }
+    }
+    parent = nullptr;
+  }
+  character = ROOT_;
+}
+
 void PathTrie::remove() {
   exists_ = false;
 
@@ -208,6 +291,178 @@ void PathTrie::remove() {
   }
 }
 
+void PathTrie::save(SnapshotWriter& writer,
+                    const std::unordered_map<const TimestepTreeNode*, uint32_t>& timestep_ids,
+                    std::vector<const PathTrie*>& nodes) const {
+  // Where the root is in the dictionary, which its committed characters
+  // can't tell anymore. The other nodes get there again from their parents.
+  writer.put(depth);
+  writer.put<int64_t>(dictionary_state_);
+  writer.put(word_rank_);
+
+  std::vector<const PathTrie*> stack(1, this);
+  while (!stack.empty()) {
+    const PathTrie* node = stack.back();
+    stack.pop_back();
+    node->save_node(writer, timestep_ids);
+    nodes.push_back(node);
+    for (auto child = node->children_.rbegin(); child != node->children_.rend(); ++child) {
+      stack.push_back(child->second);
+    }
+  }
+}
+
+void PathTrie::save_node(SnapshotWriter& writer,
+                         const std::unordered_map<const TimestepTreeNode*, uint32_t>& timestep_ids) const {
+  uint8_t flags = (exists_ ? SNAPSHOT_EXISTS : 0) |
+                  (ends_word ? SNAPSHOT_ENDS_WORD : 0) |
+                  (lm_lookahead_ ? SNAPSHOT_LM_LOOKAHEAD : 0);
+  uint32_t timesteps_id = NO_TIMESTEPS;
+  if (timesteps != nullptr) {
+    auto it = timestep_ids.find(timesteps);
+    assert(it != timestep_ids.end());
+    timesteps_id = it->second;
+  }
+
+  // Current log probabilities and the timestep storage are only used during
+  // a timestep, and the partial word score is computed again when needed
+  writer.put(flags);
+  writer.put(character);
+  writer.put(log_prob_b_prev);
+  writer.put(log_prob_nb_prev);
+  writer.put(log_prob_c);
+  writer.put(score);
+  writer.put(char_timestep);
+  writer.put(timesteps_id);
+  writer.put<uint32_t>(children_.size());
+}
+
+bool PathTrie::load(SnapshotReader& reader,
+                    const std::vector<TimestepTreeNode*>& timesteps_by_id,
+                    const std::shared_ptr<const std::vector<float>>& lm_lookahead_scores,
+                    std::vector<PathTrie*>& nodes) {
+  int64_t dictionary_state;
+  reader.get(depth);
+  reader.get(dictionary_state);
+  reader.get(word_rank_);
+  uint32_t num_children;
+  if (!load_node(reader, timesteps_by_id, lm_lookahead_scores, &num_children)) {
+    return false;
+  }
+  if (lm_lookahead_ && !has_dictionary_) {
+    return reader.fail();
+  }
+  if (has_dictionary_) {
+    if (dictionary_state < 0 || dictionary_state >= dictionary_->NumStates() ||
+        (word_ids_ && !word_ids_->valid_rank(dictionary_state, word_rank_))) {
+      return reader.fail();
+    }
+    dictionary_state_ = dictionary_state;
+  }
+  // Both are relative to the root's dictionary state, and n-grams stop at
+  // the root so its word id is never used
+  lm_lookahead = lm_lookahead_ ? (*lm_lookahead_)[dictionary_state_] : 0.0;
+  word_id = 0;
+  nodes.push_back(this);
+
+  // Nodes still missing children, and how many
+  std::vector<std::pair<PathTrie*, uint32_t>> stack;
+  if (num_children > 0) {
+    stack.emplace_back(this, num_children);
+  }
+  while (!stack.empty()) {
+    PathTrie* node = stack.back().first;
+    if (--stack.back().second == 0) {
+      stack.pop_back();
+    }
+
+    PathTrie* child = new PathTrie;
+    child->parent = node;
+    child->depth = node->depth + 1;
+    child->dictionary_ = node->dictionary_;
+    child->has_dictionary_ = node->has_dictionary_;
+    child->matcher_ = node->matcher_;
+    // owned by its parent from here on, even if loading it fails
+    node->children_.push_back(std::make_pair(0u, child));
+    if (!child->load_node(reader, timesteps_by_id, lm_lookahead_scores, &num_children) ||
+        child->character == ROOT_) {
+      return reader.fail();
+    }
+    node->children_.back().first = child->character;
+
+    // Replay the character from the parent's dictionary state, as
+    // get_path_trie() did when it made the node
+    if (node->has_dictionary_) {
+      bool lookahead = (bool)child->lm_lookahead_;
+      child->lm_lookahead_.reset();
+      node->matcher_->SetState(node->dictionary_state_);
+      if (!node->matcher_->Find(child->character + 1)) {
+        return reader.fail();
+      }
+      bool ends_word = child->ends_word;
+      child->ends_word = false;
+      node->follow_matched_arc(child, true);
+      if (child->ends_word != ends_word || (bool)child->lm_lookahead_ != lookahead) {
+        return reader.fail();
+      }
+    } else if (child->lm_lookahead_ || child->ends_word) {
+      return reader.fail();
+    }
+
+    nodes.push_back(child);
+    if (num_children > 0) {
+      stack.emplace_back(child, num_children);
+    }
+  }
+  return !reader.failed();
+}
+
+bool PathTrie::load_node(SnapshotReader& reader,
+                         const std::vector<TimestepTreeNode*>& timesteps_by_id,
+                         const std::shared_ptr<const std::vector<float>>& lm_lookahead_scores,
+                         uint32_t* num_children) {
+  uint8_t flags;
+  uint32_t timesteps_id;
+  reader.get(flags);
+  reader.get(character);
+  reader.get(log_prob_b_prev);
+  reader.get(log_prob_nb_prev);
+  reader.get(log_prob_c);
+  reader.get(score);
+  reader.get(char_timestep);
+  reader.get(timesteps_id);
+  reader.get(*num_children);
+  if (reader.failed()) {
+    return false;
+  }
+
+  exists_ = (flags & SNAPSHOT_EXISTS) != 0;
+  ends_word = (flags & SNAPSHOT_ENDS_WORD) != 0;
+  if (flags & SNAPSHOT_LM_LOOKAHEAD) {
+    if (!lm_lookahead_scores) {
+      return reader.fail();
+    }
+    lm_lookahead_ = lm_lookahead_scores;
+  } else {
+    lm_lookahead_.reset();
+  }
+
+  if (timesteps_id == NO_TIMESTEPS) {
+    timesteps = nullptr;
+  } else if (timesteps_id < timesteps_by_id.size()) {
+    timesteps = timesteps_by_id[timesteps_id];
+  } else {
+    return reader.fail();
+  }
+
+  log_prob_b_cur = -NUM_FLT_INF;
+  log_prob_nb_cur = -NUM_FLT_INF;
+  previous_timesteps = nullptr;
+  has_new_timestep = false;
+  partial_word_scored = false;
+  return true;
+}
+
 void PathTrie::set_dictionary(std::shared_ptr<PathTrie::FstType> dictionary) {
   dictionary_ = dictionary;
   dictionary_state_ = dictionary_->Start();
@@ -218,6 +473,15 @@ void PathTrie::set_matcher(std::shared_ptr<fst::SortedMatcher<FstType>> matcher)
   matcher_ = matcher;
 }
 
+void PathTrie::set_word_ids(std::shared_ptr<const WordIdMap> word_ids) {
+  word_ids_ = word_ids;
+  word_rank_ = 0;
+}
+
+void PathTrie::set_lm_lookahead(std::shared_ptr<const std::vector<float>> scores) {
+  lm_lookahead_ = scores;
+}
+
 #ifdef DEBUG
 void PathTrie::vec(std::vector<PathTrie*>& out) {
   if (parent != nullptr) {
@@ -2,14 +2,19 @@
 #define PATH_TRIE_H
 
 #include <algorithm>
+#include <cstdint>
 #include <limits>
 #include <memory>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
 #include "fst/fstlib.h"
 #include "alphabet.h"
 #include "object_pool.h"
+#include "output.h"
+#include "snapshot.h"
+#include "word_id_map.h"
 
 /* Tree structure with parent and children information
  * It is used to store the timesteps data for the PathTrie below
@@ -65,19 +70,57 @@ public:
   PathTrie* get_prev_word(std::vector<unsigned int>& output,
                           const Alphabet& alphabet);
 
-  // update log probs
+  // update log probs, and the timing information tracked in Mode
+  template<TimingMode Mode>
   void iterate_to_vec(std::vector<PathTrie*>& output);
 
+  // get all nodes of the trie from current node, including non-existing ones
+  void get_all_nodes(std::vector<PathTrie*>& output);
+
+  // get the deepest node which is an ancestor of all the existing nodes
+  // below current node
+  PathTrie* get_common_ancestor();
+
+  // detach current node from its parent, so it can be used as a new root
+  void make_root();
+
   // set dictionary for FST
   void set_dictionary(std::shared_ptr<FstType> dictionary);
 
   void set_matcher(std::shared_ptr<fst::SortedMatcher<FstType>>);
 
+  // set language model ids of the dictionary words, after set_dictionary()
+  void set_word_ids(std::shared_ptr<const WordIdMap> word_ids);
+
+  // set language model look-ahead scores of the dictionary states, after
+  // set_dictionary(), null to stop computing lm_lookahead for new nodes
+  void set_lm_lookahead(std::shared_ptr<const std::vector<float>> scores);
+
   bool is_empty() { return ROOT_ == character; }
 
+  bool exists() const { return exists_; }
+
   // remove current path from root
   void remove();
 
+  // write this node and the ones below it in pre-order, appending them to
+  // nodes. timestep_ids gives the snapshot index of the timestep tree nodes
+  // they point to.
+  void save(SnapshotWriter& writer,
+            const std::unordered_map<const TimestepTreeNode*, uint32_t>& timestep_ids,
+            std::vector<const PathTrie*>& nodes) const;
+
+  // read nodes written by save() into this root, which has the dictionary
+  // of the saved one, appending them to nodes. timesteps is indexed by the
+  // timestep ids given to save(), lm_lookahead is given to the nodes that
+  // had look-ahead scores. Below the root, dictionary states, word ids and
+  // look-ahead scores are found again from the characters, and a character
+  // the dictionary doesn't have from its parent's state fails the load.
+  bool load(SnapshotReader& reader,
+            const std::vector<TimestepTreeNode*>& timesteps,
+            const std::shared_ptr<const std::vector<float>>& lm_lookahead,
+            std::vector<PathTrie*>& nodes);
+
 #ifdef DEBUG
   void vec(std::vector<PathTrie*>& out);
   void print(const Alphabet& a);
@@ -92,14 +135,55 @@ public:
   float approx_ctc;
   unsigned int character;
   TimestepTreeNode* timesteps = nullptr;
+  // timestep of this node's character on its own best path, only tracked
+  // with TIMING_WORDS
+  unsigned int char_timestep = 0;
+
+  // number of characters between the root and this node
+  unsigned int depth;
+  // identifier unique across all nodes ever created, used by caches that
+  // hold on to node pointers to detect freed and reallocated nodes
+  uint64_t serial;
+
+  // LM log probability of the unfinished last word of this prefix, computed
+  // lazily when decoding. It only depends on the path, so it stays valid for
+  // as long as the node exists.
+  bool partial_word_scored = false;
+  bool has_partial_word = false;
+  double partial_word_log_prob;
+
+  // Whether this node completes a word of the dictionary, and the word's
+  // language model id. Only set when the dictionary has word ids.
+  bool ends_word = false;
+  unsigned int word_id = 0;
+
+  // Language model look-ahead score of the unfinished last word: the best
+  // unigram log probability among the words it can still become, relative
+  // to the best word overall. 0 at word boundaries.
+  float lm_lookahead = 0.0;
 
   // timestep temporary storage for each decoding step. 
   TimestepTreeNode* previous_timesteps = nullptr; 
   unsigned int new_timestep;
+  // whether new_timestep is to be applied, with TIMING_WORDS
+  bool has_new_timestep = false;
 
   PathTrie* parent;
 
 private:
+  // set where child is in the dictionary, its word id and look-ahead score,
+  // when matcher_ was just positioned on the arc of its character from this
+  // node's dictionary state
+  void follow_matched_arc(PathTrie* child, bool reset) const;
+
+  // write or read the fields of this node alone that save() and load() keep
+  void save_node(SnapshotWriter& writer,
+                 const std::unordered_map<const TimestepTreeNode*, uint32_t>& timestep_ids) const;
+  bool load_node(SnapshotReader& reader,
+                 const std::vector<TimestepTreeNode*>& timesteps,
+                 const std::shared_ptr<const std::vector<float>>& lm_lookahead,
+                 uint32_t* num_children);
+
   int ROOT_;
   bool exists_;
   bool has_dictionary_;
@@ -110,6 +194,12 @@ private:
   std::shared_ptr<FstType> dictionary_;
   FstType::StateId dictionary_state_;
   std::shared_ptr<fst::SortedMatcher<FstType>> matcher_;
+
+  // rank of the word being spelled, see WordIdMap
+  std::shared_ptr<const WordIdMap> word_ids_;
+  uint32_t word_rank_ = 0;
+
+  std::shared_ptr<const std::vector<float>> lm_lookahead_;
 };
 
 // TreeNode implementation
@@ -14,7 +14,9 @@
 #endif
 
 #include "scorer.h"
+#include <algorithm>
 #include <iostream>
+#include <limits>
 #include <fstream>
 
 #include "lm/config.hh"
@@ -26,6 +28,21 @@
 
 static const int32_t MAGIC = 'TRIE';
 static const int32_t FILE_VERSION = 6;
+// Optional sections following the dictionary, ignored by older readers. Each
+// one is its magic, a number of 32 bit values, and the values.
+// 'WIDS': the KenLM id of each word of the dictionary, in the order of the
+// words' ranks
+static const int32_t WORD_IDS_MAGIC = 0x57494453;
+// 'LKAH'
+static const int32_t LOOKAHEAD_MAGIC = 0x4C4B4148;
+
+static bool write_section(std::fstream& fout, int32_t magic, const void* values, uint32_t count)
+{
+  fout.write(reinterpret_cast<const char*>(&magic), sizeof(magic));
+  fout.write(reinterpret_cast<const char*>(&count), sizeof(count));
+  fout.write(reinterpret_cast<const char*>(values), count * sizeof(uint32_t));
+  return !fout.bad();
+}
 
 int
 Scorer::init(const std::string& lm_path,
@@ -143,6 +160,37 @@ int Scorer::load_trie(std::ifstream& fin, const std::string& file_path)
   opt.mode = fst::FstReadOptions::MAP;
   opt.source = file_path;
   dictionary.reset(FstType::Read(fin, opt));
+
+  // Packages without word ids are scored from the words' strings, packages
+  // without look-ahead scores can't use look-ahead
+  word_ids.reset();
+  lm_lookahead.reset();
+  int32_t section;
+  uint32_t count;
+  while (dictionary &&
+         fin.read(reinterpret_cast<char*>(&section), sizeof(section)) &&
+         fin.read(reinterpret_cast<char*>(&count), sizeof(count))) {
+    if (section == WORD_IDS_MAGIC) {
+      std::shared_ptr<WordIdMap> map = std::make_shared<WordIdMap>();
+      map->init(*dictionary);
+      if (map->num_words() != count ||
+          !fin.read(reinterpret_cast<char*>(map->ids.data()), count * sizeof(uint32_t))) {
+        std::cerr << "Warning: Ignoring invalid word ids in scorer file." << std::endl;
+        break;
+      }
+      word_ids = map;
+    } else if (section == LOOKAHEAD_MAGIC) {
+      std::shared_ptr<std::vector<float>> scores = std::make_shared<std::vector<float>>(count);
+      if (count != dictionary->NumStates() ||
+          !fin.read(reinterpret_cast<char*>(scores->data()), count * sizeof(float))) {
+        std::cerr << "Warning: Ignoring invalid look-ahead scores in scorer file." << std::endl;
+        break;
+      }
+      lm_lookahead = scores;
+    } else {
+      fin.seekg(count * sizeof(uint32_t), std::ios::cur);
+    }
+  }
   return DS_ERR_OK;
 }
 
@@ -187,7 +235,20 @@ bool Scorer::save_dictionary(const std::string& path, bool append_instead_of_ove
   fst::FstWriteOptions opt;
   opt.align = true;
   opt.source = path;
-  return dictionary->Write(fout, opt);
+  if (!dictionary->Write(fout, opt)) {
+    return false;
+  }
+  if (word_ids &&
+      !write_section(fout, WORD_IDS_MAGIC, word_ids->ids.data(), word_ids->ids.size())) {
+    std::cerr << "Error writing word ids '" << path << "'" << std::endl;
+    return false;
+  }
+  if (lm_lookahead &&
+      !write_section(fout, LOOKAHEAD_MAGIC, lm_lookahead->data(), lm_lookahead->size())) {
+    std::cerr << "Error writing look-ahead scores '" << path << "'" << std::endl;
+    return false;
+  }
+  return true;
 }
 
 bool Scorer::is_scoring_boundary(PathTrie* prefix, size_t new_label)
@@ -198,16 +259,8 @@ bool Scorer::is_scoring_boundary(PathTrie* prefix, size_t new_label)
     }
     unsigned char first_byte;
     int distance_to_boundary = prefix->distance_to_codepoint_boundary(&first_byte, alphabet_);
-    int needed_bytes;
-    if ((first_byte >> 3) == 0x1E) {
-      needed_bytes = 4;
-    } else if ((first_byte >> 4) == 0x0E) {
-      needed_bytes = 3;
-    } else if ((first_byte >> 5) == 0x06) {
-      needed_bytes = 2;
-    } else if ((first_byte >> 7) == 0x00) {
-      needed_bytes = 1;
-    } else {
+    int needed_bytes = utf8_sequence_length(first_byte);
+    if (needed_bytes == 0) {
       assert(false); // invalid byte sequence. should be unreachable, disallowed by vocabulary/trie
       return false;
     }
@@ -261,6 +314,64 @@ double Scorer::get_log_cond_prob(const std::vector<std::string>::const_iterator&
   return cond_prob/NUM_FLT_LOGE;
 }
 
+void Scorer::get_log_cond_probs(LMQuery* queries, size_t count)
+{
+  const auto& vocab = language_model_->BaseVocabulary();
+
+  size_t max_length = 0;
+  for (size_t q = 0; q < count; ++q) {
+    LMQuery& query = queries[q];
+    if (query.bos) {
+      language_model_->BeginSentenceWrite(&query.state[0]);
+    } else {
+      language_model_->NullContextWrite(&query.state[0]);
+    }
+    query.log_prob = 0.0;
+    query.oov = false;
+    if (query.words) {
+      query.num_ids = query.words->size();
+    }
+    max_length = std::max(max_length, query.num_ids);
+  }
+
+  for (size_t pos = 0; pos < max_length; ++pos) {
+    for (size_t q = 0; q < count; ++q) {
+      LMQuery& query = queries[q];
+      if (query.oov || pos >= query.num_ids) {
+        continue;
+      }
+
+      query.word = query.words ? vocab.Index((*query.words)[pos])
+                               : query.ids[pos];
+
+      // encounter OOV
+      if (query.word == lm::kUNK) {
+        query.oov = true;
+        continue;
+      }
+
+      language_model_->BasePrefetch(&query.state[pos % 2], query.word);
+    }
+
+    for (size_t q = 0; q < count; ++q) {
+      LMQuery& query = queries[q];
+      if (query.oov || pos >= query.num_ids) {
+        continue;
+      }
+
+      query.log_prob = language_model_->BaseScore(&query.state[pos % 2],
+                                                  query.word,
+                                                  &query.state[(pos + 1) % 2]);
+    }
+  }
+
+  for (size_t q = 0; q < count; ++q) {
+    LMQuery& query = queries[q];
+    // return loge prob
+    query.log_prob = query.oov ? OOV_SCORE : query.log_prob/NUM_FLT_LOGE;
+  }
+}
+
 void Scorer::reset_params(float alpha, float beta)
 {
   this->alpha = alpha;
@@ -284,15 +395,17 @@ std::vector<std::string> Scorer::split_labels_into_scored_units(const std::vecto
 std::vector<std::string> Scorer::make_ngram(PathTrie* prefix)
 {
   std::vector<std::string> ngram;
+  ngram.reserve(max_order_);
   PathTrie* current_node = prefix;
   PathTrie* new_node = nullptr;
+  std::vector<unsigned int> prefix_vec;
 
   for (int order = 0; order < max_order_; order++) {
     if (!current_node || current_node->character == -1) {
       break;
     }
 
-    std::vector<unsigned int> prefix_vec;
+    prefix_vec.clear();
 
     if (is_utf8_mode_) {
       new_node = current_node->get_prev_grapheme(prefix_vec, alphabet_);
@@ -302,13 +415,28 @@ std::vector<std::string> Scorer::make_ngram(PathTrie* prefix)
     current_node = new_node->parent;
 
     // reconstruct word
-    std::string word = alphabet_.Decode(prefix_vec);
-    ngram.push_back(word);
+    ngram.emplace_back();
+    alphabet_.DecodeAppend(prefix_vec, ngram.back());
   }
   std::reverse(ngram.begin(), ngram.end());
   return ngram;
 }
 
+size_t Scorer::make_ngram_ids(PathTrie* word_end, lm::WordIndex* ids)
+{
+  // Same words as make_ngram(), which stops at the root too
+  size_t num_ids = 0;
+  for (PathTrie* node = word_end;
+       node && !node->is_empty() && num_ids < max_order_;
+       node = node->parent) {
+    if (node->ends_word) {
+      ids[num_ids++] = node->word_id;
+    }
+  }
+  std::reverse(ids, ids + num_ids);
+  return num_ids;
+}
+
 void Scorer::fill_dictionary(const std::unordered_set<std::string>& vocabulary)
 {
   // ConstFst is immutable, so we need to use a MutableFst to create the trie,
@@ -346,4 +474,85 @@ void Scorer::fill_dictionary(const std::unordered_set<std::string>& vocabulary)
   // Now we convert the MutableFst to a ConstFst (Scorer::FstType) via its ctor
   std::unique_ptr<FstType> converted(new FstType(*new_dict));
   this->dictionary = std::move(converted);
+
+  build_word_ids(vocabulary);
+  build_lm_lookahead(vocabulary);
+}
+
+bool Scorer::words_are_scored_units(const std::unordered_set<std::string>& vocabulary) const
+{
+  // In UTF-8 mode the language model scores codepoints, which only match
+  // the dictionary words when those are single codepoints
+  if (is_utf8_mode_) {
+    for (const auto& word : vocabulary) {
+      if (get_utf8_str_len(word) > 1) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+void Scorer::build_word_ids(const std::unordered_set<std::string>& vocabulary)
+{
+  word_ids.reset();
+  if (!language_model_ || !dictionary || !words_are_scored_units(vocabulary)) {
+    return;
+  }
+
+  std::shared_ptr<WordIdMap> map = std::make_shared<WordIdMap>();
+  map->init(*dictionary);
+  const auto& vocab = language_model_->BaseVocabulary();
+  std::vector<unsigned int> labels;
+  for (const auto& word : vocabulary) {
+    uint32_t rank;
+    if (word_to_dictionary_labels(word, char_map_, is_utf8_mode_, SPACE_ID_ + 1, &labels) &&
+        map->get_rank(*dictionary, labels, &rank)) {
+      map->ids[rank] = vocab.Index(word);
+    }
+  }
+  word_ids = map;
+}
+
+void Scorer::build_lm_lookahead(const std::unordered_set<std::string>& vocabulary)
+{
+  lm_lookahead.reset();
+  if (!language_model_ || !dictionary || dictionary->Start() == fst::kNoStateId ||
+      !words_are_scored_units(vocabulary)) {
+    return;
+  }
+
+  // Best unigram score of the words going through each state, found by
+  // walking the path of every word
+  const float none = -std::numeric_limits<float>::infinity();
+  std::shared_ptr<std::vector<float>> scores =
+    std::make_shared<std::vector<float>>(dictionary->NumStates(), none);
+  std::vector<unsigned int> labels;
+  for (const auto& word : vocabulary) {
+    if (word == START_TOKEN || word == UNK_TOKEN || word == END_TOKEN ||
+        !word_to_dictionary_labels(word, char_map_, is_utf8_mode_, SPACE_ID_ + 1, &labels)) {
+      continue;
+    }
+    float score = get_log_cond_prob({word});
+    FstType::StateId state = dictionary->Start();
+    (*scores)[state] = std::max((*scores)[state], score);
+    for (unsigned int label : labels) {
+      fst::ArcIterator<FstType> aiter(*dictionary, state);
+      while (!aiter.Done() && aiter.Value().ilabel != label) {
+        aiter.Next();
+      }
+      if (aiter.Done()) {
+        break;
+      }
+      state = aiter.Value().nextstate;
+      (*scores)[state] = std::max((*scores)[state], score);
+    }
+  }
+
+  // Store them relative to the best word overall, so the start state is 0
+  const float best = (*scores)[dictionary->Start()];
+  for (float& score : *scores) {
+    score = (score == none) ? 0.0f : score - best;
+  }
+  lm_lookahead = scores;
 }
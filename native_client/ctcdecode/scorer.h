@@ -7,11 +7,13 @@
 #include <unordered_set>
 #include <vector>
 
+#include "lm/state.hh"
 #include "lm/virtual_interface.hh"
 #include "lm/word_index.hh"
 #include "util/string_piece.hh"
 
 #include "path_trie.h"
+#include "word_id_map.h"
 #include "alphabet.h"
 #include "deepspeech.h"
 
@@ -20,6 +22,24 @@ const std::string START_TOKEN = "<s>";
 const std::string UNK_TOKEN = "<unk>";
 const std::string END_TOKEN = "</s>";
 
+/* One query of Scorer::get_log_cond_probs(). The caller fills bos and either
+ * words or, when words is null, the language model ids of the words, the rest
+ * is the scorer's working state and result.
+ */
+struct LMQuery {
+  const std::vector<std::string>* words;
+  const lm::WordIndex* ids;
+  size_t num_ids;
+  bool bos;
+
+  // Conditional log probability of the last word, as get_log_cond_prob()
+  double log_prob;
+
+  bool oov;
+  lm::WordIndex word;
+  lm::ngram::State state[2];
+};
+
 /* External scorer to query score for n-gram or sentence, including language
  * model scoring and word insertion.
  *
@@ -53,6 +73,12 @@ public:
                            bool bos = false,
                            bool eos = false);
 
+  // Score several n-grams, like get_log_cond_prob() on each of them. The
+  // queries advance one word at a time in lockstep: the memory each lookup
+  // needs is prefetched for every query before any of them is scored, so the
+  // cache misses of different queries overlap.
+  void get_log_cond_probs(LMQuery* queries, size_t count);
+
   // return the max order
   size_t get_max_order() const { return max_order_; }
 
@@ -68,6 +94,11 @@ public:
   // make ngram for a given prefix
   std::vector<std::string> make_ngram(PathTrie *prefix);
 
+  // Store the language model ids of the up to max order words ending at
+  // word_end in ids, from the word ids of the trie nodes, and return their
+  // number. Requires word_ids.
+  size_t make_ngram_ids(PathTrie *word_end, lm::WordIndex *ids);
+
   // trransform the labels in index to the vector of words (word based lm) or
   // the vector of characters (character based lm)
   std::vector<std::string> split_labels_into_scored_units(const std::vector<unsigned int> &labels);
@@ -94,12 +125,29 @@ public:
   // pointer to the dictionary of FST
   std::unique_ptr<FstType> dictionary;
 
+  // language model ids of the dictionary words, null if the package has none
+  std::shared_ptr<WordIdMap> word_ids;
+
+  // language model look-ahead score of each dictionary state: the best
+  // unigram log probability of the words going through it, minus the best
+  // one overall. Null if the package has none.
+  std::shared_ptr<std::vector<float>> lm_lookahead;
+
 protected:
   // necessary setup after setting alphabet
   void setup_char_map();
 
   int load_trie(std::ifstream& fin, const std::string& file_path);
 
+  // whether the language model scores the words of vocabulary as a whole
+  bool words_are_scored_units(const std::unordered_set<std::string> &vocabulary) const;
+
+  // fill word_ids from the vocabulary the dictionary was built from
+  void build_word_ids(const std::unordered_set<std::string> &vocabulary);
+
+  // fill lm_lookahead from the vocabulary the dictionary was built from
+  void build_lm_lookahead(const std::unordered_set<std::string> &vocabulary);
+
 private:
   std::unique_ptr<lm::base::Model> language_model_;
   bool is_utf8_mode_ = true;
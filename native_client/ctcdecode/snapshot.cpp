@@ -0,0 +1,24 @@
+#include "snapshot.h"
+
+void
+SnapshotWriter::put_output(const Output& output)
+{
+  put(output.confidence);
+  put_vector(output.tokens);
+  put_vector(output.timesteps);
+}
+
+bool
+SnapshotReader::get_output(Output& output)
+{
+  output = Output();
+  if (!get(output.confidence) ||
+      !get_vector(output.tokens) ||
+      !get_vector(output.timesteps)) {
+    return false;
+  }
+  if (output.tokens.size() != output.timesteps.size()) {
+    return fail();
+  }
+  return true;
+}
@@ -0,0 +1,103 @@
+#ifndef SNAPSHOT_H_
+#define SNAPSHOT_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "output.h"
+
+/* Binary encoding of stream and decoder snapshots, see DecoderState::save().
+ * Values are written in native byte order and size: a snapshot moves a
+ * stream between processes running the same build, it is not an archival
+ * format.
+ *
+ * The reader checks every read against the end of the buffer. A read past
+ * it, or a value the caller rejects with fail(), marks the reader as failed
+ * and all later reads fail too, so callers can check failed() once at the
+ * end of a sequence of reads.
+ */
+class SnapshotWriter {
+public:
+  template<typename T>
+  void put(T value) {
+    static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value,
+                  "only numbers are written as is");
+    data_.append(reinterpret_cast<const char*>(&value), sizeof(T));
+  }
+
+  // Write the size of a vector, then its elements.
+  template<typename T>
+  void put_vector(const std::vector<T>& values) {
+    static_assert(std::is_arithmetic<T>::value, "only numbers are written as is");
+    put<uint32_t>(values.size());
+    if (!values.empty()) {
+      data_.append(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+    }
+  }
+
+  // Write the confidence, tokens and timesteps of an output, not its words.
+  void put_output(const Output& output);
+
+  const std::string& data() const { return data_; }
+
+private:
+  std::string data_;
+};
+
+class SnapshotReader {
+public:
+  SnapshotReader(const char* data, size_t size)
+    : data_(data), size_(size), pos_(0), failed_(false) {}
+
+  template<typename T>
+  bool get(T& value) {
+    static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value,
+                  "only numbers are read as is");
+    if (failed_ || size_ - pos_ < sizeof(T)) {
+      return fail();
+    }
+    memcpy(&value, data_ + pos_, sizeof(T));
+    pos_ += sizeof(T);
+    return true;
+  }
+
+  template<typename T>
+  bool get_vector(std::vector<T>& values) {
+    static_assert(std::is_arithmetic<T>::value, "only numbers are read as is");
+    uint32_t count;
+    if (!get(count) || (size_ - pos_) / sizeof(T) < count) {
+      return fail();
+    }
+    values.resize(count);
+    if (count > 0) {
+      memcpy(values.data(), data_ + pos_, count * sizeof(T));
+    }
+    pos_ += count * sizeof(T);
+    return true;
+  }
+
+  bool get_output(Output& output);
+
+  // Mark the snapshot as invalid, returns false.
+  bool fail() {
+    failed_ = true;
+    return false;
+  }
+
+  bool failed() const { return failed_; }
+
+  // Whether all of the snapshot was read successfully.
+  bool done() const { return !failed_ && pos_ == size_; }
+
+private:
+  const char* data_;
+  size_t size_;
+  size_t pos_;
+  bool failed_;
+};
+
+#endif  // SNAPSHOT_H_
@@ -0,0 +1,299 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "alphabet.h"
+#include "ctc_beam_search_decoder.h"
+#include "scorer.h"
+
+#include "lm/model.hh"
+
+/* Round trip of DecoderState::save() and load(): a state
+ * restored from a snapshot taken partway through random input must decode
+ * the rest of it exactly like the state it was saved from, and snapshots
+ * that are truncated, corrupted or taken with another alphabet or beam size
+ * must be rejected without crashing. Both are also done with a scorer,
+ * whose dictionary states, word ids and look-ahead scores a corrupted
+ * snapshot must not be able to point outside of.
+ */
+
+namespace {
+
+int failures = 0;
+
+void
+expect(bool condition, const char* what)
+{
+  if (!condition && ++failures <= 10) {
+    fprintf(stderr, "check failed: %s\n", what);
+  }
+}
+
+// Alphabet of a space, the lowercase letters and an apostrophe, in the
+// serialization format of util/text.py
+Alphabet
+make_alphabet(const std::string& labels)
+{
+  std::string buffer;
+  auto put_u16 = [&buffer](uint16_t value) {
+    buffer.append(reinterpret_cast<const char*>(&value), sizeof(value));
+  };
+  put_u16(labels.size());
+  for (size_t i = 0; i < labels.size(); ++i) {
+    put_u16(i);
+    put_u16(1);
+    buffer.push_back(labels[i]);
+  }
+  Alphabet alphabet;
+  alphabet.Deserialize(buffer.data(), buffer.size());
+  return alphabet;
+}
+
+// Scorer with a bigram language model of a few words, with word ids and
+// look-ahead scores, built in a temporary file
+std::shared_ptr<Scorer>
+make_scorer(const Alphabet& alphabet)
+{
+  const char* dir = getenv("TEST_TMPDIR");
+  const std::string arpa_path = std::string(dir ? dir : "/tmp") + "/snapshot_test.arpa";
+  const std::string lm_path = std::string(dir ? dir : "/tmp") + "/snapshot_test.binary";
+  const std::vector<std::string> words = {
+    "a", "at", "be", "bee", "cat", "dog", "go", "god", "it", "the", "to", "tea",
+  };
+  {
+    std::ofstream arpa(arpa_path);
+    arpa << "\\data\\\n"
+         << "ngram 1=" << words.size() + 3 << "\n"
+         << "ngram 2=" << words.size() << "\n\n"
+         << "\\1-grams:\n"
+         << "-3\t<unk>\t0\n-99\t<s>\t0\n-1\t</s>\t0\n";
+    for (size_t i = 0; i < words.size(); ++i) {
+      arpa << -1.0 - 0.1 * i << "\t" << words[i] << "\t0\n";
+    }
+    arpa << "\n\\2-grams:\n";
+    for (size_t i = 0; i < words.size(); ++i) {
+      arpa << "-0.2\t" << words[i] << " " << words[(i * 5 + 1) % words.size()] << "\n";
+    }
+    arpa << "\n\\end\\\n";
+  }
+  {
+    // Scorer packages don't store the vocabulary of the model, the dictionary
+    // follows it instead
+    lm::ngram::Config config;
+    config.write_mmap = lm_path.c_str();
+    config.include_vocab = false;
+    config.messages = nullptr;
+    lm::ngram::ProbingModel model(arpa_path.c_str(), config);
+  }
+
+  std::shared_ptr<Scorer> scorer(new Scorer());
+  scorer->set_alphabet(alphabet);
+  scorer->set_utf8_mode(false);
+  scorer->reset_params(0.9, 1.2);
+  if (scorer->load_lm(lm_path) != DS_ERR_SCORER_NO_TRIE) {
+    return nullptr;
+  }
+  scorer->fill_dictionary(std::unordered_set<std::string>(words.begin(), words.end()));
+  remove(arpa_path.c_str());
+  remove(lm_path.c_str());
+  return scorer;
+}
+
+// Peaky softmax outputs, mostly blank, as an acoustic model gives
+std::vector<float>
+make_probs(size_t num_steps, size_t class_dim, unsigned int seed)
+{
+  std::mt19937 rng(seed);
+  std::normal_distribution<float> logits(0.f, 2.5f);
+  std::vector<float> probs(num_steps * class_dim);
+  for (size_t t = 0; t < num_steps; ++t) {
+    float* row = &probs[t * class_dim];
+    float sum = 0.f;
+    for (size_t c = 0; c < class_dim; ++c) {
+      row[c] = std::exp(logits(rng) + (c == class_dim - 1 ? 3.f : 0.f));
+      sum += row[c];
+    }
+    for (size_t c = 0; c < class_dim; ++c) {
+      row[c] /= sum;
+    }
+  }
+  return probs;
+}
+
+bool
+same_outputs(const std::vector<Output>& a, const std::vector<Output>& b)
+{
+  if (a.size() != b.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < a.size(); ++i) {
+    if (a[i].confidence != b[i].confidence || a[i].tokens != b[i].tokens ||
+        a[i].timesteps != b[i].timesteps) {
+      return false;
+    }
+  }
+  return true;
+}
+
+typedef void (*configure_fn)(DecoderState& state);
+
+void
+check_round_trip(const Alphabet& alphabet,
+                 std::shared_ptr<Scorer> scorer,
+                 const char* name,
+                 configure_fn configure)
+{
+  const size_t class_dim = alphabet.GetSize() + 1;
+  const size_t num_steps = 120;
+  const size_t split = 70;
+  const std::vector<float> probs = make_probs(num_steps, class_dim, 3);
+  const std::unordered_map<std::string, float> no_hot_words;
+
+  DecoderState saved;
+  saved.init(alphabet, 16, 1.0, 20, scorer, no_hot_words);
+  configure(saved);
+  saved.next(probs.data(), split, class_dim, class_dim);
+
+  SnapshotWriter writer;
+  saved.save(writer);
+  const std::string snapshot = writer.data();
+
+  DecoderState restored;
+  restored.init(alphabet, 16, 1.0, 20, scorer, no_hot_words);
+  SnapshotReader reader(snapshot.data(), snapshot.size());
+  if (!restored.load(reader) || !reader.done()) {
+    ++failures;
+    fprintf(stderr, "%s: could not load the snapshot\n", name);
+    return;
+  }
+
+  SnapshotWriter again;
+  restored.save(again);
+  if (again.data() != snapshot) {
+    ++failures;
+    fprintf(stderr, "%s: saving the restored state gives another snapshot\n", name);
+  }
+
+  if (!same_outputs(saved.decode(4), restored.decode(4))) {
+    ++failures;
+    fprintf(stderr, "%s: restored state decodes differently\n", name);
+  }
+  saved.next(&probs[split * class_dim], num_steps - split, class_dim, class_dim);
+  restored.next(&probs[split * class_dim], num_steps - split, class_dim, class_dim);
+  if (!same_outputs(saved.decode(4), restored.decode(4))) {
+    ++failures;
+    fprintf(stderr, "%s: restored state decodes later input differently\n", name);
+  }
+  if (!same_outputs({saved.take_committed()}, {restored.take_committed()})) {
+    ++failures;
+    fprintf(stderr, "%s: restored state commits differently\n", name);
+  }
+}
+
+void
+check_invalid(const Alphabet& alphabet,
+              const Alphabet& other_alphabet,
+              std::shared_ptr<Scorer> scorer,
+              configure_fn configure)
+{
+  const size_t class_dim = alphabet.GetSize() + 1;
+  const std::vector<float> probs = make_probs(50, class_dim, 4);
+  const std::unordered_map<std::string, float> no_hot_words;
+
+  DecoderState saved;
+  saved.init(alphabet, 16, 1.0, 20, scorer, no_hot_words);
+  configure(saved);
+  saved.next(probs.data(), 50, class_dim, class_dim);
+  SnapshotWriter writer;
+  saved.save(writer);
+  const std::string snapshot = writer.data();
+
+  DecoderState state;
+  for (size_t size = 0; size < snapshot.size(); ++size) {
+    state.init(alphabet, 16, 1.0, 20, scorer, no_hot_words);
+    SnapshotReader reader(snapshot.data(), size);
+    expect(!state.load(reader) || !reader.done(), "truncated snapshot rejected");
+  }
+
+  // Whatever a corrupted snapshot loads as, decoding must go on safely
+  std::mt19937 rng(5);
+  for (int i = 0; i < 2000; ++i) {
+    std::string corrupted = snapshot;
+    for (int j = 0; j < 4; ++j) {
+      corrupted[rng() % corrupted.size()] ^= 1 << (rng() % 8);
+    }
+    state.init(alphabet, 16, 1.0, 20, scorer, no_hot_words);
+    configure(state);
+    SnapshotReader reader(corrupted.data(), corrupted.size());
+    if (state.load(reader)) {
+      state.next(probs.data(), 10, class_dim, class_dim);
+      state.decode(4);
+    }
+  }
+
+  state.init(other_alphabet, 16, 1.0, 20, nullptr, no_hot_words);
+  SnapshotReader reader(snapshot.data(), snapshot.size());
+  expect(!state.load(reader) && !reader.failed(), "other alphabet reported as a mismatch");
+
+  state.init(alphabet, 8, 1.0, 20, scorer, no_hot_words);
+  SnapshotReader other_beam_reader(snapshot.data(), snapshot.size());
+  expect(!state.load(other_beam_reader) && !other_beam_reader.failed(),
+         "other beam size reported as a mismatch");
+}
+
+}  // namespace
+
+int
+main()
+{
+  const Alphabet alphabet = make_alphabet(" abcdefghijklmnopqrstuvwxyz'");
+  const Alphabet other_alphabet = make_alphabet(" abc");
+
+  std::shared_ptr<Scorer> scorer = make_scorer(alphabet);
+  if (!scorer) {
+    fprintf(stderr, "could not build the language model\n");
+    return 1;
+  }
+  const configure_fn defaults = [](DecoderState&) {};
+  const configure_fn lookahead = [](DecoderState& state) {
+    state.set_lm_lookahead(true);
+  };
+
+  check_round_trip(alphabet, nullptr, "default", defaults);
+  check_round_trip(alphabet, nullptr, "committed", [](DecoderState& state) {
+    state.set_prefix_commitment(true);
+  });
+  check_round_trip(alphabet, nullptr, "word timing", [](DecoderState& state) {
+    state.set_timing_mode(TIMING_WORDS);
+  });
+  check_round_trip(alphabet, nullptr, "pruned", [](DecoderState& state) {
+    state.set_beam_threshold(8.f);
+    state.set_adaptive_beam(0.999f, 2);
+    state.set_blank_skip_threshold(0.999);
+  });
+  check_round_trip(alphabet, nullptr, "greedy", [](DecoderState& state) {
+    state.set_greedy(true);
+  });
+  check_round_trip(alphabet, scorer, "scorer", defaults);
+  check_round_trip(alphabet, scorer, "look-ahead", lookahead);
+  check_round_trip(alphabet, scorer, "committed look-ahead", [](DecoderState& state) {
+    state.set_lm_lookahead(true);
+    state.set_prefix_commitment(true);
+  });
+  check_invalid(alphabet, other_alphabet, nullptr, defaults);
+  check_invalid(alphabet, other_alphabet, scorer, lookahead);
+
+  if (failures > 0) {
+    fprintf(stderr, "%d checks failed\n", failures);
+    return 1;
+  }
+  printf("Decoder snapshots round trip\n");
+  return 0;
+}
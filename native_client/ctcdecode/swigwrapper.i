@@ -21,6 +21,7 @@ import_array();
 namespace std {
     %template(StringVector) vector<string>;
     %template(UnsignedIntVector) vector<unsigned int>;
+    %template(WordOutputVector) vector<WordOutput>;
     %template(OutputVector) vector<Output>;
     %template(OutputVectorVector) vector<vector<Output>>;
     %template(Map) unordered_map<string, float>;
@@ -34,7 +35,81 @@ namespace std {
 %apply (int* IN_ARRAY1, int DIM1) {(const int *seq_lengths, int seq_lengths_size)};
 %apply (unsigned int* IN_ARRAY1, int DIM1) {(const unsigned int *input, int length)};
 
+// Hand float32 NumPy arrays to decode_batch_flat() as they are: any strides
+// are accepted as long as the classes of a timestep are contiguous, so
+// transposed or sliced arrays are not copied either.
+%typemap(in, fragment="NumPy_Fragments")
+  (const float* probs, int batch_size, int time_dim, int class_dim, ptrdiff_t batch_stride, ptrdiff_t time_stride)
+{
+  if (!is_array($input) || array_type($input) != NPY_FLOAT || array_numdims($input) != 3) {
+    PyErr_SetString(PyExc_TypeError, "probs must be a 3-D float32 array");
+    SWIG_fail;
+  }
+  if (!array_is_native($input) || !PyArray_ISALIGNED((PyArrayObject*)$input) ||
+      array_stride($input, 2) != sizeof(float) ||
+      array_stride($input, 0) % sizeof(float) != 0 ||
+      array_stride($input, 1) % sizeof(float) != 0) {
+    PyErr_SetString(PyExc_ValueError, "probs must be aligned, in native byte order and contiguous along the class dimension");
+    SWIG_fail;
+  }
+  $1 = (const float*) array_data($input);
+  $2 = (int) array_size($input, 0);
+  $3 = (int) array_size($input, 1);
+  $4 = (int) array_size($input, 2);
+  $5 = (ptrdiff_t) (array_stride($input, 0) / (npy_intp)sizeof(float));
+  $6 = (ptrdiff_t) (array_stride($input, 1) / (npy_intp)sizeof(float));
+}
+
+// Batch decoding only reads its arguments, let other Python threads run
+// meanwhile
+%exception DecoderPool::decode_batch {
+  Py_BEGIN_ALLOW_THREADS
+  $action
+  Py_END_ALLOW_THREADS
+}
+%exception DecoderPool::decode_batch_flat {
+  Py_BEGIN_ALLOW_THREADS
+  $action
+  Py_END_ALLOW_THREADS
+}
+
+// Return the BatchOutput arrays as NumPy arrays rather than tuples
+%fragment("BatchOutput_Arrays", "header", fragment="NumPy_Fragments") %{
+template<typename T>
+static PyObject* vector_to_array(const std::vector<T>& vec, int typenum)
+{
+  npy_intp dims[1] = {(npy_intp)vec.size()};
+  PyObject* array = PyArray_SimpleNew(1, dims, typenum);
+  if (array && !vec.empty()) {
+    memcpy(array_data(array), vec.data(), vec.size()*sizeof(T));
+  }
+  return array;
+}
+%}
+%fragment("BatchOutput_Arrays");
+
+%ignore BatchOutput::confidences;
+%ignore BatchOutput::offsets;
+%ignore BatchOutput::tokens;
+%ignore BatchOutput::timesteps;
+%extend BatchOutput {
+  PyObject* confidences_array() const { return vector_to_array($self->confidences, NPY_DOUBLE); }
+  PyObject* offsets_array() const { return vector_to_array($self->offsets, NPY_UINT32); }
+  PyObject* tokens_array() const { return vector_to_array($self->tokens, NPY_UINT32); }
+  PyObject* timesteps_array() const { return vector_to_array($self->timesteps, NPY_UINT32); }
+}
+
+%ignore DecoderState::next(const float*, int, int, ptrdiff_t);
+%ignore DecoderState::set_stats;
+%ignore DecoderState::save;
+%ignore DecoderState::load;
+
 %ignore Scorer::dictionary;
+%ignore Scorer::get_log_cond_probs;
+%ignore Scorer::make_ngram_ids;
+%ignore Scorer::word_ids;
+%ignore Scorer::lm_lookahead;
+%ignore LMQuery;
 
 %include "../alphabet.h"
 %include "output.h"
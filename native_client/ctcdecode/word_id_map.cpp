@@ -0,0 +1,105 @@
+#include "word_id_map.h"
+
+// Word count of the states that can't be reached from the start state
+static const uint32_t UNREACHABLE = (uint32_t)-1;
+
+void
+WordIdMap::init(const FstType& dictionary)
+{
+  const StateId num_states = dictionary.NumStates();
+  first_arcs_.assign(num_states + 1, 0);
+  for (StateId s = 0; s < num_states; ++s) {
+    first_arcs_[s + 1] = first_arcs_[s] + dictionary.NumArcs(s);
+  }
+  arc_offsets_.assign(first_arcs_[num_states], 0);
+  words_from_.assign(num_states, UNREACHABLE);
+  num_words_ = 0;
+  ids.clear();
+
+  const StateId start = dictionary.Start();
+  if (start == fst::kNoStateId) {
+    return;
+  }
+
+  // Number of words accepted from each state, computed in post-order. The
+  // dictionary is acyclic, so a state is done once all its successors are,
+  // and states it doesn't reach keep no count.
+  const auto zero = fst::TropicalWeight::Zero();
+  std::vector<uint32_t>& counts = words_from_;
+  std::vector<bool> done(num_states, false);
+  std::vector<StateId> stack(1, start);
+  while (!stack.empty()) {
+    StateId s = stack.back();
+    if (done[s]) {
+      stack.pop_back();
+      continue;
+    }
+
+    bool ready = true;
+    for (fst::ArcIterator<FstType> aiter(dictionary, s); !aiter.Done(); aiter.Next()) {
+      StateId next = aiter.Value().nextstate;
+      if (!done[next]) {
+        stack.push_back(next);
+        ready = false;
+      }
+    }
+    if (!ready) {
+      continue;
+    }
+
+    uint32_t count = dictionary.Final(s) != zero ? 1 : 0;
+    size_t arc = first_arcs_[s];
+    for (fst::ArcIterator<FstType> aiter(dictionary, s); !aiter.Done(); aiter.Next()) {
+      arc_offsets_[arc++] = count;
+      count += counts[aiter.Value().nextstate];
+    }
+    counts[s] = count;
+    done[s] = true;
+    stack.pop_back();
+  }
+
+  num_words_ = counts[start];
+  ids.assign(num_words_, 0);
+}
+
+bool
+WordIdMap::valid_rank(StateId state, uint32_t rank) const
+{
+  if (state < 0 || (size_t)state >= words_from_.size() ||
+      words_from_[state] == UNREACHABLE) {
+    return false;
+  }
+  return (uint64_t)rank + words_from_[state] <= num_words_;
+}
+
+bool
+WordIdMap::get_rank(const FstType& dictionary,
+                    const std::vector<unsigned int>& labels,
+                    uint32_t* rank) const
+{
+  StateId state = dictionary.Start();
+  if (state == fst::kNoStateId) {
+    return false;
+  }
+
+  uint32_t sum = 0;
+  for (unsigned int label : labels) {
+    fst::ArcIterator<FstType> aiter(dictionary, state);
+    for (; !aiter.Done(); aiter.Next()) {
+      if (aiter.Value().ilabel == label) {
+        break;
+      }
+    }
+    if (aiter.Done()) {
+      return false;
+    }
+    sum += arc_offset(state, aiter.Position());
+    state = aiter.Value().nextstate;
+  }
+
+  if (dictionary.Final(state) == fst::TropicalWeight::Zero()) {
+    return false;
+  }
+  *rank = sum;
+  return true;
+}
@@ -0,0 +1,64 @@
+#ifndef WORD_ID_MAP_H_
+#define WORD_ID_MAP_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "fst/fstlib.h"
+
+/* Language model ids of the words of a dictionary FST, found while walking
+ * the FST instead of from the words' strings.
+ *
+ * The dictionary is deterministic and acyclic, so its words can be numbered
+ * in the order of a depth first walk. The rank of a word is then the sum,
+ * over the arcs of its path, of an offset stored for each arc: the number of
+ * words that end at the arc's source state or go through an earlier arc of
+ * that state. Offsets are computed from the FST when it is loaded, the scorer
+ * package only stores the language model id of each rank.
+ */
+class WordIdMap {
+public:
+  using FstType = fst::ConstFst<fst::StdArc>;
+  using StateId = FstType::StateId;
+
+  // Compute the arc offsets of dictionary, and size ids for its words.
+  void init(const FstType& dictionary);
+
+  // Number of words accepted by the dictionary
+  size_t num_words() const { return num_words_; }
+
+  // Rank offset of the arc at position pos among the arcs of state
+  uint32_t arc_offset(StateId state, size_t pos) const
+  {
+    return arc_offsets_[first_arcs_[state] + pos];
+  }
+
+  // Whether a path reaching state with the given rank offset only leads to
+  // ranks of ids, as it does when state is reached from the start state
+  bool valid_rank(StateId state, uint32_t rank) const;
+
+  /* Get the rank of a word from the labels of its path.
+   *
+   * Return:
+   *     Whether the dictionary accepts the word, in which case its rank is
+   *     stored in rank.
+  */
+  bool get_rank(const FstType& dictionary,
+                const std::vector<unsigned int>& labels,
+                uint32_t* rank) const;
+
+  // Language model id of each word, by rank
+  std::vector<uint32_t> ids;
+
+private:
+  // Index in arc_offsets_ of the first arc of each state
+  std::vector<size_t> first_arcs_;
+  std::vector<uint32_t> arc_offsets_;
+  // Number of words accepted from each state, for the states reachable from
+  // the start state
+  std::vector<uint32_t> words_from_;
+  size_t num_words_ = 0;
+};
+
+#endif  // WORD_ID_MAP_H_
@@ -3,8 +3,11 @@
   #define _USE_MATH_DEFINES
 #endif
 #include <cmath>
+#include <deque>
 #include <iostream>
 #include <memory>
+#include <mutex>
+#include <sstream>
 #include <string>
 #include <utility>
 #include <vector>
@@ -12,6 +15,8 @@
 #include "deepspeech.h"
 #include "alphabet.h"
 #include "modelstate.h"
+#include "resampler.h"
+#include "stats.h"
 
 #include "workspace_status.h"
 
@@ -62,6 +67,46 @@ using std::vector;
 
    When finishStream() is called, we return the corresponding transcript from
    the current decoder state.
+
+   With endpointing enabled, every batch is followed by a check for a long
+   enough run of blank timesteps (and, optionally, of quiet audio windows).
+   When one is found the current transcript is queued as a finished segment,
+   and the decoder and LSTM states are reset in place so the next utterance
+   starts from scratch without reallocating any of the buffers above.
+
+   With silence skipping enabled, we also keep track of how many of the latest
+   feature frames came from digital silence (all-zero audio windows, or the
+   zero padding). A timestep whose whole context window is silent is marked as
+   such, and a batch made only of silent timesteps is not run through the
+   acoustic model: the decoder is advanced by the same number of blank
+   timesteps instead, and the LSTM state is left untouched.
+
+   Audio given to DS_FeedAudioContentEx() is converted to mono float samples
+   straight into the resampler's input buffer when its rate differs from the
+   model's, or into a scratch buffer otherwise, and then goes through the same
+   path as 16-bit samples. The resampler keeps its filter history between
+   calls and is flushed when the stream is finished.
+
+   Every stream times its stages and counts its audio samples and timesteps
+   in its own StatsCollector, which the decoder also records LM queries and
+   FST lookups into. Only the thread feeding the stream writes to it, so no
+   synchronization is needed beyond relaxed atomics, and it is merged into
+   the model's collector when the stream is freed. Building with
+   DS_DISABLE_STATS removes the instrumentation.
+
+   Freed streams can be kept in a pool on the ModelState they were created
+   from. DS_CreateStream() then reinitializes a pooled stream with init(),
+   which clears the buffers and the decoder state but keeps their allocations,
+   including the decoder's copy of the scorer dictionary. The decoder's
+   timestep tree comes from a pool owned by the thread that decoded, so
+   DS_FreeStream() frees it before pooling the stream: the stream can then be
+   reused or destroyed on any thread, after that one exited.
+
+   A stream can be saved to a binary snapshot with save() and restored into a
+   freshly initialized stream of a model loaded from the same files, possibly
+   in another process, with restore(). The snapshot holds the buffers and
+   LSTM state above along with the decoder state, so no audio is processed
+   again.
 */
 struct StreamingState {
   vector<float> audio_buffer_;
@@ -73,24 +118,70 @@ struct StreamingState {
   ModelState* model_;
   DecoderState decoder_state_;
 
+  bool endpointing_;
+  unsigned int endpoint_frames_;
+  float energy_threshold_;
+  unsigned int quiet_windows_;
+  std::deque<Output> segments_;
+  // Set by finalizeStream(), the last utterance is never an endpoint
+  bool finalizing_;
+
+  bool skip_silence_;
+  unsigned int silent_frames_;
+  unsigned int silent_steps_in_batch_;
+
+  Resampler resampler_;
+  vector<float> converted_;
+
+  // Written by result methods too, which are const
+  mutable StatsCollector stats_;
+
   StreamingState();
   ~StreamingState();
 
+  void init(ModelState* model);
+
   void feedAudioContent(const short* buffer, unsigned int buffer_size);
+  int feedAudioContentEx(const void* buffer, unsigned int num_frames,
+                         unsigned int sample_rate, unsigned int channels,
+                         int format);
+  template<typename T>
+  void pushAudio(const T* buffer, unsigned int buffer_size);
   char* intermediateDecode() const;
   Metadata* intermediateDecodeWithMetadata(unsigned int num_results) const;
+  WordMetadataList* intermediateDecodeWithWords(unsigned int num_results) const;
   void finalizeStream();
   char* finishStream();
   Metadata* finishStreamWithMetadata(unsigned int num_results);
+  WordMetadataList* finishStreamWithWords(unsigned int num_results);
+  char* takeCommitted();
+  Metadata* takeCommittedWithMetadata();
+  void enableEndpointing(unsigned int min_silence_ms, float energy_threshold_db);
+  char* takeSegment();
+  Metadata* takeSegmentWithMetadata();
+  void enableFrameSkipping(float blank_threshold, bool skip_silence);
 
   void processAudioWindow(const vector<float>& buf);
   void processMfccWindow(const vector<float>& buf);
   void pushMfccBuffer(const vector<float>& buf);
   void addZeroMfccWindow();
   void processBatch(const vector<float>& buf, unsigned int n_steps);
+  void checkEndpoint();
+  void resetUtterance();
+
+  void save(SnapshotWriter& writer) const;
+  int restore(const char* data, unsigned int size);
 };
 
 StreamingState::StreamingState()
+  : endpointing_(false)
+  , endpoint_frames_(0)
+  , energy_threshold_(0.f)
+  , quiet_windows_(0)
+  , finalizing_(false)
+  , skip_silence_(false)
+  , silent_frames_(0)
+  , silent_steps_in_batch_(0)
 {
 }
 
@@ -98,6 +189,49 @@ StreamingState::~StreamingState()
 {
 }
 
+void
+StreamingState::init(ModelState* model)
+{
+  model_ = model;
+
+  audio_buffer_.clear();
+  audio_buffer_.reserve(model->audio_win_len_);
+  mfcc_buffer_.clear();
+  mfcc_buffer_.reserve(model->mfcc_feats_per_timestep_);
+  mfcc_buffer_.resize(model->n_features_*model->n_context_, 0.f);
+  batch_buffer_.clear();
+  batch_buffer_.reserve(model->n_steps_ * model->mfcc_feats_per_timestep_);
+  previous_state_c_.assign(model->state_size_, 0.f);
+  previous_state_h_.assign(model->state_size_, 0.f);
+
+  endpointing_ = false;
+  endpoint_frames_ = 0;
+  energy_threshold_ = 0.f;
+  quiet_windows_ = 0;
+  segments_.clear();
+  finalizing_ = false;
+
+  skip_silence_ = false;
+  silent_frames_ = 0;
+  silent_steps_in_batch_ = 0;
+
+  resampler_.reset();
+
+  stats_.clear();
+  DS_STATS_ADD(&stats_, STATS_COUNTER_STREAMS, 1);
+
+  const int cutoff_top_n = 40;
+  const double cutoff_prob = 1.0;
+
+  decoder_state_.init(model->alphabet_,
+                      model->beam_width_,
+                      cutoff_prob,
+                      cutoff_top_n,
+                      model->scorer_,
+                      model->hot_words_);
+  decoder_state_.set_stats(&stats_);
+}
+
 template<typename T>
 void
 shift_buffer_left(vector<T>& buf, int shift_amount)
@@ -106,16 +240,110 @@ shift_buffer_left(vector<T>& buf, int shift_amount)
   buf.resize(buf.size() - shift_amount);
 }
 
+static inline float
+sample_to_float(short sample)
+{
+  // Convert i16 sample into f32
+  return (float)sample * (1.0f / (1 << 15));
+}
+
+static inline float
+sample_to_float(float sample)
+{
+  return sample;
+}
+
+// Append num_frames frames of interleaved samples to out, averaging channels
+template<typename T>
+static void
+append_mono(const T* buffer, unsigned int num_frames, unsigned int channels,
+            vector<float>& out)
+{
+  const size_t offset = out.size();
+  out.resize(offset + num_frames);
+  float* dst = out.data() + offset;
+  if (channels == 1) {
+    for (unsigned int i = 0; i < num_frames; ++i) {
+      dst[i] = sample_to_float(buffer[i]);
+    }
+    return;
+  }
+  const float scale = 1.0f / channels;
+  for (unsigned int i = 0; i < num_frames; ++i) {
+    float sum = 0.f;
+    for (unsigned int c = 0; c < channels; ++c) {
+      sum += sample_to_float(buffer[i*channels + c]);
+    }
+    dst[i] = sum * scale;
+  }
+}
+
 void
 StreamingState::feedAudioContent(const short* buffer,
                                  unsigned int buffer_size)
 {
+  pushAudio(buffer, buffer_size);
+}
+
+int
+StreamingState::feedAudioContentEx(const void* buffer,
+                                   unsigned int num_frames,
+                                   unsigned int sample_rate,
+                                   unsigned int channels,
+                                   int format)
+{
+  if (sample_rate == 0 || channels == 0 ||
+      (format != DS_SAMPLE_FORMAT_S16 && format != DS_SAMPLE_FORMAT_F32)) {
+    return DS_ERR_INVALID_AUDIO_FORMAT;
+  }
+  if (!Resampler::supports(sample_rate, model_->sample_rate_)) {
+    return DS_ERR_INVALID_AUDIO_FORMAT;
+  }
+
+  // Audio buffered by the resampler at a previous rate goes first
+  converted_.clear();
+  resampler_.set_rates(sample_rate, model_->sample_rate_, converted_);
+  if (!converted_.empty()) {
+    pushAudio(converted_.data(), converted_.size());
+  }
+
+  vector<float>* mono;
+  if (sample_rate == model_->sample_rate_) {
+    if (channels == 1 && format == DS_SAMPLE_FORMAT_S16) {
+      pushAudio((const short*)buffer, num_frames);
+      return DS_ERR_OK;
+    }
+    converted_.clear();
+    mono = &converted_;
+  } else {
+    mono = &resampler_.input();
+  }
+
+  if (format == DS_SAMPLE_FORMAT_S16) {
+    append_mono((const short*)buffer, num_frames, channels, *mono);
+  } else {
+    append_mono((const float*)buffer, num_frames, channels, *mono);
+  }
+
+  if (sample_rate != model_->sample_rate_) {
+    converted_.clear();
+    resampler_.process(converted_);
+  }
+  pushAudio(converted_.data(), converted_.size());
+  return DS_ERR_OK;
+}
+
+template<typename T>
+void
+StreamingState::pushAudio(const T* buffer,
+                          unsigned int buffer_size)
+{
+  DS_STATS_ADD(&stats_, STATS_COUNTER_AUDIO_SAMPLES, buffer_size);
+
   // Consume all the data that was passed in, processing full buffers if needed
   while (buffer_size > 0) {
     while (buffer_size > 0 && audio_buffer_.size() < model_->audio_win_len_) {
-      // Convert i16 sample into f32
-      float multiplier = 1.0f / (1 << 15);
-      audio_buffer_.push_back((float)(*buffer) * multiplier);
+      audio_buffer_.push_back(sample_to_float(*buffer));
       ++buffer;
       --buffer_size;
     }
@@ -134,42 +362,148 @@ StreamingState::feedAudioContent(const short* buffer,
 char*
 StreamingState::intermediateDecode() const
 {
+  DS_STATS_SCOPE(&stats_, STATS_STAGE_RESULT);
   return model_->decode(decoder_state_);
 }
 
 Metadata*
 StreamingState::intermediateDecodeWithMetadata(unsigned int num_results) const
 {
+  DS_STATS_SCOPE(&stats_, STATS_STAGE_RESULT);
   return model_->decode_metadata(decoder_state_, num_results);
 }
 
+WordMetadataList*
+StreamingState::intermediateDecodeWithWords(unsigned int num_results) const
+{
+  DS_STATS_SCOPE(&stats_, STATS_STAGE_RESULT);
+  return model_->decode_words(decoder_state_, num_results);
+}
+
 char*
 StreamingState::finishStream()
 {
   finalizeStream();
-  return model_->decode(decoder_state_);
+  return intermediateDecode();
 }
 
 Metadata*
 StreamingState::finishStreamWithMetadata(unsigned int num_results)
 {
   finalizeStream();
-  return model_->decode_metadata(decoder_state_, num_results);
+  return intermediateDecodeWithMetadata(num_results);
+}
+
+WordMetadataList*
+StreamingState::finishStreamWithWords(unsigned int num_results)
+{
+  finalizeStream();
+  return intermediateDecodeWithWords(num_results);
+}
+
+char*
+StreamingState::takeCommitted()
+{
+  Output committed = decoder_state_.take_committed();
+  return strdup(model_->alphabet_.Decode(committed.tokens).c_str());
+}
+
+Metadata*
+StreamingState::takeCommittedWithMetadata()
+{
+  return model_->outputs_to_metadata({decoder_state_.take_committed()});
+}
+
+void
+StreamingState::enableEndpointing(unsigned int min_silence_ms,
+                                  float energy_threshold_db)
+{
+  // One timestep of the acoustic model per feature window
+  unsigned int frames = (unsigned long)min_silence_ms * model_->sample_rate_ /
+                        (1000ul * model_->audio_win_step_);
+  endpoint_frames_ = std::max(frames, 1u);
+  energy_threshold_ = energy_threshold_db < 0.f ?
+                      std::pow(10.f, energy_threshold_db / 20.f) : 0.f;
+  quiet_windows_ = 0;
+  endpointing_ = true;
+}
+
+char*
+StreamingState::takeSegment()
+{
+  if (segments_.empty()) {
+    return nullptr;
+  }
+  char* text = strdup(model_->alphabet_.Decode(segments_.front().tokens).c_str());
+  segments_.pop_front();
+  return text;
+}
+
+Metadata*
+StreamingState::takeSegmentWithMetadata()
+{
+  if (segments_.empty()) {
+    return nullptr;
+  }
+  Metadata* metadata = model_->outputs_to_metadata({segments_.front()});
+  segments_.pop_front();
+  return metadata;
+}
+
+void
+StreamingState::enableFrameSkipping(float blank_threshold, bool skip_silence)
+{
+  decoder_state_.set_blank_skip_threshold(blank_threshold);
+  if (skip_silence && !skip_silence_) {
+    // Audio fed so far wasn't checked
+    silent_frames_ = 0;
+    silent_steps_in_batch_ = 0;
+  }
+  skip_silence_ = skip_silence;
 }
 
 void
 StreamingState::processAudioWindow(const vector<float>& buf)
 {
+  if (skip_silence_) {
+    bool silent = std::all_of(buf.begin(), buf.end(),
+                              [](float sample) { return sample == 0.f; });
+    silent_frames_ = silent ? silent_frames_ + 1 : 0;
+  }
+
+  if (endpointing_ && energy_threshold_ > 0.f) {
+    float energy = 0.f;
+    for (float sample : buf) {
+      energy += sample * sample;
+    }
+    float rms = buf.empty() ? 0.f : std::sqrt(energy / buf.size());
+    quiet_windows_ = rms < energy_threshold_ ? quiet_windows_ + 1 : 0;
+  }
+
   // Compute MFCC features
   vector<float> mfcc;
   mfcc.reserve(model_->n_features_);
-  model_->compute_mfcc(buf, mfcc);
+  {
+    DS_STATS_SCOPE(&stats_, STATS_STAGE_MFCC);
+    model_->compute_mfcc(buf, mfcc);
+  }
   pushMfccBuffer(mfcc);
 }
 
 void
 StreamingState::finalizeStream()
 {
+  // The zero windows added below decode as blanks and would end the last
+  // utterance as a segment, leaving nothing for the Finish* calls to return
+  finalizing_ = true;
+
+  // Audio still in the resampler's filter
+  if (resampler_.in_rate() != 0) {
+    converted_.clear();
+    resampler_.flush(converted_);
+    pushAudio(converted_.data(), converted_.size());
+  }
+
   // Flush audio buffer
   processAudioWindow(audio_buffer_);
 
@@ -188,6 +522,7 @@ void
 StreamingState::addZeroMfccWindow()
 {
   vector<float> zero_buffer(model_->n_features_, 0.f);
+  ++silent_frames_;
   pushMfccBuffer(zero_buffer);
 }
 
@@ -223,6 +558,10 @@ StreamingState::pushMfccBuffer(const vector<float>& buf)
 void
 StreamingState::processMfccWindow(const vector<float>& buf)
 {
+  if (skip_silence_ && silent_frames_ >= 2 * model_->n_context_ + 1) {
+    ++silent_steps_in_batch_;
+  }
+
   auto start = buf.begin();
   auto end = buf.end();
   while (start != end) {
@@ -242,24 +581,198 @@ StreamingState::processMfccWindow(const vector<float>& buf)
 void
 StreamingState::processBatch(const vector<float>& buf, unsigned int n_steps)
 {
+  const bool silent = skip_silence_ && silent_steps_in_batch_ >= n_steps;
+  silent_steps_in_batch_ = 0;
+  DS_STATS_ADD(&stats_, STATS_COUNTER_TIMESTEPS, n_steps);
+  if (silent) {
+    decoder_state_.skip_blank_frames(n_steps);
+    if (endpointing_) {
+      checkEndpoint();
+    }
+    return;
+  }
+
   vector<float> logits;
-  model_->infer(buf,
-                n_steps,
-                previous_state_c_,
-                previous_state_h_,
-                logits,
-                previous_state_c_,
-                previous_state_h_);
+  {
+    DS_STATS_SCOPE(&stats_, STATS_STAGE_INFERENCE);
+    model_->infer(buf,
+                  n_steps,
+                  previous_state_c_,
+                  previous_state_h_,
+                  logits,
+                  previous_state_c_,
+                  previous_state_h_);
+  }
 
   const size_t num_classes = model_->alphabet_.GetSize() + 1; // +1 for blank
   const int n_frames = logits.size() / (ModelState::BATCH_SIZE * num_classes);
 
-  // Convert logits to double
-  vector<double> inputs(logits.begin(), logits.end());
+  {
+    DS_STATS_SCOPE(&stats_, STATS_STAGE_DECODE);
+    decoder_state_.next(logits.data(),
+                        n_frames,
+                        num_classes,
+                        num_classes);
+  }
 
-  decoder_state_.next(inputs.data(),
-                      n_frames,
-                      num_classes);
+  if (endpointing_) {
+    checkEndpoint();
+  }
+}
+
+void
+StreamingState::checkEndpoint()
+{
+  if (finalizing_) {
+    return;
+  }
+  if (decoder_state_.get_trailing_blank_frames() < endpoint_frames_) {
+    return;
+  }
+  if (energy_threshold_ > 0.f && quiet_windows_ < endpoint_frames_) {
+    return;
+  }
+
+  Output segment = decoder_state_.decode(1)[0];
+  if (!segment.tokens.empty()) {
+    segments_.push_back(std::move(segment));
+  }
+  resetUtterance();
+}
+
+void
+StreamingState::resetUtterance()
+{
+  // Buffered audio and features are kept: they belong to the next utterance
+  std::fill(previous_state_c_.begin(), previous_state_c_.end(), 0.f);
+  std::fill(previous_state_h_.begin(), previous_state_h_.end(), 0.f);
+  decoder_state_.reset();
+}
+
+// Start of stream snapshots, the version changes with their layout
+static const uint32_t SNAPSHOT_MAGIC = 0x53534453; // "SDSS"
+static const uint32_t SNAPSHOT_VERSION = 1;
+
+/* A snapshot holds everything that affects later results: the buffered audio
+   and features, the recurrent state of the acoustic model, the settings and
+   pending segments of the stream, and the decoder state. The model sizes the
+   buffers depend on are written first, so that restoring into another model
+   is detected. Statistics are not part of it.
+*/
+void
+StreamingState::save(SnapshotWriter& writer) const
+{
+  writer.put(SNAPSHOT_MAGIC);
+  writer.put(SNAPSHOT_VERSION);
+  writer.put(model_->sample_rate_);
+  writer.put(model_->audio_win_len_);
+  writer.put(model_->audio_win_step_);
+  writer.put(model_->n_features_);
+  writer.put(model_->n_context_);
+  writer.put(model_->mfcc_feats_per_timestep_);
+  writer.put(model_->n_steps_);
+  writer.put(model_->state_size_);
+
+  writer.put_vector(audio_buffer_);
+  writer.put_vector(mfcc_buffer_);
+  writer.put_vector(batch_buffer_);
+  writer.put_vector(previous_state_c_);
+  writer.put_vector(previous_state_h_);
+
+  writer.put<uint8_t>(endpointing_);
+  writer.put(endpoint_frames_);
+  writer.put(energy_threshold_);
+  writer.put(quiet_windows_);
+  writer.put<uint32_t>(segments_.size());
+  for (const Output& segment : segments_) {
+    writer.put_output(segment);
+  }
+
+  writer.put<uint8_t>(skip_silence_);
+  writer.put(silent_frames_);
+  writer.put(silent_steps_in_batch_);
+
+  resampler_.save(writer);
+  decoder_state_.save(writer);
+}
+
+// Restore a snapshot written by save() into a stream just initialized with
+// init(), returns an error code.
+int
+StreamingState::restore(const char* data, unsigned int size)
+{
+  SnapshotReader reader(data, size);
+  uint32_t magic, version;
+  reader.get(magic);
+  reader.get(version);
+  if (reader.failed() || magic != SNAPSHOT_MAGIC) {
+    return DS_ERR_INVALID_SNAPSHOT;
+  }
+  if (version != SNAPSHOT_VERSION) {
+    return DS_ERR_SNAPSHOT_MISMATCH;
+  }
+
+  const unsigned int geometry[] = {
+    model_->sample_rate_, model_->audio_win_len_, model_->audio_win_step_,
+    model_->n_features_, model_->n_context_, model_->mfcc_feats_per_timestep_,
+    model_->n_steps_, model_->state_size_,
+  };
+  bool same_geometry = true;
+  for (unsigned int expected : geometry) {
+    unsigned int value;
+    reader.get(value);
+    same_geometry = same_geometry && value == expected;
+  }
+  if (reader.failed()) {
+    return DS_ERR_INVALID_SNAPSHOT;
+  }
+  if (!same_geometry) {
+    return DS_ERR_SNAPSHOT_MISMATCH;
+  }
+
+  reader.get_vector(audio_buffer_);
+  reader.get_vector(mfcc_buffer_);
+  reader.get_vector(batch_buffer_);
+  reader.get_vector(previous_state_c_);
+  reader.get_vector(previous_state_h_);
+  const size_t batch_size = model_->n_steps_ * model_->mfcc_feats_per_timestep_;
+  if (audio_buffer_.size() >= model_->audio_win_len_ ||
+      mfcc_buffer_.size() >= model_->mfcc_feats_per_timestep_ ||
+      batch_buffer_.size() >= batch_size ||
+      batch_buffer_.size() % model_->mfcc_feats_per_timestep_ != 0 ||
+      previous_state_c_.size() != model_->state_size_ ||
+      previous_state_h_.size() != model_->state_size_) {
+    reader.fail();
+  }
+
+  uint8_t endpointing, skip_silence;
+  uint32_t num_segments;
+  reader.get(endpointing);
+  reader.get(endpoint_frames_);
+  reader.get(energy_threshold_);
+  reader.get(quiet_windows_);
+  reader.get(num_segments);
+  for (uint32_t i = 0; i < num_segments && !reader.failed(); ++i) {
+    Output segment;
+    reader.get_output(segment);
+    segments_.push_back(std::move(segment));
+  }
+  reader.get(skip_silence);
+  reader.get(silent_frames_);
+  reader.get(silent_steps_in_batch_);
+  endpointing_ = endpointing;
+  skip_silence_ = skip_silence;
+
+  if (reader.failed() || !resampler_.load(reader)) {
+    return DS_ERR_INVALID_SNAPSHOT;
+  }
+  if (!decoder_state_.load(reader)) {
+    return reader.failed() ? DS_ERR_INVALID_SNAPSHOT : DS_ERR_SNAPSHOT_MISMATCH;
+  }
+  if (!reader.done()) {
+    return DS_ERR_INVALID_SNAPSHOT;
+  }
+  return DS_ERR_OK;
 }
 
 int
@@ -326,6 +839,9 @@ DS_GetModelSampleRate(const ModelState* aCtx)
 void
 DS_FreeModel(ModelState* ctx)
 {
+  if (ctx) {
+    DS_SetStreamPoolSize(ctx, 0);
+  }
   delete ctx;
 }
 
@@ -416,32 +932,140 @@ DS_CreateStream(ModelState* aCtx,
 {
   *retval = nullptr;
 
-  std::unique_ptr<StreamingState> ctx(new StreamingState());
+  std::unique_ptr<StreamingState> ctx;
+  {
+    std::lock_guard<std::mutex> lock(aCtx->stream_pool_mutex_);
+    if (!aCtx->stream_pool_.empty()) {
+      ctx.reset(aCtx->stream_pool_.back());
+      aCtx->stream_pool_.pop_back();
+      ++aCtx->stream_pool_hits_;
+    } else if (aCtx->stream_pool_max_size_ > 0) {
+      ++aCtx->stream_pool_misses_;
+    }
+  }
+
+  if (!ctx) {
+    ctx.reset(new StreamingState());
+  }
   if (!ctx) {
     std::cerr << "Could not allocate streaming state." << std::endl;
     return DS_ERR_FAIL_CREATE_STREAM;
   }
 
-  ctx->audio_buffer_.reserve(aCtx->audio_win_len_);
-  ctx->mfcc_buffer_.reserve(aCtx->mfcc_feats_per_timestep_);
-  ctx->mfcc_buffer_.resize(aCtx->n_features_*aCtx->n_context_, 0.f);
-  ctx->batch_buffer_.reserve(aCtx->n_steps_ * aCtx->mfcc_feats_per_timestep_);
-  ctx->previous_state_c_.resize(aCtx->state_size_, 0.f);
-  ctx->previous_state_h_.resize(aCtx->state_size_, 0.f);
-  ctx->model_ = aCtx;
+  ctx->init(aCtx);
 
-  const int cutoff_top_n = 40;
-  const double cutoff_prob = 1.0;
+  *retval = ctx.release();
+  return DS_ERR_OK;
+}
 
-  ctx->decoder_state_.init(aCtx->alphabet_,
-                           aCtx->beam_width_,
-                           cutoff_prob,
-                           cutoff_top_n,
-                           aCtx->scorer_,
-                           aCtx->hot_words_);
+int
+DS_SetStreamPoolSize(ModelState* aCtx,
+                     unsigned int aMaxSize)
+{
+  std::vector<StreamingState*> evicted;
+  {
+    std::lock_guard<std::mutex> lock(aCtx->stream_pool_mutex_);
+    aCtx->stream_pool_max_size_ = aMaxSize;
+    while (aCtx->stream_pool_.size() > aMaxSize) {
+      evicted.push_back(aCtx->stream_pool_.back());
+      aCtx->stream_pool_.pop_back();
+    }
+  }
+  for (StreamingState* ctx : evicted) {
+    delete ctx;
+  }
+  return DS_ERR_OK;
+}
 
-  *retval = ctx.release();
+unsigned int
+DS_GetStreamPoolHits(const ModelState* aCtx)
+{
+  std::lock_guard<std::mutex> lock(aCtx->stream_pool_mutex_);
+  return aCtx->stream_pool_hits_;
+}
+
+unsigned int
+DS_GetStreamPoolMisses(const ModelState* aCtx)
+{
+  std::lock_guard<std::mutex> lock(aCtx->stream_pool_mutex_);
+  return aCtx->stream_pool_misses_;
+}
+
+#ifndef DS_DISABLE_STATS
+static_assert((int)DS_STATS_NUM_STAGES == (int)STATS_NUM_STAGES &&
+              DS_STATS_HISTOGRAM_BUCKETS == StatsCollector::kHistogramBuckets,
+              "PipelineStats does not match StatsCollector");
+
+static void
+fill_stats(const StatsCollector& collector, PipelineStats* stats)
+{
+  for (int s = 0; s < STATS_NUM_STAGES; ++s) {
+    StatsStage stage = (StatsStage)s;
+    StageStats& out = stats->stages[s];
+    out.count = collector.count(stage);
+    out.total_ns = collector.total_ns(stage);
+    out.max_ns = collector.max_ns(stage);
+    for (int b = 0; b < DS_STATS_HISTOGRAM_BUCKETS; ++b) {
+      out.histogram[b] = collector.histogram(stage, b);
+    }
+  }
+  stats->audio_samples = collector.counter(STATS_COUNTER_AUDIO_SAMPLES);
+  stats->timesteps = collector.counter(STATS_COUNTER_TIMESTEPS);
+  stats->streams = collector.counter(STATS_COUNTER_STREAMS);
+  stats->lm_cache_hits = collector.counter(STATS_COUNTER_LM_CACHE_HITS);
+  stats->lm_cache_misses = collector.counter(STATS_COUNTER_LM_CACHE_MISSES);
+  stats->fst_lookups = collector.counter(STATS_COUNTER_FST_LOOKUPS);
+}
+#endif // DS_DISABLE_STATS
+
+int
+DS_GetStats(const ModelState* aCtx,
+            const StreamingState* aSctx,
+            PipelineStats* aStats)
+{
+#ifndef DS_DISABLE_STATS
+  fill_stats(aSctx ? aSctx->stats_ : aCtx->stats_, aStats);
   return DS_ERR_OK;
+#else
+  return DS_ERR_STATS_NOT_ENABLED;
+#endif // DS_DISABLE_STATS
+}
+
+char*
+DS_GetStatsJSON(const ModelState* aCtx,
+                const StreamingState* aSctx)
+{
+  PipelineStats stats;
+  if (DS_GetStats(aCtx, aSctx, &stats) != DS_ERR_OK) {
+    return nullptr;
+  }
+
+  static const char* const stage_names[DS_STATS_NUM_STAGES] = {
+    "mfcc", "inference", "decode", "lm_query", "extend", "result"
+  };
+
+  std::ostringstream out;
+  out << "{\"streams\":" << stats.streams
+      << ",\"audio_samples\":" << stats.audio_samples
+      << ",\"timesteps\":" << stats.timesteps
+      << ",\"lm_cache_hits\":" << stats.lm_cache_hits
+      << ",\"lm_cache_misses\":" << stats.lm_cache_misses
+      << ",\"fst_lookups\":" << stats.fst_lookups
+      << ",\"stages\":{";
+  for (int s = 0; s < DS_STATS_NUM_STAGES; ++s) {
+    const StageStats& stage = stats.stages[s];
+    out << (s ? "," : "") << "\"" << stage_names[s] << "\":{"
+        << "\"count\":" << stage.count
+        << ",\"total_ns\":" << stage.total_ns
+        << ",\"max_ns\":" << stage.max_ns
+        << ",\"histogram\":[";
+    for (int b = 0; b < DS_STATS_HISTOGRAM_BUCKETS; ++b) {
+      out << (b ? "," : "") << stage.histogram[b];
+    }
+    out << "]}";
+  }
+  out << "}}";
+  return strdup(out.str().c_str());
 }
 
 void
@@ -452,6 +1076,175 @@ DS_FeedAudioContent(StreamingState* aSctx,
   aSctx->feedAudioContent(aBuffer, aBufferSize);
 }
 
+int
+DS_FeedAudioContentEx(StreamingState* aSctx,
+                      const void* aBuffer,
+                      unsigned int aNumFrames,
+                      unsigned int aSampleRate,
+                      unsigned int aChannels,
+                      int aFormat)
+{
+  return aSctx->feedAudioContentEx(aBuffer, aNumFrames, aSampleRate,
+                                   aChannels, aFormat);
+}
+
+int
+DS_EnableStreamPrefixCommitment(StreamingState* aSctx)
+{
+  aSctx->decoder_state_.set_prefix_commitment(true);
+  return DS_ERR_OK;
+}
+
+char*
+DS_TakeCommittedText(StreamingState* aSctx)
+{
+  return aSctx->takeCommitted();
+}
+
+Metadata*
+DS_TakeCommittedMetadata(StreamingState* aSctx)
+{
+  return aSctx->takeCommittedWithMetadata();
+}
+
+int
+DS_EnableStreamEndpointing(StreamingState* aSctx,
+                           unsigned int aMinSilenceMs,
+                           float aEnergyThreshold)
+{
+  aSctx->enableEndpointing(aMinSilenceMs, aEnergyThreshold);
+  return DS_ERR_OK;
+}
+
+int
+DS_EnableStreamFrameSkipping(StreamingState* aSctx,
+                             float aBlankThreshold,
+                             int aSkipSilence)
+{
+  aSctx->enableFrameSkipping(aBlankThreshold, aSkipSilence != 0);
+  return DS_ERR_OK;
+}
+
+unsigned int
+DS_GetStreamSkippedFrames(const StreamingState* aSctx)
+{
+  return aSctx->decoder_state_.get_skipped_frames();
+}
+
+int
+DS_EnableStreamLMLookahead(StreamingState* aSctx)
+{
+  if (!aSctx->model_->scorer_) {
+    return DS_ERR_SCORER_NOT_ENABLED;
+  }
+  if (!aSctx->decoder_state_.set_lm_lookahead(true)) {
+    return DS_ERR_SCORER_NO_LOOKAHEAD;
+  }
+  return DS_ERR_OK;
+}
+
+int
+DS_EnableStreamGreedyDecoding(StreamingState* aSctx)
+{
+  if (!aSctx->decoder_state_.set_greedy(true)) {
+    return DS_ERR_GREEDY_WITH_SCORER;
+  }
+  return DS_ERR_OK;
+}
+
+int
+DS_SetStreamTimingMode(StreamingState* aSctx, int aMode)
+{
+  switch (aMode) {
+  case DS_TIMING_TOKENS:
+    aSctx->decoder_state_.set_timing_mode(TIMING_TOKENS);
+    break;
+  case DS_TIMING_WORDS:
+    aSctx->decoder_state_.set_timing_mode(TIMING_WORDS);
+    break;
+  case DS_TIMING_NONE:
+    aSctx->decoder_state_.set_timing_mode(TIMING_NONE);
+    break;
+  default:
+    return DS_ERR_INVALID_TIMING_MODE;
+  }
+  return DS_ERR_OK;
+}
+
+int
+DS_EnableStreamBeamPruning(StreamingState* aSctx,
+                           float aBeamThreshold,
+                           float aMassCoverage,
+                           unsigned int aMinBeamWidth)
+{
+  if (!(aBeamThreshold >= 0.0f) || !(aMassCoverage >= 0.0f && aMassCoverage <= 1.0f)) {
+    return DS_ERR_INVALID_BEAM_PRUNING;
+  }
+  aSctx->decoder_state_.set_beam_threshold(aBeamThreshold);
+  aSctx->decoder_state_.set_adaptive_beam(aMassCoverage, aMinBeamWidth);
+  return DS_ERR_OK;
+}
+
+int
+DS_SaveStream(const StreamingState* aSctx,
+              char** aSnapshot,
+              unsigned int* aSize)
+{
+  SnapshotWriter writer;
+  aSctx->save(writer);
+  const std::string& data = writer.data();
+  *aSnapshot = (char*)malloc(data.size());
+  *aSize = 0;
+  if (!*aSnapshot) {
+    return DS_ERR_FAIL_SAVE_STREAM;
+  }
+  memcpy(*aSnapshot, data.data(), data.size());
+  *aSize = data.size();
+  return DS_ERR_OK;
+}
+
+int
+DS_RestoreStream(ModelState* aCtx,
+                 const char* aSnapshot,
+                 unsigned int aSize,
+                 StreamingState** retval)
+{
+  *retval = nullptr;
+
+  StreamingState* ctx;
+  int err = DS_CreateStream(aCtx, &ctx);
+  if (err != DS_ERR_OK) {
+    return err;
+  }
+
+  err = ctx->restore(aSnapshot, aSize);
+  if (err != DS_ERR_OK) {
+    DS_FreeStream(ctx);
+    return err;
+  }
+
+  *retval = ctx;
+  return DS_ERR_OK;
+}
+
+void
+DS_FreeSnapshot(char* aSnapshot)
+{
+  free(aSnapshot);
+}
+
+char*
+DS_TakeSegment(StreamingState* aSctx)
+{
+  return aSctx->takeSegment();
+}
+
+Metadata*
+DS_TakeSegmentWithMetadata(StreamingState* aSctx)
+{
+  return aSctx->takeSegmentWithMetadata();
+}
+
 char*
 DS_IntermediateDecode(const StreamingState* aSctx)
 {
@@ -465,6 +1258,13 @@ DS_IntermediateDecodeWithMetadata(const StreamingState* aSctx,
   return aSctx->intermediateDecodeWithMetadata(aNumResults);
 }
 
+WordMetadataList*
+DS_IntermediateDecodeWithWords(const StreamingState* aSctx,
+                               unsigned int aNumResults)
+{
+  return aSctx->intermediateDecodeWithWords(aNumResults);
+}
+
 char*
 DS_FinishStream(StreamingState* aSctx)
 {
@@ -482,6 +1282,15 @@ DS_FinishStreamWithMetadata(StreamingState* aSctx,
   return result;
 }
 
+WordMetadataList*
+DS_FinishStreamWithWords(StreamingState* aSctx,
+                         unsigned int aNumResults)
+{
+  WordMetadataList* result = aSctx->finishStreamWithWords(aNumResults);
+  DS_FreeStream(aSctx);
+  return result;
+}
+
 StreamingState*
 CreateStreamAndFeedAudioContent(ModelState* aCtx,
                                 const short* aBuffer,
@@ -515,27 +1324,52 @@ DS_SpeechToTextWithMetadata(ModelState* aCtx,
   return DS_FinishStreamWithMetadata(ctx, aNumResults);
 }
 
+WordMetadataList*
+DS_SpeechToTextWithWords(ModelState* aCtx,
+                         const short* aBuffer,
+                         unsigned int aBufferSize,
+                         unsigned int aNumResults)
+{
+  StreamingState* ctx = CreateStreamAndFeedAudioContent(aCtx, aBuffer, aBufferSize);
+  return DS_FinishStreamWithWords(ctx, aNumResults);
+}
+
 void
 DS_FreeStream(StreamingState* aSctx)
 {
+  if (!aSctx) {
+    return;
+  }
+
+  ModelState* model = aSctx->model_;
+#ifndef DS_DISABLE_STATS
+  model->stats_.merge(aSctx->stats_);
+#endif // DS_DISABLE_STATS
+  // Free the timestep tree on this thread, whose pool it comes from, in case
+  // the stream is pooled
+  aSctx->decoder_state_.reset();
+  {
+    std::lock_guard<std::mutex> lock(model->stream_pool_mutex_);
+    if (model->stream_pool_.size() < model->stream_pool_max_size_) {
+      model->stream_pool_.push_back(aSctx);
+      return;
+    }
+  }
   delete aSctx;
 }
 
 void
 DS_FreeMetadata(Metadata* m)
 {
-  if (m) {
-    for (int i = 0; i < m->num_transcripts; ++i) {
-      for (int j = 0; j < m->transcripts[i].num_tokens; ++j) {
-        free((void*)m->transcripts[i].tokens[j].text);
-      }
-
-      free((void*)m->transcripts[i].tokens);
-    }
+  // Transcripts, tokens and their text are allocated in the same block
+  free(m);
+}
 
-    free((void*)m->transcripts);
-    free(m);
-  }
+void
+DS_FreeWordMetadata(WordMetadataList* m)
+{
+  // Transcripts, words and their text are allocated in the same block
+  free(m);
 }
 
 void
@@ -59,6 +59,57 @@ typedef struct Metadata {
   const unsigned int num_transcripts;
 } Metadata;
 
+/**
+ * @brief Stores text of an individual word, along with its timing and scores.
+ */
+typedef struct WordMetadata {
+  /** The text of the word */
+  const char* const text;
+
+  /** Position of the first token of the word in units of 20ms */
+  const unsigned int start_timestep;
+
+  /** Position of the space following the word, or the end of the word if it
+   * is the last one, in units of 20ms */
+  const unsigned int end_timestep;
+
+  /** Position of the word in seconds */
+  const float start_time;
+
+  /** Duration of the word in seconds */
+  const float duration;
+
+  /** Sum of the acoustic model log probabilities of the tokens of the word */
+  const double acoustic_score;
+
+  /** Log probability of the word given by the external scorer, 0 without one */
+  const double lm_score;
+} WordMetadata;
+
+/**
+ * @brief A single transcript computed by the model, split into words.
+ */
+typedef struct WordTranscript {
+  /** Array of WordMetadata objects */
+  const WordMetadata* const words;
+  /** Size of the words array */
+  const unsigned int num_words;
+  /** Approximated confidence value for this transcript, see
+   * CandidateTranscript::confidence.
+   */
+  const double confidence;
+} WordTranscript;
+
+/**
+ * @brief An array of WordTranscript objects computed by the model.
+ */
+typedef struct WordMetadataList {
+  /** Array of WordTranscript objects */
+  const WordTranscript* const transcripts;
+  /** Size of the transcripts array */
+  const unsigned int num_transcripts;
+} WordMetadataList;
+
 // sphinx-doc: error_code_listing_start
 
 #define DS_FOR_EACH_ERROR(APPLY) \
@@ -74,6 +125,14 @@ typedef struct Metadata {
   APPLY(DS_ERR_SCORER_NO_TRIE,          0x2007, "Reached end of scorer file before loading vocabulary trie.") \
   APPLY(DS_ERR_SCORER_INVALID_TRIE,     0x2008, "Invalid magic in trie header.") \
   APPLY(DS_ERR_SCORER_VERSION_MISMATCH, 0x2009, "Scorer file version does not match expected version.") \
+  APPLY(DS_ERR_INVALID_AUDIO_FORMAT,    0x2010, "Invalid audio sample rate, channel count or sample format.") \
+  APPLY(DS_ERR_STATS_NOT_ENABLED,       0x2011, "Statistics were disabled at build time.") \
+  APPLY(DS_ERR_SCORER_NO_LOOKAHEAD,     0x2012, "Scorer file has no language model look-ahead scores.") \
+  APPLY(DS_ERR_GREEDY_WITH_SCORER,      0x2013, "Greedy decoding can't be used with an external scorer.") \
+  APPLY(DS_ERR_INVALID_TIMING_MODE,     0x2014, "Invalid timing mode.") \
+  APPLY(DS_ERR_INVALID_BEAM_PRUNING,    0x2015, "Invalid beam pruning parameters.") \
+  APPLY(DS_ERR_INVALID_SNAPSHOT,        0x2016, "Invalid or corrupted stream snapshot.") \
+  APPLY(DS_ERR_SNAPSHOT_MISMATCH,       0x2017, "Stream snapshot was saved with another model, scorer or version.") \
   APPLY(DS_ERR_FAIL_INIT_MMAP,          0x3000, "Failed to initialize memory mapped model.") \
   APPLY(DS_ERR_FAIL_INIT_SESS,          0x3001, "Failed to initialize the session.") \
   APPLY(DS_ERR_FAIL_INTERPRETER,        0x3002, "Interpreter failed.") \
@@ -84,7 +143,8 @@ typedef struct Metadata {
   APPLY(DS_ERR_FAIL_CREATE_MODEL,       0x3007, "Could not allocate model state.") \
   APPLY(DS_ERR_FAIL_INSERT_HOTWORD,     0x3008, "Could not insert hot-word.") \
   APPLY(DS_ERR_FAIL_CLEAR_HOTWORD,      0x3009, "Could not clear hot-words.") \
-  APPLY(DS_ERR_FAIL_ERASE_HOTWORD,      0x3010, "Could not erase hot-word.")
+  APPLY(DS_ERR_FAIL_ERASE_HOTWORD,      0x3010, "Could not erase hot-word.") \
+  APPLY(DS_ERR_FAIL_SAVE_STREAM,        0x3011, "Could not allocate the stream snapshot.")
 
 // sphinx-doc: error_code_listing_end
 
@@ -95,6 +155,97 @@ DS_FOR_EACH_ERROR(DEFINE)
 #undef DEFINE
 };
 
+/**
+ * @brief Sample formats accepted by {@link DS_FeedAudioContentEx()}.
+ */
+enum DeepSpeech_Sample_Format
+{
+  /** 16-bit signed integers, in native byte order. */
+  DS_SAMPLE_FORMAT_S16 = 0,
+  /** 32-bit floats, in the range [-1, 1]. */
+  DS_SAMPLE_FORMAT_F32 = 1
+};
+
+/**
+ * @brief Timing information tracked by a stream, see
+ *        {@link DS_SetStreamTimingMode()}.
+ */
+enum DeepSpeech_Timing_Mode
+{
+  /** Exact timesteps of every token of every candidate transcript. */
+  DS_TIMING_TOKENS = 0,
+  /** Timesteps of each token on its own best path, enough for word start
+   *  and end times at a lower memory and CPU cost. */
+  DS_TIMING_WORDS = 1,
+  /** No timing, timesteps and start times are 0. */
+  DS_TIMING_NONE = 2
+};
+
+/**
+ * @brief Stages of the inference pipeline timed by {@link DS_GetStats()}.
+ */
+enum DeepSpeech_Stats_Stage
+{
+  /** Feature computation from audio windows. */
+  DS_STATS_STAGE_MFCC = 0,
+  /** Acoustic model runs. */
+  DS_STATS_STAGE_INFERENCE = 1,
+  /** Beam search steps, including the LM query and extend stages. */
+  DS_STATS_STAGE_DECODE = 2,
+  /** Language model scoring by the beam search, once per timestep for the
+   *  queries its cache can't answer, and once per result for the words
+   *  the results end with. */
+  DS_STATS_STAGE_LM_QUERY = 3,
+  /** Extension of the beams with the candidate characters by the beam
+   *  search, including lexicon FST lookups, once per call feeding the
+   *  decoder. */
+  DS_STATS_STAGE_EXTEND = 4,
+  /** Building transcripts and metadata from the decoder state. */
+  DS_STATS_STAGE_RESULT = 5,
+  /** Number of stages. */
+  DS_STATS_NUM_STAGES = 6
+};
+
+/** Number of buckets of the duration histogram of a StageStats. */
+#define DS_STATS_HISTOGRAM_BUCKETS 32
+
+/**
+ * @brief Timing of one stage of the inference pipeline.
+ */
+typedef struct StageStats {
+  /** Number of runs of the stage */
+  unsigned long long count;
+  /** Total duration of the runs in nanoseconds */
+  unsigned long long total_ns;
+  /** Duration of the longest run in nanoseconds */
+  unsigned long long max_ns;
+  /** Bucket i counts the runs that took between 2^i and 2^(i+1)
+   * nanoseconds. The first bucket also counts shorter runs and the last one
+   * longer runs. */
+  unsigned long long histogram[DS_STATS_HISTOGRAM_BUCKETS];
+} StageStats;
+
+/**
+ * @brief Timing and counters of a stream, or of all the finished streams of
+ *        a model.
+ */
+typedef struct PipelineStats {
+  /** Timing of each stage, indexed by DeepSpeech_Stats_Stage */
+  StageStats stages[DS_STATS_NUM_STAGES];
+  /** Number of audio samples processed, at the model sample rate */
+  unsigned long long audio_samples;
+  /** Number of acoustic model timesteps decoded */
+  unsigned long long timesteps;
+  /** Number of streams accounted for */
+  unsigned long long streams;
+  /** Number of language model queries answered by the decoder's cache */
+  unsigned long long lm_cache_hits;
+  /** Number of language model queries that missed the decoder's cache */
+  unsigned long long lm_cache_misses;
+  /** Number of lexicon FST lookups made by the beam search */
+  unsigned long long fst_lookups;
+} PipelineStats;
+
 /**
  * @brief An object providing an interface to a trained DeepSpeech model.
  *
@@ -259,6 +410,27 @@ Metadata* DS_SpeechToTextWithMetadata(ModelState* aCtx,
                                       unsigned int aBufferSize,
                                       unsigned int aNumResults);
 
+/**
+ * @brief Use the DeepSpeech model to convert speech to text and return
+ *        word-level results.
+ *
+ * @param aCtx The ModelState pointer for the model to use.
+ * @param aBuffer A 16-bit, mono raw audio signal at the appropriate
+ *                sample rate (matching what the model was trained on).
+ * @param aBufferSize The number of samples in the audio signal.
+ * @param aNumResults The maximum number of WordTranscript structs to return.
+ *                    Returned value might be smaller than this.
+ *
+ * @return WordMetadataList struct containing multiple candidate transcripts
+ *         split into words. The user is responsible for freeing it by calling
+ *         {@link DS_FreeWordMetadata()}. Returns NULL on error.
+ */
+DEEPSPEECH_EXPORT
+WordMetadataList* DS_SpeechToTextWithWords(ModelState* aCtx,
+                                           const short* aBuffer,
+                                           unsigned int aBufferSize,
+                                           unsigned int aNumResults);
+
 /**
  * @brief Create a new streaming inference state. The streaming state returned
  *        by this function can then be passed to {@link DS_FeedAudioContent()}
@@ -274,6 +446,83 @@ DEEPSPEECH_EXPORT
 int DS_CreateStream(ModelState* aCtx,
                     StreamingState** retval);
 
+/**
+ * @brief Set the maximum number of freed streams kept for reuse by a model.
+ *        Streams freed by {@link DS_FinishStream()},
+ *        {@link DS_FinishStreamWithMetadata()} or {@link DS_FreeStream()} are
+ *        then recycled by {@link DS_CreateStream()}, which avoids most of the
+ *        allocations and setup of a new stream, possibly on another thread
+ *        than the one that freed them. Pooling is disabled by default.
+ *
+ * @param aCtx The ModelState pointer for the model to change.
+ * @param aMaxSize Maximum number of pooled streams. Pass 0 to disable pooling
+ *                 and free the pooled streams.
+ *
+ * @return Zero on success, non-zero on failure.
+ */
+DEEPSPEECH_EXPORT
+int DS_SetStreamPoolSize(ModelState* aCtx,
+                         unsigned int aMaxSize);
+
+/**
+ * @brief Get the number of streams created from the stream pool of a model.
+ *
+ * @param aCtx A ModelState pointer created with {@link DS_CreateModel}.
+ *
+ * @return Number of calls to {@link DS_CreateStream()} that reused a stream.
+ */
+DEEPSPEECH_EXPORT
+unsigned int DS_GetStreamPoolHits(const ModelState* aCtx);
+
+/**
+ * @brief Get the number of streams allocated while stream pooling was enabled
+ *        because the pool of a model was empty.
+ *
+ * @param aCtx A ModelState pointer created with {@link DS_CreateModel}.
+ *
+ * @return Number of calls to {@link DS_CreateStream()} that had to allocate a
+ *         new stream.
+ */
+DEEPSPEECH_EXPORT
+unsigned int DS_GetStreamPoolMisses(const ModelState* aCtx);
+
+/**
+ * @brief Get the timing and counters of a stream, or of a model. Streams
+ *        record the time spent in each stage of the pipeline as they are
+ *        fed and decoded, and add their figures to the model they were
+ *        created from when they are freed. Both can be queried from any
+ *        thread at any time.
+ *
+ * @param aCtx A ModelState pointer created with {@link DS_CreateModel}.
+ * @param aSctx A streaming state pointer returned by {@link DS_CreateStream()}
+ *              to get the figures of that stream only, or NULL to get the
+ *              totals of all the freed streams of @p aCtx.
+ * @param[out] aStats Where to store the figures.
+ *
+ * @return Zero on success, DS_ERR_STATS_NOT_ENABLED if the library was built
+ *         without statistics.
+ */
+DEEPSPEECH_EXPORT
+int DS_GetStats(const ModelState* aCtx,
+                const StreamingState* aSctx,
+                PipelineStats* aStats);
+
+/**
+ * @brief Get the figures returned by {@link DS_GetStats()} as a JSON
+ *        object, ready to be sent to a monitoring system. The returned
+ *        string must be freed with {@link DS_FreeString()}.
+ *
+ * @param aCtx A ModelState pointer created with {@link DS_CreateModel}.
+ * @param aSctx A streaming state pointer returned by {@link DS_CreateStream()},
+ *              or NULL for the totals of @p aCtx.
+ *
+ * @return The JSON object, or NULL if the library was built without
+ *         statistics.
+ */
+DEEPSPEECH_EXPORT
+char* DS_GetStatsJSON(const ModelState* aCtx,
+                      const StreamingState* aSctx);
+
 /**
  * @brief Feed audio samples to an ongoing streaming inference.
  *
@@ -287,6 +536,291 @@ void DS_FeedAudioContent(StreamingState* aSctx,
                          const short* aBuffer,
                          unsigned int aBufferSize);
 
+/**
+ * @brief Feed audio samples in any sample rate, channel count and sample
+ *        format to an ongoing streaming inference. Channels are averaged, and
+ *        audio at another rate than {@link DS_GetModelSampleRate()} is
+ *        resampled as it is fed, keeping the resampler state across calls so
+ *        the audio can be split into chunks of any size.
+ *
+ * @param aSctx A streaming state pointer returned by {@link DS_CreateStream()}.
+ * @param aBuffer Interleaved samples, in the format given by @p aFormat.
+ * @param aNumFrames The number of frames in @p aBuffer, a frame holding one
+ *                   sample per channel.
+ * @param aSampleRate The sample rate of the audio. Changing it within a stream
+ *                    first flushes the audio waiting in the resampler, so
+ *                    audio keeps the order it was fed in. The
+ *                    resampling filter has L * taps coefficients, L/M being
+ *                    the model rate over this rate in lowest terms, and taps
+ *                    32 * max(1, M/L) rounded up to a multiple of 8. Rates
+ *                    needing more than 2^20 coefficients are rejected: the
+ *                    usual rates from 8 kHz to 768 kHz need at most 2^18,
+ *                    rates sharing no factor with the model's, such as
+ *                    96001 Hz, need millions.
+ * @param aChannels The number of interleaved channels.
+ * @param aFormat One of the DeepSpeech_Sample_Format values.
+ *
+ * @return Zero on success, DS_ERR_INVALID_AUDIO_FORMAT if the sample rate or
+ *         channel count is zero, the sample rate needs too large a resampling
+ *         filter or the format is unknown.
+ */
+DEEPSPEECH_EXPORT
+int DS_FeedAudioContentEx(StreamingState* aSctx,
+                          const void* aBuffer,
+                          unsigned int aNumFrames,
+                          unsigned int aSampleRate,
+                          unsigned int aChannels,
+                          int aFormat);
+
+/**
+ * @brief Enable prefix commitment on a stream. Once enabled, the beginning
+ *        of the transcription that all decoder beams agree on is finalized and
+ *        dropped from the decoder state, so memory use and decoding cost stay
+ *        bounded for arbitrarily long streams. Finalized text keeps being
+ *        included at the start of decoding results until it is retrieved with
+ *        {@link DS_TakeCommittedText()} or {@link DS_TakeCommittedMetadata()}.
+ *
+ * @param aSctx A streaming state pointer returned by {@link DS_CreateStream()}.
+ *
+ * @return Zero on success, non-zero on failure.
+ */
+DEEPSPEECH_EXPORT
+int DS_EnableStreamPrefixCommitment(StreamingState* aSctx);
+
+/**
+ * @brief Retrieve the text finalized by prefix commitment since the last
+ *        call. The returned text is no longer included in subsequent
+ *        decoding results.
+ *
+ * @param aSctx A streaming state pointer returned by {@link DS_CreateStream()}.
+ *
+ * @return The finalized text, possibly empty. The user is responsible for
+ *         freeing the string using {@link DS_FreeString()}.
+ */
+DEEPSPEECH_EXPORT
+char* DS_TakeCommittedText(StreamingState* aSctx);
+
+/**
+ * @brief Retrieve the text finalized by prefix commitment since the last
+ *        call, including metadata. The returned text is no longer included in
+ *        subsequent decoding results.
+ *
+ * @param aSctx A streaming state pointer returned by {@link DS_CreateStream()}.
+ *
+ * @return Metadata struct containing a single candidate transcript with
+ *         per-token metadata including timing information. The user is
+ *         responsible for freeing Metadata by calling {@link DS_FreeMetadata()}.
+ *         Returns NULL on error.
+ */
+DEEPSPEECH_EXPORT
+Metadata* DS_TakeCommittedMetadata(StreamingState* aSctx);
+
+/**
+ * @brief Enable endpointing on a stream. Whenever the acoustic model outputs
+ *        a long enough run of blank timesteps after some speech, the current
+ *        transcript is finalized as a segment and the stream starts decoding
+ *        a new utterance. Finalized segments are retrieved with
+ *        {@link DS_TakeSegment()} or {@link DS_TakeSegmentWithMetadata()};
+ *        intermediate and final decoding results only cover the utterance
+ *        in progress. Timings stay relative to the start of the stream.
+ *
+ * @param aSctx A streaming state pointer returned by {@link DS_CreateStream()}.
+ * @param aMinSilenceMs Minimum duration of silence, in milliseconds, that ends
+ *                      a segment.
+ * @param aEnergyThreshold Level in dBFS under which audio is considered
+ *                         quiet, e.g. -45. When negative, the audio must also
+ *                         have stayed under this level for aMinSilenceMs
+ *                         before a segment ends. Pass 0 to rely on the
+ *                         acoustic model alone.
+ *
+ * @return Zero on success, non-zero on failure.
+ */
+DEEPSPEECH_EXPORT
+int DS_EnableStreamEndpointing(StreamingState* aSctx,
+                               unsigned int aMinSilenceMs,
+                               float aEnergyThreshold);
+
+/**
+ * @brief Enable frame skipping on a stream, to avoid spending time on
+ *        silence. Timesteps where the acoustic model is nearly certain of a
+ *        blank only get a cheap decoder update instead of a full beam search
+ *        step, and stretches of digital silence (all-zero samples) can skip
+ *        acoustic model inference altogether.
+ *
+ * @param aSctx A streaming state pointer returned by {@link DS_CreateStream()}.
+ * @param aBlankThreshold Blank probability at or above which a timestep is
+ *                        decoded as blank only, e.g. 0.999. Pass 0 to decode
+ *                        every timestep fully.
+ * @param aSkipSilence Non-zero to skip inference on batches of timesteps made
+ *                     of digital silence only.
+ *
+ * @return Zero on success, non-zero on failure.
+ */
+DEEPSPEECH_EXPORT
+int DS_EnableStreamFrameSkipping(StreamingState* aSctx,
+                                 float aBlankThreshold,
+                                 int aSkipSilence);
+
+/**
+ * @brief Get the number of timesteps of a stream that were skipped by frame
+ *        skipping, see {@link DS_EnableStreamFrameSkipping()}.
+ *
+ * @param aSctx A streaming state pointer returned by {@link DS_CreateStream()}.
+ *
+ * @return Number of timesteps that did not go through a full decoding step,
+ *         including the ones for which inference was skipped.
+ */
+DEEPSPEECH_EXPORT
+unsigned int DS_GetStreamSkippedFrames(const StreamingState* aSctx);
+
+/**
+ * @brief Enable language model look-ahead on a stream. Each character added
+ *        to a word is scored with the best unigram probability of the words
+ *        it can still become, so beams spelling unlikely words are pruned
+ *        before reaching the end of the word and a smaller beam width gives
+ *        the same accuracy. Call before feeding audio, as it restarts the
+ *        decoding.
+ *
+ * @param aSctx A streaming state pointer returned by {@link DS_CreateStream()}.
+ *
+ * @return Zero on success, DS_ERR_SCORER_NOT_ENABLED without an external
+ *         scorer, DS_ERR_SCORER_NO_LOOKAHEAD if the scorer package was
+ *         created without look-ahead scores.
+ */
+DEEPSPEECH_EXPORT
+int DS_EnableStreamLMLookahead(StreamingState* aSctx);
+
+/**
+ * @brief Decode a stream with greedy CTC decoding: keep the most probable
+ *        label of each timestep and collapse repeats and blanks, instead of
+ *        running the beam search. Much cheaper, for applications that don't
+ *        use an external scorer. Results have the same format, but only one
+ *        candidate transcript, whose confidence is the log probability of the
+ *        path. Call before feeding audio.
+ *
+ * @param aSctx A streaming state pointer returned by {@link DS_CreateStream()}.
+ *
+ * @return Zero on success, DS_ERR_GREEDY_WITH_SCORER if an external scorer is
+ *         enabled.
+ */
+DEEPSPEECH_EXPORT
+int DS_EnableStreamGreedyDecoding(StreamingState* aSctx);
+
+/**
+ * @brief Set the timing information tracked while decoding a stream. Exact
+ *        per token timing keeps a tree of timesteps for all hypotheses, which
+ *        applications that only need word times, or only the text, can do
+ *        without: it saves memory and time on long audio. Call before feeding
+ *        audio, as it restarts the decoding.
+ *
+ * @param aSctx A streaming state pointer returned by {@link DS_CreateStream()}.
+ * @param aMode One of the DeepSpeech_Timing_Mode values, DS_TIMING_TOKENS by
+ *              default.
+ *
+ * @return Zero on success, DS_ERR_INVALID_TIMING_MODE if the mode is unknown.
+ */
+DEEPSPEECH_EXPORT
+int DS_SetStreamTimingMode(StreamingState* aSctx, int aMode);
+
+/**
+ * @brief Enable beam pruning on a stream, in addition to the beam width. The
+ *        score beam drops hypotheses far below the best one, and the adaptive
+ *        beam keeps only the best hypotheses holding most of the probability
+ *        mass. Both shrink the beam on timesteps the acoustic model is sure
+ *        of and keep it wide on ambiguous ones, which saves decoding time for
+ *        a small accuracy cost. Call before feeding audio.
+ *
+ * @param aSctx A streaming state pointer returned by {@link DS_CreateStream()}.
+ * @param aBeamThreshold Largest difference between the log probability of a
+ *                       hypothesis and the best one, e.g. 10. Pass 0 to
+ *                       disable the score beam.
+ * @param aMassCoverage Share of the probability mass kept by the adaptive
+ *                      beam, e.g. 0.999. Pass 0 to disable the adaptive beam.
+ * @param aMinBeamWidth Fewest hypotheses kept by the adaptive beam.
+ *
+ * @return Zero on success, DS_ERR_INVALID_BEAM_PRUNING if the threshold is
+ *         negative or the coverage is outside [0, 1].
+ */
+DEEPSPEECH_EXPORT
+int DS_EnableStreamBeamPruning(StreamingState* aSctx,
+                               float aBeamThreshold,
+                               float aMassCoverage,
+                               unsigned int aMinBeamWidth);
+
+/**
+ * @brief Save the state of a stream to a compact binary snapshot, from which
+ *        {@link DS_RestoreStream()} continues decoding exactly where the
+ *        stream was, e.g. in another process after a migration or a restart.
+ *        The snapshot holds the buffered audio, the recurrent state of the
+ *        acoustic model, the stream settings and the decoder hypotheses. It
+ *        uses the byte order of the machine, and can only be restored with
+ *        the same library version, model and scorer. The stream is not
+ *        changed.
+ *
+ * @param aSctx A streaming state pointer returned by {@link DS_CreateStream()}.
+ * @param[out] aSnapshot The snapshot. The user is responsible for freeing it
+ *                       using {@link DS_FreeSnapshot()}.
+ * @param[out] aSize The size of the snapshot in bytes.
+ *
+ * @return Zero on success, DS_ERR_FAIL_SAVE_STREAM if the snapshot could not
+ *         be allocated.
+ */
+DEEPSPEECH_EXPORT
+int DS_SaveStream(const StreamingState* aSctx,
+                  char** aSnapshot,
+                  unsigned int* aSize);
+
+/**
+ * @brief Create a new stream from a snapshot written by {@link DS_SaveStream()}.
+ *
+ * @param aCtx The ModelState pointer for the model to use, loaded with the
+ *             same model, scorer and beam width as the saved stream's.
+ * @param aSnapshot The snapshot.
+ * @param aSize The size of the snapshot in bytes.
+ * @param[out] retval an opaque pointer that represents the streaming state.
+ *                    Can be NULL if an error occurs.
+ *
+ * @return Zero for success, DS_ERR_SNAPSHOT_MISMATCH if the snapshot was saved
+ *         with another model, scorer, beam width or library version,
+ *         DS_ERR_INVALID_SNAPSHOT if it is corrupted.
+ */
+DEEPSPEECH_EXPORT
+int DS_RestoreStream(ModelState* aCtx,
+                     const char* aSnapshot,
+                     unsigned int aSize,
+                     StreamingState** retval);
+
+/**
+ * @brief Free a snapshot returned by {@link DS_SaveStream()}.
+ */
+DEEPSPEECH_EXPORT
+void DS_FreeSnapshot(char* aSnapshot);
+
+/**
+ * @brief Retrieve the oldest segment finalized by endpointing.
+ *
+ * @param aSctx A streaming state pointer returned by {@link DS_CreateStream()}.
+ *
+ * @return The text of the segment, or NULL if no segment is pending. The user
+ *         is responsible for freeing the string using {@link DS_FreeString()}.
+ */
+DEEPSPEECH_EXPORT
+char* DS_TakeSegment(StreamingState* aSctx);
+
+/**
+ * @brief Retrieve the oldest segment finalized by endpointing, including
+ *        metadata.
+ *
+ * @param aSctx A streaming state pointer returned by {@link DS_CreateStream()}.
+ *
+ * @return Metadata struct containing a single candidate transcript with
+ *         per-token metadata including timing information, or NULL if no
+ *         segment is pending. The user is responsible for freeing Metadata by
+ *         calling {@link DS_FreeMetadata()}.
+ */
+DEEPSPEECH_EXPORT
+Metadata* DS_TakeSegmentWithMetadata(StreamingState* aSctx);
+
 /**
  * @brief Compute the intermediate decoding of an ongoing streaming inference.
  *
@@ -328,6 +862,21 @@ Metadata* DS_IntermediateDecodeWithMetadata(const StreamingState* aSctx,
 DEEPSPEECH_EXPORT
 char* DS_FinishStream(StreamingState* aSctx);
 
+/**
+ * @brief Compute the intermediate decoding of an ongoing streaming inference,
+ *        return word-level results.
+ *
+ * @param aSctx A streaming state pointer returned by {@link DS_CreateStream()}.
+ * @param aNumResults The number of candidate transcripts to return.
+ *
+ * @return WordMetadataList struct containing multiple candidate transcripts
+ *         split into words. The user is responsible for freeing it by calling
+ *         {@link DS_FreeWordMetadata()}. Returns NULL on error.
+ */
+DEEPSPEECH_EXPORT
+WordMetadataList* DS_IntermediateDecodeWithWords(const StreamingState* aSctx,
+                                                 unsigned int aNumResults);
+
 /**
  * @brief Compute the final decoding of an ongoing streaming inference and return
  *        results including metadata. Signals the end of an ongoing streaming
@@ -347,6 +896,24 @@ DEEPSPEECH_EXPORT
 Metadata* DS_FinishStreamWithMetadata(StreamingState* aSctx,
                                       unsigned int aNumResults);
 
+/**
+ * @brief Compute the final decoding of an ongoing streaming inference and return
+ *        word-level results. Signals the end of an ongoing streaming
+ *        inference.
+ *
+ * @param aSctx A streaming state pointer returned by {@link DS_CreateStream()}.
+ * @param aNumResults The number of candidate transcripts to return.
+ *
+ * @return WordMetadataList struct containing multiple candidate transcripts
+ *         split into words. The user is responsible for freeing it by calling
+ *         {@link DS_FreeWordMetadata()}. Returns NULL on error.
+ *
+ * @note This method will free the state pointer (@p aSctx).
+ */
+DEEPSPEECH_EXPORT
+WordMetadataList* DS_FinishStreamWithWords(StreamingState* aSctx,
+                                           unsigned int aNumResults);
+
 /**
  * @brief Destroy a streaming state without decoding the computed logits. This
  *        can be used if you no longer need the result of an ongoing streaming
@@ -354,17 +921,27 @@ Metadata* DS_FinishStreamWithMetadata(StreamingState* aSctx,
  *
  * @param aSctx A streaming state pointer returned by {@link DS_CreateStream()}.
  *
- * @note This method will free the state pointer (@p aSctx).
+ * @note This method will free the state pointer (@p aSctx), or return it to
+ *       the stream pool, see {@link DS_SetStreamPoolSize()}. It must be
+ *       called before the model the stream was created from is freed.
  */
 DEEPSPEECH_EXPORT
 void DS_FreeStream(StreamingState* aSctx);
 
 /**
- * @brief Free memory allocated for metadata information.
+ * @brief Free memory allocated for metadata information. All transcripts and
+ *        tokens of @p m, including their text, are freed by this call.
  */
 DEEPSPEECH_EXPORT
 void DS_FreeMetadata(Metadata* m);
 
+/**
+ * @brief Free memory allocated for word-level results. All transcripts and
+ *        words of @p m, including their text, are freed by this call.
+ */
+DEEPSPEECH_EXPORT
+void DS_FreeWordMetadata(WordMetadataList* m);
+
 /**
  * @brief Free a char* string returned by the DeepSpeech API.
  */
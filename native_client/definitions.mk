@@ -19,7 +19,9 @@ PLATFORM_EXE_SUFFIX := .exe
 endif
 
 DEEPSPEECH_BIN       := deepspeech$(PLATFORM_EXE_SUFFIX)
-CFLAGS_DEEPSPEECH    := -std=c++11 -o $(DEEPSPEECH_BIN)
+CFLAGS_DEEPSPEECH    := -std=c++11 -pthread -o $(DEEPSPEECH_BIN)
+DS_BENCH_BIN         := ds_bench$(PLATFORM_EXE_SUFFIX)
+CFLAGS_DS_BENCH      := -std=c++11 -pthread -o $(DS_BENCH_BIN)
 LINK_DEEPSPEECH      := -ldeepspeech
 LINK_PATH_DEEPSPEECH := -L${TFDIR}/bazel-bin/native_client
 
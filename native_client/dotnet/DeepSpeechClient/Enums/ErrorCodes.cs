@@ -17,6 +17,14 @@
         DS_ERR_INVALID_SCORER = 0x2002,
         DS_ERR_MODEL_INCOMPATIBLE = 0x2003,
         DS_ERR_SCORER_NOT_ENABLED = 0x2004,
+        DS_ERR_INVALID_AUDIO_FORMAT = 0x2010,
+        DS_ERR_STATS_NOT_ENABLED = 0x2011,
+        DS_ERR_SCORER_NO_LOOKAHEAD = 0x2012,
+        DS_ERR_GREEDY_WITH_SCORER = 0x2013,
+        DS_ERR_INVALID_TIMING_MODE = 0x2014,
+        DS_ERR_INVALID_BEAM_PRUNING = 0x2015,
+        DS_ERR_INVALID_SNAPSHOT = 0x2016,
+        DS_ERR_SNAPSHOT_MISMATCH = 0x2017,
 
         // Runtime failures
         DS_ERR_FAIL_INIT_MMAP = 0x3000,
@@ -28,6 +36,7 @@
         DS_ERR_FAIL_CREATE_SESS = 0x3006,
         DS_ERR_FAIL_INSERT_HOTWORD = 0x3008,
         DS_ERR_FAIL_CLEAR_HOTWORD = 0x3009,
-        DS_ERR_FAIL_ERASE_HOTWORD = 0x3010
+        DS_ERR_FAIL_ERASE_HOTWORD = 0x3010,
+        DS_ERR_FAIL_SAVE_STREAM = 0x3011
     }
 }
@@ -0,0 +1,869 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <dirent.h>
+#include <getopt.h>
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "deepspeech.h"
+
+/* Benchmark of the inference pipeline over a directory of WAV files.
+
+   The files are loaded in memory first and fed to streams in chunks of
+   --chunk_ms milliseconds, as a live source would, through
+   DS_FeedAudioContentEx() so any sample rate, channel count and 16-bit or
+   float format is accepted. The benchmark then measures:
+
+   - startup: time to load the model and the scorer.
+
+   - single_stream: one stream at a time over all the files, --runs times.
+     Real-time factor is processing time over audio duration. Chunk latency
+     is the time spent in a single feed call, finish latency the time spent
+     in DS_FinishStream(), i.e. how long the final result takes once the
+     audio has ended. Per-stage figures come from DS_GetStats(), with
+     percentiles interpolated from its histograms.
+
+   - concurrency: 1, 2, 4... streams decoding in parallel threads for
+     --sweep_seconds each, until the worst stream falls behind real time or
+     the 99th percentile chunk latency exceeds --target_latency_ms. The last
+     level that passed gives the number of streams per core.
+
+   - memory: peak resident set size after startup and at the end.
+
+   - beam_sweep: with --beam_sweep, one pass over the files for each of the
+     given beam widths, with and without language model look-ahead when the
+     scorer has it, and with and without beam pruning when --beam_threshold
+     or --adaptive_beam is given. Word error rate is computed against
+     FILE.txt next to each FILE.wav, or against the widest beam without
+     look-ahead or pruning for files that have no transcript.
+
+   - snapshot: with --snapshot, one pass over the files where each stream is
+     saved with DS_SaveStream() halfway through its audio, freed, and
+     restored with DS_RestoreStream() to finish decoding, as when migrating
+     streams off a node. Reports snapshot sizes, save and restore latencies,
+     and how many transcripts differ from an uninterrupted decode.
+
+   The backend is the one libdeepspeech was built with, the report names it
+   after the model file type. Results are printed as a single JSON object on
+   stdout, and a summary on stderr.
+*/
+
+namespace {
+
+const char* model_path = nullptr;
+const char* scorer_path = nullptr;
+const char* audio_dir = nullptr;
+int beam_width = 0;
+int runs = 1;
+int warmup = 1;
+int chunk_ms = 20;
+double target_latency_ms = 0.;
+int max_streams = 0;
+double sweep_seconds = 10.;
+bool lm_lookahead = false;
+bool greedy = false;
+const char* timing = "tokens";
+int timing_mode = DS_TIMING_TOKENS;
+double beam_threshold = 0.;
+double mass_coverage = 0.;
+int min_beam_width = 1;
+bool beam_pruning = false;
+std::vector<int> beam_sweep;
+bool snapshot = false;
+
+typedef std::chrono::steady_clock bench_clock;
+
+double
+ElapsedMs(bench_clock::time_point start)
+{
+  return std::chrono::duration<double, std::milli>(bench_clock::now() - start).count();
+}
+
+struct audio_file {
+  std::string path;
+  std::vector<char> data;
+  unsigned int sample_rate;
+  unsigned int channels;
+  int format;
+  unsigned int frame_size;
+  std::string reference;
+  bool has_reference = false;
+
+  unsigned int num_frames() const { return data.size() / frame_size; }
+  double duration() const { return (double)num_frames() / sample_rate; }
+};
+
+uint32_t
+ReadLE(const char* p, int bytes)
+{
+  uint32_t value = 0;
+  for (int i = bytes - 1; i >= 0; --i) {
+    value = (value << 8) | (unsigned char)p[i];
+  }
+  return value;
+}
+
+// Load a RIFF WAVE file of 16-bit integer or 32-bit float samples
+bool
+LoadWav(const std::string& path, audio_file& out)
+{
+  std::ifstream in(path, std::ios::binary);
+  std::vector<char> bytes((std::istreambuf_iterator<char>(in)),
+                          std::istreambuf_iterator<char>());
+  if (bytes.size() < 12 || memcmp(&bytes[0], "RIFF", 4) || memcmp(&bytes[8], "WAVE", 4)) {
+    return false;
+  }
+
+  bool has_fmt = false;
+  size_t pos = 12;
+  while (pos + 8 <= bytes.size()) {
+    const char* chunk = &bytes[pos];
+    size_t size = ReadLE(chunk + 4, 4);
+    size_t body = pos + 8;
+    size = std::min(size, bytes.size() - body);
+    if (!memcmp(chunk, "fmt ", 4) && size >= 16) {
+      unsigned int tag = ReadLE(&bytes[body], 2);
+      if (tag == 0xFFFE && size >= 26) {
+        // WAVE_FORMAT_EXTENSIBLE, the actual format starts the subformat GUID
+        tag = ReadLE(&bytes[body + 24], 2);
+      }
+      out.channels = ReadLE(&bytes[body + 2], 2);
+      out.sample_rate = ReadLE(&bytes[body + 4], 4);
+      unsigned int bits = ReadLE(&bytes[body + 14], 2);
+      if (tag == 1 && bits == 16) {
+        out.format = DS_SAMPLE_FORMAT_S16;
+      } else if (tag == 3 && bits == 32) {
+        out.format = DS_SAMPLE_FORMAT_F32;
+      } else {
+        return false;
+      }
+      out.frame_size = out.channels * bits / 8;
+      has_fmt = out.channels > 0 && out.sample_rate > 0;
+    } else if (!memcmp(chunk, "data", 4) && has_fmt) {
+      out.data.assign(bytes.begin() + body,
+                      bytes.begin() + body + size / out.frame_size * out.frame_size);
+      out.path = path;
+      return true;
+    }
+    pos = body + size + (size & 1);
+  }
+  return false;
+}
+
+double
+Percentile(std::vector<double> values, double p)
+{
+  if (values.empty()) {
+    return 0.;
+  }
+  size_t rank = std::min(values.size() - 1, (size_t)(p / 100. * values.size()));
+  std::nth_element(values.begin(), values.begin() + rank, values.end());
+  return values[rank];
+}
+
+// Percentile of a StageStats histogram in milliseconds, interpolating
+// linearly inside the power of two bucket it falls in
+double
+HistogramPercentile(const StageStats& stage, double p)
+{
+  if (stage.count == 0) {
+    return 0.;
+  }
+  double rank = p / 100. * stage.count;
+  unsigned long long seen = 0;
+  for (int b = 0; b < DS_STATS_HISTOGRAM_BUCKETS; ++b) {
+    unsigned long long in_bucket = stage.histogram[b];
+    if (in_bucket > 0 && seen + in_bucket >= rank) {
+      double low = b == 0 ? 0. : (double)(1ull << b);
+      double high = std::min((double)(2ull << b), (double)stage.max_ns);
+      double ns = low + (high - low) * (rank - seen) / in_bucket;
+      return std::max(low, ns) / 1e6;
+    }
+    seen += in_bucket;
+  }
+  return stage.max_ns / 1e6;
+}
+
+void
+SubtractStats(PipelineStats& after, const PipelineStats& before)
+{
+  for (int s = 0; s < DS_STATS_NUM_STAGES; ++s) {
+    after.stages[s].count -= before.stages[s].count;
+    after.stages[s].total_ns -= before.stages[s].total_ns;
+    for (int b = 0; b < DS_STATS_HISTOGRAM_BUCKETS; ++b) {
+      after.stages[s].histogram[b] -= before.stages[s].histogram[b];
+    }
+  }
+  after.audio_samples -= before.audio_samples;
+  after.timesteps -= before.timesteps;
+  after.streams -= before.streams;
+  after.lm_cache_hits -= before.lm_cache_hits;
+  after.lm_cache_misses -= before.lm_cache_misses;
+  after.fst_lookups -= before.fst_lookups;
+}
+
+long
+PeakRssKb()
+{
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+  return usage.ru_maxrss / 1024;
+#else
+  return usage.ru_maxrss;
+#endif
+}
+
+struct stream_timing {
+  std::vector<double> chunk_ms;
+  std::vector<double> finish_ms;
+  double audio_seconds = 0.;
+  double processing_ms = 0.;
+};
+
+struct snapshot_timing {
+  std::vector<double> save_ms;
+  std::vector<double> restore_ms;
+  std::vector<double> bytes;
+};
+
+// Decode one file as a live stream, recording the time spent in each call.
+// With migration, the stream is saved halfway through the audio and the rest
+// is fed to a stream restored from the snapshot.
+bool
+DecodeFile(ModelState* ctx, const audio_file& file, stream_timing& timing,
+           std::string* transcript = nullptr, snapshot_timing* migration = nullptr)
+{
+  const unsigned int chunk_frames = std::max(1u, file.sample_rate * chunk_ms / 1000);
+  const unsigned int num_frames = file.num_frames();
+
+  bench_clock::time_point file_start = bench_clock::now();
+  StreamingState* stream;
+  if (DS_CreateStream(ctx, &stream) != DS_ERR_OK) {
+    return false;
+  }
+  if (lm_lookahead && DS_EnableStreamLMLookahead(stream) != DS_ERR_OK) {
+    DS_FreeStream(stream);
+    return false;
+  }
+  if (greedy && DS_EnableStreamGreedyDecoding(stream) != DS_ERR_OK) {
+    DS_FreeStream(stream);
+    return false;
+  }
+  if (DS_SetStreamTimingMode(stream, timing_mode) != DS_ERR_OK) {
+    DS_FreeStream(stream);
+    return false;
+  }
+  if (beam_pruning &&
+      DS_EnableStreamBeamPruning(stream, beam_threshold, mass_coverage, min_beam_width) != DS_ERR_OK) {
+    DS_FreeStream(stream);
+    return false;
+  }
+  bool migrated = false;
+  for (unsigned int frame = 0; frame < num_frames; frame += chunk_frames) {
+    if (migration && !migrated && frame >= num_frames / 2) {
+      migrated = true;
+      char* data;
+      unsigned int size;
+      bench_clock::time_point start = bench_clock::now();
+      int status = DS_SaveStream(stream, &data, &size);
+      migration->save_ms.push_back(ElapsedMs(start));
+      DS_FreeStream(stream);
+      if (status != DS_ERR_OK) {
+        return false;
+      }
+      migration->bytes.push_back(size);
+      start = bench_clock::now();
+      status = DS_RestoreStream(ctx, data, size, &stream);
+      migration->restore_ms.push_back(ElapsedMs(start));
+      DS_FreeSnapshot(data);
+      if (status != DS_ERR_OK) {
+        return false;
+      }
+    }
+    unsigned int frames = std::min(chunk_frames, num_frames - frame);
+    bench_clock::time_point start = bench_clock::now();
+    int status = DS_FeedAudioContentEx(stream, &file.data[frame * file.frame_size], frames,
+                                       file.sample_rate, file.channels, file.format);
+    timing.chunk_ms.push_back(ElapsedMs(start));
+    if (status != DS_ERR_OK) {
+      DS_FreeStream(stream);
+      return false;
+    }
+  }
+  bench_clock::time_point start = bench_clock::now();
+  char* text = DS_FinishStream(stream);
+  timing.finish_ms.push_back(ElapsedMs(start));
+  if (transcript) {
+    *transcript = text;
+  }
+  DS_FreeString(text);
+  timing.processing_ms += ElapsedMs(file_start);
+  timing.audio_seconds += file.duration();
+  return true;
+}
+
+std::vector<std::string>
+SplitWords(const std::string& text)
+{
+  std::istringstream in(text);
+  return std::vector<std::string>(std::istream_iterator<std::string>(in),
+                                  std::istream_iterator<std::string>());
+}
+
+// Word level Levenshtein distance
+size_t
+WordErrors(const std::vector<std::string>& ref, const std::vector<std::string>& hyp)
+{
+  std::vector<size_t> row(hyp.size() + 1);
+  for (size_t j = 0; j <= hyp.size(); ++j) {
+    row[j] = j;
+  }
+  for (size_t i = 1; i <= ref.size(); ++i) {
+    size_t diagonal = row[0];
+    row[0] = i;
+    for (size_t j = 1; j <= hyp.size(); ++j) {
+      size_t above = row[j];
+      row[j] = std::min(std::min(row[j] + 1, row[j - 1] + 1),
+                        diagonal + (ref[i - 1] == hyp[j - 1] ? 0 : 1));
+      diagonal = above;
+    }
+  }
+  return row[hyp.size()];
+}
+
+void
+PrintLatencies(std::ostream& out, const std::vector<double>& values)
+{
+  out << "{\"p50\":" << Percentile(values, 50.)
+      << ",\"p90\":" << Percentile(values, 90.)
+      << ",\"p99\":" << Percentile(values, 99.)
+      << ",\"max\":" << (values.empty() ? 0. : *std::max_element(values.begin(), values.end()))
+      << "}";
+}
+
+std::string
+JSONString(const std::string& in)
+{
+  std::ostringstream out;
+  out << '"';
+  for (char c : in) {
+    if (c == '"' || c == '\\') {
+      out << '\\' << c;
+    } else if ((unsigned char)c < 0x20) {
+      char buf[8];
+      snprintf(buf, sizeof(buf), "\\u%04x", c);
+      out << buf;
+    } else {
+      out << c;
+    }
+  }
+  out << '"';
+  return out.str();
+}
+
+void
+PrintHelp(const char* bin)
+{
+  std::cout <<
+  "Usage: " << bin << " --model MODEL [--scorer SCORER] --audio DIRECTORY\n"
+  "\n"
+  "Benchmark DeepSpeech inference over a directory of WAV files.\n"
+  "\n"
+  "\t--model MODEL\t\t\tPath to the model (protocol buffer binary file)\n"
+  "\t--scorer SCORER\t\t\tPath to the external scorer file\n"
+  "\t--audio DIRECTORY\t\tDirectory of WAV files (16-bit or float, any rate)\n"
+  "\t--beam_width BEAM_WIDTH\t\tValue for decoder beam width (int)\n"
+  "\t--runs NUMBER\t\t\tSingle stream passes over the files (default: 1)\n"
+  "\t--warmup NUMBER\t\t\tFiles decoded before measuring (default: 1)\n"
+  "\t--chunk_ms NUMBER\t\tDuration of the audio chunks fed to streams (default: 20)\n"
+  "\t--target_latency_ms NUMBER\t99th percentile chunk latency allowed under load (default: chunk duration)\n"
+  "\t--max_streams NUMBER\t\tMost concurrent streams tried (default: twice the number of cores, 0 to skip)\n"
+  "\t--sweep_seconds NUMBER\t\tDuration of each concurrency level (default: 10)\n"
+  "\t--lm_lookahead\t\t\tEnable language model look-ahead on all streams\n"
+  "\t--greedy\t\t\tUse greedy decoding on all streams, requires no --scorer\n"
+  "\t--timing MODE\t\t\tTiming tracked by all streams: tokens, words or none (default: tokens)\n"
+  "\t--beam_threshold NUMBER\t\tPrune hypotheses further than this below the best one (default: 0, off)\n"
+  "\t--adaptive_beam NUMBER\t\tKeep the hypotheses holding this share of the probability mass (default: 0, off)\n"
+  "\t--min_beam_width NUMBER\t\tFewest hypotheses kept by --adaptive_beam (default: 1)\n"
+  "\t--beam_sweep LIST\t\tComma separated beam widths to measure accuracy and speed at\n"
+  "\t--snapshot\t\t\tMeasure saving and restoring every stream halfway through\n"
+  "\t--help\t\t\t\tShow help\n";
+  exit(1);
+}
+
+bool
+ProcessArgs(int argc, char** argv)
+{
+  bool max_streams_set = false;
+  const option long_opts[] = {
+    {"model", required_argument, nullptr, 'm'},
+    {"scorer", required_argument, nullptr, 'l'},
+    {"audio", required_argument, nullptr, 'a'},
+    {"beam_width", required_argument, nullptr, 'b'},
+    {"runs", required_argument, nullptr, 'r'},
+    {"warmup", required_argument, nullptr, 'w'},
+    {"chunk_ms", required_argument, nullptr, 'c'},
+    {"target_latency_ms", required_argument, nullptr, 't'},
+    {"max_streams", required_argument, nullptr, 's'},
+    {"sweep_seconds", required_argument, nullptr, 'd'},
+    {"lm_lookahead", no_argument, nullptr, 'k'},
+    {"greedy", no_argument, nullptr, 'g'},
+    {"timing", required_argument, nullptr, 'i'},
+    {"beam_threshold", required_argument, nullptr, 'p'},
+    {"adaptive_beam", required_argument, nullptr, 'v'},
+    {"min_beam_width", required_argument, nullptr, 'n'},
+    {"beam_sweep", required_argument, nullptr, 'e'},
+    {"snapshot", no_argument, nullptr, 'x'},
+    {"help", no_argument, nullptr, 'h'},
+    {nullptr, no_argument, nullptr, 0}
+  };
+
+  while (true) {
+    const auto opt = getopt_long(argc, argv, "", long_opts, nullptr);
+    if (opt == -1) {
+      break;
+    }
+    switch (opt) {
+    case 'm': model_path = optarg; break;
+    case 'l': scorer_path = optarg; break;
+    case 'a': audio_dir = optarg; break;
+    case 'b': beam_width = atoi(optarg); break;
+    case 'r': runs = atoi(optarg); break;
+    case 'w': warmup = atoi(optarg); break;
+    case 'c': chunk_ms = atoi(optarg); break;
+    case 't': target_latency_ms = atof(optarg); break;
+    case 's': max_streams = atoi(optarg); max_streams_set = true; break;
+    case 'd': sweep_seconds = atof(optarg); break;
+    case 'k': lm_lookahead = true; break;
+    case 'g': greedy = true; break;
+    case 'i': timing = optarg; break;
+    case 'p': beam_threshold = atof(optarg); break;
+    case 'v': mass_coverage = atof(optarg); break;
+    case 'n': min_beam_width = atoi(optarg); break;
+    case 'e': {
+      std::istringstream list(optarg);
+      std::string width;
+      while (std::getline(list, width, ',')) {
+        beam_sweep.push_back(atoi(width.c_str()));
+      }
+    } break;
+    case 'x': snapshot = true; break;
+    default: PrintHelp(argv[0]); break;
+    }
+  }
+
+  if (strcmp(timing, "tokens") == 0) {
+    timing_mode = DS_TIMING_TOKENS;
+  } else if (strcmp(timing, "words") == 0) {
+    timing_mode = DS_TIMING_WORDS;
+  } else if (strcmp(timing, "none") == 0) {
+    timing_mode = DS_TIMING_NONE;
+  } else {
+    PrintHelp(argv[0]);
+    return false;
+  }
+
+  if (!model_path || !audio_dir || runs < 1 || warmup < 0 || chunk_ms < 1 ||
+      max_streams < 0 || sweep_seconds <= 0. || beam_threshold < 0. ||
+      mass_coverage < 0. || mass_coverage > 1. || min_beam_width < 1 ||
+      std::any_of(beam_sweep.begin(), beam_sweep.end(), [](int w) { return w < 1; })) {
+    PrintHelp(argv[0]);
+    return false;
+  }
+  beam_pruning = beam_threshold > 0. || mass_coverage > 0.;
+  if (target_latency_ms <= 0.) {
+    target_latency_ms = chunk_ms;
+  }
+  if (!max_streams_set) {
+    max_streams = 2 * std::max(1u, std::thread::hardware_concurrency());
+  }
+  return true;
+}
+
+} // namespace
+
+int
+main(int argc, char** argv)
+{
+  if (!ProcessArgs(argc, argv)) {
+    return 1;
+  }
+
+  const unsigned int cores = std::max(1u, std::thread::hardware_concurrency());
+  std::string model_name(model_path);
+  const bool tflite = model_name.size() > 7 &&
+                      model_name.compare(model_name.size() - 7, 7, ".tflite") == 0;
+
+  // Startup
+  bench_clock::time_point start = bench_clock::now();
+  ModelState* ctx;
+  int status = DS_CreateModel(model_path, &ctx);
+  if (status != DS_ERR_OK) {
+    char* error = DS_ErrorCodeToErrorMessage(status);
+    fprintf(stderr, "Could not create model: %s\n", error);
+    DS_FreeString(error);
+    return 1;
+  }
+  const double model_load_ms = ElapsedMs(start);
+
+  double scorer_load_ms = 0.;
+  if (scorer_path) {
+    start = bench_clock::now();
+    status = DS_EnableExternalScorer(ctx, scorer_path);
+    if (status != DS_ERR_OK) {
+      fprintf(stderr, "Could not enable external scorer.\n");
+      DS_FreeModel(ctx);
+      return 1;
+    }
+    scorer_load_ms = ElapsedMs(start);
+  }
+  if (beam_width > 0) {
+    DS_SetModelBeamWidth(ctx, beam_width);
+  }
+  // Streams are created for every file, like a server would, so reuse them
+  DS_SetStreamPoolSize(ctx, max_streams + 1);
+  const long rss_after_load_kb = PeakRssKb();
+
+  // Audio, sorted so runs are reproducible
+  std::vector<audio_file> files;
+  DIR* dir = opendir(audio_dir);
+  if (!dir) {
+    fprintf(stderr, "Could not open %s\n", audio_dir);
+    DS_FreeModel(ctx);
+    return 1;
+  }
+  std::vector<std::string> names;
+  struct dirent* entry;
+  while ((entry = readdir(dir)) != NULL) {
+    std::string name(entry->d_name);
+    if (name.size() > 4 && name.compare(name.size() - 4, 4, ".wav") == 0) {
+      names.push_back(std::string(audio_dir) + "/" + name);
+    }
+  }
+  closedir(dir);
+  std::sort(names.begin(), names.end());
+  for (const std::string& name : names) {
+    audio_file file;
+    if (LoadWav(name, file) && file.num_frames() > 0) {
+      std::ifstream reference(name.substr(0, name.size() - 4) + ".txt");
+      if (reference) {
+        std::getline(reference, file.reference);
+        file.has_reference = true;
+      }
+      files.push_back(std::move(file));
+    } else {
+      fprintf(stderr, "Skipping %s: not a 16-bit or float WAV file\n", name.c_str());
+    }
+  }
+  if (files.empty()) {
+    fprintf(stderr, "No usable WAV file in %s\n", audio_dir);
+    DS_FreeModel(ctx);
+    return 1;
+  }
+
+  double total_audio = 0.;
+  for (const audio_file& file : files) {
+    total_audio += file.duration();
+  }
+
+  for (int i = 0; i < warmup; ++i) {
+    stream_timing ignored;
+    DecodeFile(ctx, files[i % files.size()], ignored);
+  }
+
+  // Single stream
+  PipelineStats stats_before, stats_after;
+  const bool has_stats = DS_GetStats(ctx, nullptr, &stats_before) == DS_ERR_OK;
+  stream_timing single;
+  for (int run = 0; run < runs; ++run) {
+    for (const audio_file& file : files) {
+      if (!DecodeFile(ctx, file, single) || single.audio_seconds <= 0.) {
+        fprintf(stderr, "Could not decode %s\n", file.path.c_str());
+        DS_FreeModel(ctx);
+        return 1;
+      }
+    }
+  }
+  if (has_stats) {
+    DS_GetStats(ctx, nullptr, &stats_after);
+    SubtractStats(stats_after, stats_before);
+  }
+  const double single_rtf = single.processing_ms / 1000. / single.audio_seconds;
+
+  // Concurrency sweep
+  struct level_result {
+    int streams;
+    double worst_rtf;
+    double chunk_p99_ms;
+    double audio_seconds;
+    int failures;
+    bool passed;
+  };
+  std::vector<level_result> levels;
+  int streams_at_target = 0;
+  for (int streams = 1; streams <= max_streams; streams *= 2) {
+    std::vector<stream_timing> timings(streams);
+    // A stream that can't be created or fed gives no timings, count it
+    // instead so the level doesn't pass by measuring nothing
+    std::vector<int> failures(streams, 0);
+    std::vector<std::thread> threads;
+    bench_clock::time_point level_start = bench_clock::now();
+    for (int t = 0; t < streams; ++t) {
+      threads.emplace_back([&, t]() {
+        size_t next = t;
+        do {
+          if (!DecodeFile(ctx, files[next++ % files.size()], timings[t])) {
+            ++failures[t];
+            break;
+          }
+        } while (ElapsedMs(level_start) < sweep_seconds * 1000.);
+      });
+    }
+    for (std::thread& thread : threads) {
+      thread.join();
+    }
+
+    level_result level = {streams, 0., 0., 0., 0, false};
+    std::vector<double> chunks;
+    for (const stream_timing& timing : timings) {
+      if (timing.audio_seconds > 0.) {
+        level.worst_rtf = std::max(level.worst_rtf,
+                                   timing.processing_ms / 1000. / timing.audio_seconds);
+      }
+      level.audio_seconds += timing.audio_seconds;
+      chunks.insert(chunks.end(), timing.chunk_ms.begin(), timing.chunk_ms.end());
+    }
+    for (int failed : failures) {
+      level.failures += failed;
+    }
+    level.chunk_p99_ms = Percentile(chunks, 99.);
+    level.passed = level.failures == 0 && level.worst_rtf <= 1. &&
+                   level.chunk_p99_ms <= target_latency_ms;
+    levels.push_back(level);
+    if (!level.passed) {
+      break;
+    }
+    streams_at_target = streams;
+  }
+
+  // Beam width sweep, widest beam first as it gives the missing references
+  struct sweep_result {
+    int beam_width;
+    bool lm_lookahead;
+    bool pruned;
+    double rtf;
+    double wer;
+  };
+  std::vector<sweep_result> sweep;
+  std::sort(beam_sweep.begin(), beam_sweep.end(), std::greater<int>());
+  bool sweep_lookahead = false;
+  if (!beam_sweep.empty() && scorer_path) {
+    StreamingState* stream;
+    if (DS_CreateStream(ctx, &stream) == DS_ERR_OK) {
+      sweep_lookahead = DS_EnableStreamLMLookahead(stream) == DS_ERR_OK;
+      DS_FreeStream(stream);
+    }
+    if (!sweep_lookahead) {
+      fprintf(stderr, "Scorer has no look-ahead scores, sweeping without it only\n");
+    }
+  }
+  const unsigned int model_beam_width = DS_GetModelBeamWidth(ctx);
+  const bool lm_lookahead_option = lm_lookahead;
+  const bool beam_pruning_option = beam_pruning;
+  std::vector<std::vector<std::string>> references(files.size());
+  for (size_t f = 0; f < files.size(); ++f) {
+    if (files[f].has_reference) {
+      references[f] = SplitWords(files[f].reference);
+    }
+  }
+  for (int with_lookahead = 0; with_lookahead <= (sweep_lookahead ? 1 : 0); ++with_lookahead) {
+    lm_lookahead = with_lookahead != 0;
+    for (int pruned = 0; pruned <= (beam_pruning_option ? 1 : 0); ++pruned) {
+      beam_pruning = pruned != 0;
+      for (int width : beam_sweep) {
+        DS_SetModelBeamWidth(ctx, width);
+        stream_timing timing;
+        size_t errors = 0;
+        size_t words = 0;
+        for (size_t f = 0; f < files.size(); ++f) {
+          std::string transcript;
+          if (!DecodeFile(ctx, files[f], timing, &transcript)) {
+            fprintf(stderr, "Could not decode %s\n", files[f].path.c_str());
+            DS_FreeModel(ctx);
+            return 1;
+          }
+          std::vector<std::string> hypothesis = SplitWords(transcript);
+          if (!files[f].has_reference && !with_lookahead && !pruned && width == beam_sweep[0]) {
+            references[f] = hypothesis;
+          }
+          errors += WordErrors(references[f], hypothesis);
+          words += references[f].size();
+        }
+        sweep.push_back({width, lm_lookahead, beam_pruning,
+                         timing.processing_ms / 1000. / timing.audio_seconds,
+                         words ? (double)errors / words : 0.});
+      }
+    }
+  }
+  lm_lookahead = lm_lookahead_option;
+  beam_pruning = beam_pruning_option;
+  DS_SetModelBeamWidth(ctx, model_beam_width);
+
+  // Snapshots, against the same files decoded without interruption
+  snapshot_timing migration;
+  size_t snapshot_mismatches = 0;
+  if (snapshot) {
+    for (const audio_file& file : files) {
+      stream_timing ignored;
+      std::string expected, restored;
+      if (!DecodeFile(ctx, file, ignored, &expected) ||
+          !DecodeFile(ctx, file, ignored, &restored, &migration)) {
+        fprintf(stderr, "Could not migrate %s\n", file.path.c_str());
+        DS_FreeModel(ctx);
+        return 1;
+      }
+      if (restored != expected) {
+        ++snapshot_mismatches;
+      }
+    }
+  }
+
+  const long peak_rss_kb = PeakRssKb();
+  DS_FreeModel(ctx);
+
+  // Report
+  static const char* const stage_names[DS_STATS_NUM_STAGES] = {
+    "mfcc", "inference", "decode", "lm_query", "extend", "result"
+  };
+  char* version = DS_Version();
+  std::ostringstream out;
+  out << "{\"version\":" << JSONString(version)
+      << ",\"backend\":\"" << (tflite ? "tflite" : "tensorflow") << "\""
+      << ",\"model\":" << JSONString(model_path)
+      << ",\"scorer\":" << (scorer_path ? JSONString(scorer_path) : "null")
+      << ",\"beam_width\":" << beam_width
+      << ",\"lm_lookahead\":" << (lm_lookahead ? "true" : "false")
+      << ",\"greedy\":" << (greedy ? "true" : "false")
+      << ",\"timing\":" << JSONString(timing)
+      << ",\"beam_threshold\":" << beam_threshold
+      << ",\"adaptive_beam\":" << mass_coverage
+      << ",\"min_beam_width\":" << min_beam_width
+      << ",\"chunk_ms\":" << chunk_ms
+      << ",\"cores\":" << cores
+      << ",\"files\":" << files.size()
+      << ",\"audio_seconds\":" << total_audio;
+  DS_FreeString(version);
+
+  out << ",\"startup\":{\"model_load_ms\":" << model_load_ms
+      << ",\"scorer_load_ms\":" << scorer_load_ms << "}";
+
+  out << ",\"single_stream\":{\"runs\":" << runs
+      << ",\"processing_seconds\":" << single.processing_ms / 1000.
+      << ",\"rtf\":" << single_rtf
+      << ",\"chunk_latency_ms\":";
+  PrintLatencies(out, single.chunk_ms);
+  out << ",\"finish_latency_ms\":";
+  PrintLatencies(out, single.finish_ms);
+  out << ",\"stages\":";
+  if (has_stats) {
+    out << "{";
+    for (int s = 0; s < DS_STATS_NUM_STAGES; ++s) {
+      const StageStats& stage = stats_after.stages[s];
+      out << (s ? "," : "") << "\"" << stage_names[s] << "\":{"
+          << "\"count\":" << stage.count
+          << ",\"total_ms\":" << stage.total_ns / 1e6
+          << ",\"mean_ms\":" << (stage.count ? stage.total_ns / 1e6 / stage.count : 0.)
+          << ",\"p50_ms\":" << HistogramPercentile(stage, 50.)
+          << ",\"p90_ms\":" << HistogramPercentile(stage, 90.)
+          << ",\"p99_ms\":" << HistogramPercentile(stage, 99.)
+          << "}";
+    }
+    const unsigned long long lm_queries = stats_after.lm_cache_hits + stats_after.lm_cache_misses;
+    out << "},\"lm_cache_hit_rate\":"
+        << (lm_queries ? (double)stats_after.lm_cache_hits / lm_queries : 0.)
+        << ",\"fst_lookups\":" << stats_after.fst_lookups;
+  } else {
+    out << "null";
+  }
+  out << "}";
+
+  out << ",\"concurrency\":{\"target_latency_ms\":" << target_latency_ms
+      << ",\"sweep_seconds\":" << sweep_seconds
+      << ",\"levels\":[";
+  for (size_t i = 0; i < levels.size(); ++i) {
+    const level_result& level = levels[i];
+    out << (i ? "," : "") << "{\"streams\":" << level.streams
+        << ",\"worst_rtf\":" << level.worst_rtf
+        << ",\"chunk_p99_ms\":" << level.chunk_p99_ms
+        << ",\"audio_seconds\":" << level.audio_seconds
+        << ",\"failures\":" << level.failures
+        << ",\"passed\":" << (level.passed ? "true" : "false") << "}";
+  }
+  out << "],\"streams_at_target\":" << streams_at_target
+      << ",\"streams_per_core\":" << (double)streams_at_target / cores << "}";
+
+  out << ",\"beam_sweep\":[";
+  for (size_t i = 0; i < sweep.size(); ++i) {
+    out << (i ? "," : "") << "{\"beam_width\":" << sweep[i].beam_width
+        << ",\"lm_lookahead\":" << (sweep[i].lm_lookahead ? "true" : "false")
+        << ",\"pruned\":" << (sweep[i].pruned ? "true" : "false")
+        << ",\"rtf\":" << sweep[i].rtf
+        << ",\"wer\":" << sweep[i].wer << "}";
+  }
+  out << "]";
+
+  out << ",\"snapshot\":";
+  if (snapshot) {
+    out << "{\"streams\":" << migration.bytes.size()
+        << ",\"bytes\":";
+    PrintLatencies(out, migration.bytes);
+    out << ",\"save_ms\":";
+    PrintLatencies(out, migration.save_ms);
+    out << ",\"restore_ms\":";
+    PrintLatencies(out, migration.restore_ms);
+    out << ",\"mismatches\":" << snapshot_mismatches << "}";
+  } else {
+    out << "null";
+  }
+
+  out << ",\"memory\":{\"peak_rss_after_load_kb\":" << rss_after_load_kb
+      << ",\"peak_rss_kb\":" << peak_rss_kb << "}}";
+
+  std::cout << out.str() << std::endl;
+
+  fprintf(stderr, "%s backend, %zu files, %.1f s of audio\n",
+          tflite ? "TFLite" : "TensorFlow", files.size(), total_audio);
+  fprintf(stderr, "startup: model %.1f ms, scorer %.1f ms\n", model_load_ms, scorer_load_ms);
+  fprintf(stderr, "single stream: RTF %.3f, chunk p99 %.2f ms, finish p99 %.2f ms\n",
+          single_rtf, Percentile(single.chunk_ms, 99.), Percentile(single.finish_ms, 99.));
+  fprintf(stderr, "concurrency: %d streams within %.1f ms (%.2f per core)\n",
+          streams_at_target, target_latency_ms, (double)streams_at_target / cores);
+  for (const sweep_result& result : sweep) {
+    fprintf(stderr, "beam %d%s%s: RTF %.3f, WER %.4f\n", result.beam_width,
+            result.lm_lookahead ? " with look-ahead" : "",
+            result.pruned ? " pruned" : "", result.rtf, result.wer);
+  }
+  if (snapshot) {
+    fprintf(stderr, "snapshot: p99 %.0f bytes, save p99 %.3f ms, restore p99 %.3f ms, %zu mismatches\n",
+            Percentile(migration.bytes, 99.), Percentile(migration.save_ms, 99.),
+            Percentile(migration.restore_ms, 99.), snapshot_mismatches);
+  }
+  fprintf(stderr, "peak RSS: %ld kB after startup, %ld kB overall\n",
+          rss_after_load_kb, peak_rss_kb);
+
+  return 0;
+}
@@ -1,13 +1,30 @@
 #include <string>
 #include <vector>
 #include <fstream>
+#include <sstream>
 #include <unordered_set>
 #include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <iterator>
 using namespace std;
 
+#if defined(__linux__)
+#include <unistd.h>
+#endif
+
 #include "absl/types/optional.h"
 #include "boost/program_options.hpp"
 
+#include "lm/config.hh"
+#include "lm/model.hh"
+#include "lm/state.hh"
+#include "util/exception.hh"
+#include "util/file.hh"
+
 #include "ctcdecode/decoder_utils.h"
 #include "ctcdecode/scorer.h"
 #include "alphabet.h"
@@ -15,6 +32,244 @@ using namespace std;
 
 namespace po = boost::program_options;
 
+// KenLM data structure and quantization to build the language model with
+struct lm_variant {
+    lm::ngram::ModelType type;
+    int prob_bits;
+    int backoff_bits;
+    int bhiksha_bits;
+
+    string name() const
+    {
+        ostringstream out;
+        switch (type) {
+        case lm::ngram::PROBING:          out << "probing"; break;
+        case lm::ngram::TRIE:             out << "trie"; break;
+        case lm::ngram::QUANT_TRIE:       out << "quant trie"; break;
+        case lm::ngram::ARRAY_TRIE:       out << "array trie"; break;
+        case lm::ngram::QUANT_ARRAY_TRIE: out << "quant array trie"; break;
+        default:                          out << "type " << type; break;
+        }
+        if (type == lm::ngram::QUANT_TRIE || type == lm::ngram::QUANT_ARRAY_TRIE) {
+            out << " q" << prob_bits << "/b" << backoff_bits;
+        }
+        if (type == lm::ngram::ARRAY_TRIE || type == lm::ngram::QUANT_ARRAY_TRIE) {
+            out << " a" << bhiksha_bits;
+        }
+        return out.str();
+    }
+};
+
+// Build a KenLM binary from an ARPA file, like KenLM's build_binary -v
+int
+build_lm_binary(const string& arpa_path,
+                const lm_variant& variant,
+                const string& binary_path,
+                bool show_progress = true)
+{
+    lm::ngram::Config config;
+    config.show_progress = show_progress;
+    config.write_mmap = binary_path.c_str();
+    config.write_method = lm::ngram::Config::WRITE_AFTER;
+    // The scorer package trie holds the vocabulary
+    config.include_vocab = false;
+    config.prob_bits = variant.prob_bits;
+    config.backoff_bits = variant.backoff_bits;
+    config.pointer_bhiksha_bits = variant.bhiksha_bits;
+    try {
+        unique_ptr<lm::base::Model> model(
+            lm::ngram::LoadVirtual(arpa_path.c_str(), config, variant.type));
+    } catch (const util::Exception& e) {
+        cerr << "Error building " << variant.name() << " language model: "
+             << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
+
+// Resident set size of the process in kB, -1 if unknown
+long
+resident_kb()
+{
+#if defined(__linux__)
+    ifstream statm("/proc/self/statm");
+    long size, resident;
+    if (statm >> size >> resident) {
+        return resident * (sysconf(_SC_PAGESIZE) / 1024);
+    }
+#endif
+    return -1;
+}
+
+// Every stride-th n-gram of an ARPA file, about count of them in total
+vector<vector<string>>
+sample_arpa_ngrams(const string& arpa_path, size_t count)
+{
+    vector<vector<string>> ngrams;
+    ifstream fin(arpa_path);
+    string line;
+    uint64_t total = 0;
+    while (getline(fin, line) && line.find("-grams:") == string::npos) {
+        if (line.compare(0, 6, "ngram ") == 0) {
+            total += stoull(line.substr(line.find('=') + 1));
+        }
+    }
+    const uint64_t stride = max<uint64_t>(1, total / max<size_t>(1, count));
+    uint64_t index = 0;
+    while (getline(fin, line)) {
+        if (line.empty() || line[0] == '\\') {
+            continue;
+        }
+        if (index++ % stride != 0) {
+            continue;
+        }
+        // probability, tab, words separated by spaces, optional tab and backoff
+        size_t begin = line.find('\t');
+        if (begin == string::npos) {
+            continue;
+        }
+        size_t end = line.find('\t', begin + 1);
+        istringstream words(line.substr(begin + 1, end == string::npos ? string::npos : end - begin - 1));
+        ngrams.emplace_back(istream_iterator<string>(words), istream_iterator<string>());
+    }
+    return ngrams;
+}
+
+struct variant_report {
+    uint64_t file_bytes;
+    long resident_kb;
+    double queries_per_second;
+    vector<float> scores;
+};
+
+// Load a KenLM binary the way the decoder does and time queries of ngrams
+bool
+measure_lm_binary(const string& binary_path,
+                  const vector<vector<string>>& ngrams,
+                  variant_report& report)
+{
+    {
+        util::scoped_fd fd(util::OpenReadOrThrow(binary_path.c_str()));
+        report.file_bytes = util::SizeFile(fd.get());
+    }
+
+    const long resident_before = resident_kb();
+    lm::ngram::Config config;
+    config.load_method = util::LoadMethod::LAZY;
+    unique_ptr<lm::base::Model> model;
+    try {
+        model.reset(lm::ngram::LoadVirtual(binary_path.c_str(), config));
+    } catch (const util::Exception& e) {
+        cerr << "Error loading " << binary_path << ": " << e.what() << "\n";
+        return false;
+    }
+
+    // Word ids differ between data structures, look them up outside the timing
+    vector<vector<lm::WordIndex>> ids(ngrams.size());
+    vector<bool> bos(ngrams.size(), false);
+    for (size_t i = 0; i < ngrams.size(); ++i) {
+        for (const string& word : ngrams[i]) {
+            if (word == "<s>") {
+                bos[i] = true;
+            } else {
+                ids[i].push_back(model->BaseVocabulary().Index(word));
+            }
+        }
+    }
+
+    // One pass to fault the pages in, then repeat passes for at least a second
+    report.scores.assign(ngrams.size(), 0.f);
+    lm::ngram::State states[2];
+    auto score_all = [&]() {
+        for (size_t i = 0; i < ids.size(); ++i) {
+            if (bos[i]) {
+                model->BeginSentenceWrite(&states[0]);
+            } else {
+                model->NullContextWrite(&states[0]);
+            }
+            float score = 0.f;
+            for (size_t j = 0; j < ids[i].size(); ++j) {
+                score += model->BaseScore(&states[j % 2], ids[i][j], &states[(j + 1) % 2]);
+            }
+            report.scores[i] = score;
+        }
+    };
+    score_all();
+    report.resident_kb = resident_before < 0 ? -1 : resident_kb() - resident_before;
+
+    using bench_clock = chrono::steady_clock;
+    const bench_clock::time_point start = bench_clock::now();
+    double seconds = 0.;
+    uint64_t queries = 0;
+    while (seconds < 1. && !ids.empty()) {
+        score_all();
+        queries += ids.size();
+        seconds = chrono::duration<double>(bench_clock::now() - start).count();
+    }
+    report.queries_per_second = seconds > 0. ? queries / seconds : 0.;
+    return true;
+}
+
+/* Build every data structure KenLM offers from arpa_path and print how they
+ * compare: file size, memory touched by the queries, query throughput and
+ * how far the quantized scores are from the exact ones.
+ */
+int
+report_lm_variants(const string& arpa_path,
+                   const string& scratch_path,
+                   int prob_bits,
+                   int backoff_bits,
+                   int bhiksha_bits,
+                   size_t num_ngrams)
+{
+    const vector<lm_variant> variants = {
+        {lm::ngram::PROBING, prob_bits, backoff_bits, bhiksha_bits},
+        {lm::ngram::TRIE, prob_bits, backoff_bits, bhiksha_bits},
+        {lm::ngram::ARRAY_TRIE, prob_bits, backoff_bits, bhiksha_bits},
+        {lm::ngram::QUANT_TRIE, prob_bits, backoff_bits, bhiksha_bits},
+        {lm::ngram::QUANT_ARRAY_TRIE, prob_bits, backoff_bits, bhiksha_bits},
+    };
+
+    const vector<vector<string>> ngrams = sample_arpa_ngrams(arpa_path, num_ngrams);
+    cerr << "Comparing language model variants on " << ngrams.size()
+         << " n-grams sampled from " << arpa_path << ".\n";
+
+    vector<variant_report> reports(variants.size());
+    for (size_t v = 0; v < variants.size(); ++v) {
+        cerr << "Building " << variants[v].name() << " variant.\n";
+        bool ok = build_lm_binary(arpa_path, variants[v], scratch_path, false) == 0 &&
+                  measure_lm_binary(scratch_path, ngrams, reports[v]);
+        remove(scratch_path.c_str());
+        if (!ok) {
+            return 1;
+        }
+    }
+
+    // Probing stores the scores unchanged, quantization errors are relative to it
+    cerr << "\n" << left << setw(28) << "variant"
+         << right << setw(12) << "size (MB)"
+         << setw(16) << "resident (MB)"
+         << setw(14) << "queries/s"
+         << setw(16) << "max log10 err" << "\n";
+    for (size_t v = 0; v < variants.size(); ++v) {
+        float max_error = 0.f;
+        for (size_t i = 0; i < ngrams.size(); ++i) {
+            max_error = max(max_error, fabs(reports[v].scores[i] - reports[0].scores[i]));
+        }
+        cerr << left << setw(28) << variants[v].name() << right << fixed
+             << setprecision(2) << setw(12) << reports[v].file_bytes / 1048576.;
+        if (reports[v].resident_kb >= 0) {
+            cerr << setw(16) << reports[v].resident_kb / 1024.;
+        } else {
+            cerr << setw(16) << "n/a";
+        }
+        cerr << setprecision(0) << setw(14) << reports[v].queries_per_second
+             << setprecision(4) << setw(16) << max_error << "\n";
+    }
+    cerr << "\n";
+    return 0;
+}
+
 int
 create_package(absl::optional<string> alphabet_path,
                string lm_path,
@@ -73,9 +328,12 @@ create_package(absl::optional<string> alphabet_path,
         return 1;
     }
     scorer.fill_dictionary(words);
+    if (!scorer.word_ids) {
+        cerr << "Vocabulary words are not single characters, not storing word ids.\n";
+    }
 
-    // Copy LM file to final package file destination
-    {
+    // Copy LM file to final package file destination, unless it was built there
+    if (lm_path != package_path) {
         ifstream lm_src(lm_path, std::ios::binary);
         ofstream package_dest(package_path, std::ios::binary);
         package_dest << lm_src.rdbuf();
@@ -99,11 +357,18 @@ main(int argc, char** argv)
         ("help", "show help message")
         ("alphabet", po::value<string>(), "Path of alphabet file to use for vocabulary construction. Words with characters not in the alphabet will not be included in the vocabulary. Optional if using bytes output mode.")
         ("lm", po::value<string>(), "Path of KenLM binary LM file. Must be built without including the vocabulary (use the -v flag). See generate_lm.py for how to create a binary LM.")
+        ("arpa", po::value<string>(), "Path of an ARPA LM file to build the KenLM binary from, instead of --lm. See --lm_type, --prob_bits, --backoff_bits and --bhiksha_bits.")
         ("vocab", po::value<string>(), "Path of vocabulary file. Must contain words separated by whitespace.")
         ("package", po::value<string>(), "Path to save scorer package.")
         ("default_alpha", po::value<float>(), "Default value of alpha hyperparameter (float).")
         ("default_beta", po::value<float>(), "Default value of beta hyperparameter (float).")
         ("force_bytes_output_mode", po::value<bool>(), "Boolean flag, force set or unset bytes output mode in the scorer package. If not set, infers from the vocabulary. See <https://deepspeech.readthedocs.io/en/master/Decoder.html#bytes-output-mode> for further explanation.")
+        ("lm_type", po::value<string>(), "With --arpa, KenLM data structure to build: trie (compact, default) or probing (fastest, largest).")
+        ("prob_bits", po::value<int>(), "With --arpa and a trie, quantize probabilities to this many bits (1 to 25).")
+        ("backoff_bits", po::value<int>(), "With --arpa and a trie, quantize backoffs to this many bits (1 to 25). Defaults to --prob_bits.")
+        ("bhiksha_bits", po::value<int>(), "With --arpa and a trie, compress trie pointers with at most this many bits (255 for the best compression).")
+        ("report", "With --arpa, build every KenLM data structure first and print their size, resident memory, query throughput and quantization error.")
+        ("report_ngrams", po::value<int>()->default_value(100000), "Number of n-grams of the ARPA file queried by --report.")
     ;
 
     po::variables_map vm;
@@ -116,12 +381,16 @@ main(int argc, char** argv)
     }
 
     // Check required flags.
-    for (const string& flag : {"lm", "vocab", "package", "default_alpha", "default_beta"}) {
+    for (const string& flag : {"vocab", "package", "default_alpha", "default_beta"}) {
         if (!vm.count(flag)) {
             cerr << "--" << flag << " is a required flag. Pass --help for help.\n";
             return 1;
         }
     }
+    if (vm.count("lm") == vm.count("arpa")) {
+        cerr << "Exactly one of --lm and --arpa is required. Pass --help for help.\n";
+        return 1;
+    }
 
     // Parse optional --force_bytes_output_mode
     absl::optional<bool> force_bytes_output_mode = absl::nullopt;
@@ -135,13 +404,68 @@ main(int argc, char** argv)
         alphabet = vm["alphabet"].as<string>();
     }
 
-    create_package(alphabet,
-                   vm["lm"].as<string>(),
-                   vm["vocab"].as<string>(),
-                   vm["package"].as<string>(),
-                   force_bytes_output_mode,
-                   vm["default_alpha"].as<float>(),
-                   vm["default_beta"].as<float>());
+    const string package_path = vm["package"].as<string>();
+    string lm_path;
+    if (vm.count("lm")) {
+        for (const string& flag : {"lm_type", "prob_bits", "backoff_bits", "bhiksha_bits", "report"}) {
+            if (vm.count(flag)) {
+                cerr << "--" << flag << " requires --arpa.\n";
+                return 1;
+            }
+        }
+        lm_path = vm["lm"].as<string>();
+    } else {
+        // Parse the KenLM build flags, with build_binary's defaults
+        const string lm_type = vm.count("lm_type") ? vm["lm_type"].as<string>() : "trie";
+        const bool quantize = vm.count("prob_bits") || vm.count("backoff_bits");
+        const int prob_bits = vm.count("prob_bits") ? vm["prob_bits"].as<int>() : 8;
+        const int backoff_bits = vm.count("backoff_bits") ? vm["backoff_bits"].as<int>() : prob_bits;
+        const int bhiksha_bits = vm.count("bhiksha_bits") ? vm["bhiksha_bits"].as<int>() : 22;
+        lm_variant variant = {lm::ngram::TRIE, prob_bits, backoff_bits, bhiksha_bits};
+        if (lm_type == "probing") {
+            if (quantize || vm.count("bhiksha_bits")) {
+                cerr << "--prob_bits, --backoff_bits and --bhiksha_bits require --lm_type trie.\n";
+                return 1;
+            }
+            variant.type = lm::ngram::PROBING;
+        } else if (lm_type == "trie") {
+            if (quantize) {
+                variant.type = static_cast<lm::ngram::ModelType>(variant.type + lm::ngram::kQuantAdd);
+            }
+            if (vm.count("bhiksha_bits")) {
+                variant.type = static_cast<lm::ngram::ModelType>(variant.type + lm::ngram::kArrayAdd);
+            }
+        } else {
+            cerr << "Unknown --lm_type " << lm_type << ", use trie or probing.\n";
+            return 1;
+        }
+        if (prob_bits < 1 || prob_bits > 25 || backoff_bits < 1 || backoff_bits > 25 ||
+            bhiksha_bits < 0 || bhiksha_bits > 255) {
+            cerr << "Invalid number of bits for quantization or pointer compression.\n";
+            return 1;
+        }
 
-    return 0;
+        const string arpa_path = vm["arpa"].as<string>();
+        if (vm.count("report") &&
+            report_lm_variants(arpa_path, package_path + ".variant", prob_bits,
+                               backoff_bits, bhiksha_bits,
+                               max(1, vm["report_ngrams"].as<int>())) != 0) {
+            return 1;
+        }
+
+        cerr << "Building " << variant.name() << " language model from "
+             << arpa_path << ".\n";
+        if (build_lm_binary(arpa_path, variant, package_path) != 0) {
+            return 1;
+        }
+        lm_path = package_path;
+    }
+
+    return create_package(alphabet,
+                          lm_path,
+                          vm["vocab"].as<string>(),
+                          package_path,
+                          force_bytes_output_mode,
+                          vm["default_alpha"].as<float>(),
+                          vm["default_beta"].as<float>());
 }
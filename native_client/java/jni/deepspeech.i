@@ -47,18 +47,105 @@
   }
 }
 
+%extend struct WordTranscript {
+  /**
+   * Retrieve one WordMetadata element
+   *
+   * @param i Array index of the WordMetadata to get
+   *
+   * @return The WordMetadata requested or null
+   */
+  const WordMetadata& getWord(int i) {
+    return self->words[i];
+  }
+}
+
+%extend struct WordMetadataList {
+  /**
+   * Retrieve one WordTranscript element
+   *
+   * @param i Array index of the WordTranscript to get
+   *
+   * @return The WordTranscript requested or null
+   */
+  const WordTranscript& getTranscript(int i) {
+    return self->transcripts[i];
+  }
+
+  ~WordMetadataList() {
+    DS_FreeWordMetadata(self);
+  }
+}
+
 %nodefaultctor Metadata;
 %nodefaultdtor Metadata;
 %nodefaultctor CandidateTranscript;
 %nodefaultdtor CandidateTranscript;
 %nodefaultctor TokenMetadata;
 %nodefaultdtor TokenMetadata;
+%nodefaultctor WordMetadataList;
+%nodefaultdtor WordMetadataList;
+%nodefaultctor WordTranscript;
+%nodefaultdtor WordTranscript;
+%nodefaultctor WordMetadata;
+%nodefaultdtor WordMetadata;
+
+// DS_SaveStream copies the snapshot to the first element of a byte[][], the
+// way out parameters are passed in Java
+%typemap(jni) (char** aSnapshot, unsigned int* aSize) "jobjectArray"
+%typemap(jtype) (char** aSnapshot, unsigned int* aSize) "byte[][]"
+%typemap(jstype) (char** aSnapshot, unsigned int* aSize) "byte[][]"
+%typemap(javain) (char** aSnapshot, unsigned int* aSize) "$javainput"
+
+%typemap(in) (char** aSnapshot, unsigned int* aSize) (char* snapshot, unsigned int size) {
+  if (!$input || JCALL1(GetArrayLength, jenv, $input) == 0) {
+    SWIG_JavaThrowException(jenv, SWIG_JavaIndexOutOfBoundsException, "snapshot array must have at least one element");
+    return $null;
+  }
+  snapshot = NULL;
+  size = 0;
+  $1 = &snapshot;
+  $2 = &size;
+}
+
+%typemap(argout) (char** aSnapshot, unsigned int* aSize) {
+  if (*$1) {
+    jbyteArray bytes = JCALL1(NewByteArray, jenv, (jsize)*$2);
+    if (bytes) {
+      JCALL4(SetByteArrayRegion, jenv, bytes, 0, (jsize)*$2, (const jbyte*)*$1);
+      JCALL3(SetObjectArrayElement, jenv, $input, 0, bytes);
+    }
+    DS_FreeSnapshot(*$1);
+  }
+}
+
+// DS_RestoreStream takes the snapshot as a byte[]
+%typemap(jni) (const char* aSnapshot, unsigned int aSize) "jbyteArray"
+%typemap(jtype) (const char* aSnapshot, unsigned int aSize) "byte[]"
+%typemap(jstype) (const char* aSnapshot, unsigned int aSize) "byte[]"
+%typemap(javain) (const char* aSnapshot, unsigned int aSize) "$javainput"
+
+%typemap(in) (const char* aSnapshot, unsigned int aSize) {
+  if (!$input) {
+    SWIG_JavaThrowException(jenv, SWIG_JavaNullPointerException, "null snapshot");
+    return $null;
+  }
+  $1 = (char*)JCALL2(GetByteArrayElements, jenv, $input, 0);
+  $2 = (unsigned int)JCALL1(GetArrayLength, jenv, $input);
+}
+
+%typemap(freearg) (const char* aSnapshot, unsigned int aSize) {
+  JCALL3(ReleaseByteArrayElements, jenv, $input, (jbyte*)$1, JNI_ABORT);
+}
 
 %typemap(newfree) char* "DS_FreeString($1);";
 %newobject DS_SpeechToText;
 %newobject DS_IntermediateDecode;
 %newobject DS_FinishStream;
+%newobject DS_TakeCommittedText;
+%newobject DS_TakeSegment;
 %newobject DS_ErrorCodeToErrorMessage;
+%newobject DS_GetStatsJSON;
 
 %rename ("%(strip:[DS_])s") "";
 
@@ -70,5 +157,12 @@
 // getTranscript(int i) above.
 %ignore "Metadata::transcripts";
 %ignore "CandidateTranscript::tokens";
+%ignore "WordMetadataList::transcripts";
+%ignore "WordTranscript::words";
+
+// Takes untyped audio buffers, use FeedAudioContent with 16-bit samples
+%ignore DS_FeedAudioContentEx;
+// Snapshots are freed by the typemaps below
+%ignore DS_FreeSnapshot;
 
 %include "../deepspeech.h"
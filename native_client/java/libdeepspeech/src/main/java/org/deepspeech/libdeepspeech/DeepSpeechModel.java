@@ -14,7 +14,7 @@ public class DeepSpeechModel {
     private SWIGTYPE_p_p_ModelState _mspp;
     private SWIGTYPE_p_ModelState   _msp;
 
-    private void evaluateErrorCode(int errorCode) {
+    static void evaluateErrorCode(int errorCode) {
         DeepSpeech_Error_Codes code = DeepSpeech_Error_Codes.swigToEnum(errorCode);
         if (code != DeepSpeech_Error_Codes.ERR_OK) {
             throw new RuntimeException("Error: " + impl.ErrorCodeToErrorMessage(errorCode) + " (0x" + Integer.toHexString(errorCode) + ").");
@@ -135,6 +135,22 @@ public class DeepSpeechModel {
         return impl.SpeechToTextWithMetadata(this._msp, buffer, buffer_size, num_results);
     }
 
+   /**
+    * @brief Use the DeepSpeech model to perform Speech-To-Text and return
+    *        word-level results.
+    *
+    * @param buffer A 16-bit, mono raw audio signal at the appropriate
+    *                sample rate (matching what the model was trained on).
+    * @param buffer_size The number of samples in the audio signal.
+    * @param num_results Maximum number of candidate transcripts to return. Returned list might be smaller than this.
+    *
+    * @return WordMetadataList struct containing multiple candidate transcripts
+    *         split into words, with the timing and scores of each word.
+    */
+    public WordMetadataList sttWithWords(short[] buffer, int buffer_size, int num_results) {
+        return impl.SpeechToTextWithWords(this._msp, buffer, buffer_size, num_results);
+    }
+
    /**
     * @brief Create a new streaming inference state. The streaming state returned
     *        by this function can then be passed to feedAudioContent()
@@ -150,6 +166,25 @@ public class DeepSpeechModel {
         return new DeepSpeechStreamingState(impl.streamingstatep_value(ssp));
     }
 
+   /**
+    * @brief Create a new streaming inference state from a snapshot taken with
+    *        DeepSpeechStreamingState.saveState(), which continues decoding
+    *        exactly where the saved stream was. The model, scorer and beam
+    *        width must be the same as the saved stream's.
+    *
+    * @param snapshot The snapshot.
+    *
+    * @return An opaque object that represents the streaming state.
+    *
+    * @throws RuntimeException if the snapshot is invalid or was saved with
+    *         another model.
+    */
+    public DeepSpeechStreamingState restoreStream(byte[] snapshot) {
+        SWIGTYPE_p_p_StreamingState ssp = impl.new_streamingstatep();
+        evaluateErrorCode(impl.RestoreStream(this._msp, snapshot, ssp));
+        return new DeepSpeechStreamingState(impl.streamingstatep_value(ssp));
+    }
+
    /**
     * @brief Feed audio samples to an ongoing streaming inference.
     *
@@ -185,6 +220,20 @@ public class DeepSpeechModel {
         return impl.IntermediateDecodeWithMetadata(ctx.get(), num_results);
     }
 
+   /**
+    * @brief Compute the intermediate decoding of an ongoing streaming inference,
+    *        return word-level results.
+    *
+    * @param ctx A streaming state pointer returned by createStream().
+    * @param num_results Maximum number of candidate transcripts to return. Returned list might be smaller than this.
+    *
+    * @return WordMetadataList struct containing multiple candidate transcripts
+    *         split into words.
+    */
+    public WordMetadataList intermediateDecodeWithWords(DeepSpeechStreamingState ctx, int num_results) {
+        return impl.IntermediateDecodeWithWords(ctx.get(), num_results);
+    }
+
    /**
     * @brief Compute the final decoding of an ongoing streaming inference and return
     *        the result. Signals the end of an ongoing streaming inference.
@@ -215,6 +264,23 @@ public class DeepSpeechModel {
     public Metadata finishStreamWithMetadata(DeepSpeechStreamingState ctx, int num_results) {
         return impl.FinishStreamWithMetadata(ctx.get(), num_results);
     }
+
+   /**
+    * @brief Compute the final decoding of an ongoing streaming inference and return
+    *        word-level results. Signals the end of an ongoing streaming
+    *        inference.
+    *
+    * @param ctx A streaming state pointer returned by createStream().
+    * @param num_results Maximum number of candidate transcripts to return. Returned list might be smaller than this.
+    *
+    * @return WordMetadataList struct containing multiple candidate transcripts
+    *         split into words.
+    *
+    * @note This method will free the state pointer (@p ctx).
+    */
+    public WordMetadataList finishStreamWithWords(DeepSpeechStreamingState ctx, int num_results) {
+        return impl.FinishStreamWithWords(ctx.get(), num_results);
+    }
     /**
      * @brief Add a hot-word.
      *
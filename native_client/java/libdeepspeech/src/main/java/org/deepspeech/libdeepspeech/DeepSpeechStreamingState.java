@@ -10,4 +10,19 @@ public final class DeepSpeechStreamingState {
     public SWIGTYPE_p_StreamingState get() {
         return this._sp;
     }
+
+   /**
+    * @brief Save the state of the stream to a snapshot, from which
+    *        DeepSpeechModel.restoreStream() continues decoding, e.g. in
+    *        another process. The stream is not changed.
+    *
+    * @return The snapshot.
+    *
+    * @throws RuntimeException on failure.
+    */
+    public byte[] saveState() {
+        byte[][] snapshot = new byte[1][];
+        DeepSpeechModel.evaluateErrorCode(impl.SaveStream(this._sp, snapshot));
+        return snapshot[0];
+    }
 }
@@ -21,6 +21,14 @@ public enum DeepSpeech_Error_Codes {
   ERR_SCORER_NO_TRIE(0x2007),
   ERR_SCORER_INVALID_TRIE(0x2008),
   ERR_SCORER_VERSION_MISMATCH(0x2009),
+  ERR_INVALID_AUDIO_FORMAT(0x2010),
+  ERR_STATS_NOT_ENABLED(0x2011),
+  ERR_SCORER_NO_LOOKAHEAD(0x2012),
+  ERR_GREEDY_WITH_SCORER(0x2013),
+  ERR_INVALID_TIMING_MODE(0x2014),
+  ERR_INVALID_BEAM_PRUNING(0x2015),
+  ERR_INVALID_SNAPSHOT(0x2016),
+  ERR_SNAPSHOT_MISMATCH(0x2017),
   ERR_FAIL_INIT_MMAP(0x3000),
   ERR_FAIL_INIT_SESS(0x3001),
   ERR_FAIL_INTERPRETER(0x3002),
@@ -31,7 +39,8 @@ public enum DeepSpeech_Error_Codes {
   ERR_FAIL_CREATE_MODEL(0x3007),
   ERR_FAIL_INSERT_HOTWORD(0x3008),
   ERR_FAIL_CLEAR_HOTWORD(0x3009),
-  ERR_FAIL_ERASE_HOTWORD(0x3010);
+  ERR_FAIL_ERASE_HOTWORD(0x3010),
+  ERR_FAIL_SAVE_STREAM(0x3011);
 
   public final int swigValue() {
     return swigValue;
@@ -0,0 +1,87 @@
+/* ----------------------------------------------------------------------------
+ * This file was automatically generated by SWIG (http://www.swig.org).
+ * Version 4.0.1
+ *
+ * Do not make changes to this file unless you know what you are doing--modify
+ * the SWIG interface file instead.
+ * ----------------------------------------------------------------------------- */
+
+package org.deepspeech.libdeepspeech;
+
+/**
+ * Stores text of an individual word, along with its timing and scores.
+ */
+public class WordMetadata {
+  private transient long swigCPtr;
+  protected transient boolean swigCMemOwn;
+
+  protected WordMetadata(long cPtr, boolean cMemoryOwn) {
+    swigCMemOwn = cMemoryOwn;
+    swigCPtr = cPtr;
+  }
+
+  protected static long getCPtr(WordMetadata obj) {
+    return (obj == null) ? 0 : obj.swigCPtr;
+  }
+
+  public synchronized void delete() {
+    if (swigCPtr != 0) {
+      if (swigCMemOwn) {
+        swigCMemOwn = false;
+        throw new UnsupportedOperationException("C++ destructor does not have public access");
+      }
+      swigCPtr = 0;
+    }
+  }
+
+  /**
+   *  The text of the word 
+   */
+  public String getText() {
+    return implJNI.WordMetadata_Text_get(swigCPtr, this);
+  }
+
+  /**
+   *  Position of the first token of the word in units of 20ms 
+   */
+  public long getStartTimestep() {
+    return implJNI.WordMetadata_StartTimestep_get(swigCPtr, this);
+  }
+
+  /**
+   *  Position of the space following the word, or the end of the word if it<br>
+   * is the last one, in units of 20ms 
+   */
+  public long getEndTimestep() {
+    return implJNI.WordMetadata_EndTimestep_get(swigCPtr, this);
+  }
+
+  /**
+   *  Position of the word in seconds 
+   */
+  public float getStartTime() {
+    return implJNI.WordMetadata_StartTime_get(swigCPtr, this);
+  }
+
+  /**
+   *  Duration of the word in seconds 
+   */
+  public float getDuration() {
+    return implJNI.WordMetadata_Duration_get(swigCPtr, this);
+  }
+
+  /**
+   *  Sum of the acoustic model log probabilities of the tokens of the word 
+   */
+  public double getAcousticScore() {
+    return implJNI.WordMetadata_AcousticScore_get(swigCPtr, this);
+  }
+
+  /**
+   *  Log probability of the word given by the external scorer, 0 without one 
+   */
+  public double getLmScore() {
+    return implJNI.WordMetadata_LmScore_get(swigCPtr, this);
+  }
+
+}
@@ -0,0 +1,60 @@
+/* ----------------------------------------------------------------------------
+ * This file was automatically generated by SWIG (http://www.swig.org).
+ * Version 4.0.1
+ *
+ * Do not make changes to this file unless you know what you are doing--modify
+ * the SWIG interface file instead.
+ * ----------------------------------------------------------------------------- */
+
+package org.deepspeech.libdeepspeech;
+
+/**
+ * An array of WordTranscript objects computed by the model.
+ */
+public class WordMetadataList {
+  private transient long swigCPtr;
+  protected transient boolean swigCMemOwn;
+
+  protected WordMetadataList(long cPtr, boolean cMemoryOwn) {
+    swigCMemOwn = cMemoryOwn;
+    swigCPtr = cPtr;
+  }
+
+  protected static long getCPtr(WordMetadataList obj) {
+    return (obj == null) ? 0 : obj.swigCPtr;
+  }
+
+  @SuppressWarnings("deprecation")
+  protected void finalize() {
+    delete();
+  }
+
+  public synchronized void delete() {
+    if (swigCPtr != 0) {
+      if (swigCMemOwn) {
+        swigCMemOwn = false;
+        implJNI.delete_WordMetadataList(swigCPtr);
+      }
+      swigCPtr = 0;
+    }
+  }
+
+  /**
+   *  Size of the transcripts array 
+   */
+  public long getNumTranscripts() {
+    return implJNI.WordMetadataList_NumTranscripts_get(swigCPtr, this);
+  }
+
+  /**
+   * Retrieve one WordTranscript element<br>
+   * <br>
+   * @param i Array index of the WordTranscript to get<br>
+   * <br>
+   * @return The WordTranscript requested or null
+   */
+  public WordTranscript getTranscript(int i) {
+    return new WordTranscript(implJNI.WordMetadataList_getTranscript(swigCPtr, this, i), false);
+  }
+
+}
@@ -0,0 +1,63 @@
+/* ----------------------------------------------------------------------------
+ * This file was automatically generated by SWIG (http://www.swig.org).
+ * Version 4.0.1
+ *
+ * Do not make changes to this file unless you know what you are doing--modify
+ * the SWIG interface file instead.
+ * ----------------------------------------------------------------------------- */
+
+package org.deepspeech.libdeepspeech;
+
+/**
+ * A single transcript computed by the model, split into words.
+ */
+public class WordTranscript {
+  private transient long swigCPtr;
+  protected transient boolean swigCMemOwn;
+
+  protected WordTranscript(long cPtr, boolean cMemoryOwn) {
+    swigCMemOwn = cMemoryOwn;
+    swigCPtr = cPtr;
+  }
+
+  protected static long getCPtr(WordTranscript obj) {
+    return (obj == null) ? 0 : obj.swigCPtr;
+  }
+
+  public synchronized void delete() {
+    if (swigCPtr != 0) {
+      if (swigCMemOwn) {
+        swigCMemOwn = false;
+        throw new UnsupportedOperationException("C++ destructor does not have public access");
+      }
+      swigCPtr = 0;
+    }
+  }
+
+  /**
+   *  Size of the words array 
+   */
+  public long getNumWords() {
+    return implJNI.WordTranscript_NumWords_get(swigCPtr, this);
+  }
+
+  /**
+   *  Approximated confidence value for this transcript, see<br>
+   * CandidateTranscript::confidence.
+   */
+  public double getConfidence() {
+    return implJNI.WordTranscript_Confidence_get(swigCPtr, this);
+  }
+
+  /**
+   * Retrieve one WordMetadata element<br>
+   * <br>
+   * @param i Array index of the WordMetadata to get<br>
+   * <br>
+   * @return The WordMetadata requested or null
+   */
+  public WordMetadata getWord(int i) {
+    return new WordMetadata(implJNI.WordTranscript_getWord(swigCPtr, this, i), false);
+  }
+
+}
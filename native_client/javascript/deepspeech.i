@@ -29,6 +29,13 @@ using namespace node;
 // apply to DS_FeedAudioContent and DS_SpeechToText
 %apply (short* IN_ARRAY1, int DIM1) {(const short* aBuffer, unsigned int aBufferSize)};
 
+// DS_FeedAudioContentEx takes int16 or float32 samples, the JavaScript wrapper
+// derives the frame count from the Buffer length
+%typemap(in) (const void* aBuffer)
+{
+  $1 = Buffer::Data(SWIGV8_TO_OBJECT($input));
+}
+
 
 // make sure the string returned by SpeechToText is freed
 %typemap(newfree) char* "DS_FreeString($1);";
@@ -36,8 +43,11 @@ using namespace node;
 %newobject DS_SpeechToText;
 %newobject DS_IntermediateDecode;
 %newobject DS_FinishStream;
+%newobject DS_TakeCommittedText;
+%newobject DS_TakeSegment;
 %newobject DS_Version;
 %newobject DS_ErrorCodeToErrorMessage;
+%newobject DS_GetStatsJSON;
 
 // convert double pointer retval in CreateModel to an output
 %typemap(in, numinputs=0) ModelState **retval (ModelState *ret) {
@@ -66,6 +76,30 @@ using namespace node;
   %append_output(SWIG_NewPointerObj(%as_voidptr(*$1), $*1_descriptor, 0));
 }
 
+// DS_SaveStream returns the snapshot as a Buffer, DS_RestoreStream takes one
+%typemap(in, numinputs=0) (char** aSnapshot, unsigned int* aSize) (char* snapshot, unsigned int size) {
+  snapshot = NULL;
+  size = 0;
+  $1 = &snapshot;
+  $2 = &size;
+}
+
+%typemap(argout) (char** aSnapshot, unsigned int* aSize) {
+  $result = SWIGV8_ARRAY_NEW(0);
+  SWIGV8_AppendOutput($result, SWIG_From_int(result));
+  if (*$1) {
+    %append_output(Buffer::Copy(v8::Isolate::GetCurrent(), *$1, *$2).ToLocalChecked());
+    DS_FreeSnapshot(*$1);
+  }
+}
+
+%typemap(in) (const char* aSnapshot, unsigned int aSize)
+{
+  Local<Object> bufferObj = SWIGV8_TO_OBJECT($input);
+  $1 = Buffer::Data(bufferObj);
+  $2 = ($2_ltype)Buffer::Length(bufferObj);
+}
+
 %nodefaultctor ModelState;
 %nodefaultdtor ModelState;
 
@@ -83,8 +117,24 @@ using namespace node;
   }
 %}
 
+%typemap(out) WordMetadata* %{
+  $result = SWIGV8_ARRAY_NEW(0);
+  for (int i = 0; i < arg1->num_words; ++i) {
+    SWIGV8_AppendOutput($result, SWIG_NewPointerObj(SWIG_as_voidptr(&result[i]), SWIGTYPE_p_WordMetadata, 0));
+  }
+%}
+
+%typemap(out) WordTranscript* %{
+  $result = SWIGV8_ARRAY_NEW(0);
+  for (int i = 0; i < arg1->num_transcripts; ++i) {
+    SWIGV8_AppendOutput($result, SWIG_NewPointerObj(SWIG_as_voidptr(&result[i]), SWIGTYPE_p_WordTranscript, 0));
+  }
+%}
+
 %ignore Metadata::num_transcripts;
 %ignore CandidateTranscript::num_tokens;
+%ignore WordMetadataList::num_transcripts;
+%ignore WordTranscript::num_words;
 
 %nodefaultctor Metadata;
 %nodefaultdtor Metadata;
@@ -92,6 +142,12 @@ using namespace node;
 %nodefaultdtor CandidateTranscript;
 %nodefaultctor TokenMetadata;
 %nodefaultdtor TokenMetadata;
+%nodefaultctor WordMetadataList;
+%nodefaultdtor WordMetadataList;
+%nodefaultctor WordTranscript;
+%nodefaultdtor WordTranscript;
+%nodefaultctor WordMetadata;
+%nodefaultdtor WordMetadata;
 
 %rename ("%(strip:[DS_])s") "";
 
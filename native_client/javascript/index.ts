@@ -61,6 +61,49 @@ export interface Metadata {
     transcripts: CandidateTranscript[];
 }
 
+/**
+ * Stores text of an individual word, along with its timing and scores
+ */
+export interface WordMetadata {
+    /** The text of the word */
+    text: string;
+
+    /** Position of the first token of the word in units of 20ms */
+    start_timestep: number;
+
+    /** Position of the space following the word, or the end of the word if it is the last one, in units of 20ms */
+    end_timestep: number;
+
+    /** Position of the word in seconds */
+    start_time: number;
+
+    /** Duration of the word in seconds */
+    duration: number;
+
+    /** Sum of the acoustic model log probabilities of the tokens of the word */
+    acoustic_score: number;
+
+    /** Log probability of the word given by the external scorer, 0 without one */
+    lm_score: number;
+}
+
+/**
+ * A single transcript computed by the model, split into words.
+ */
+export interface WordTranscript {
+    words: WordMetadata[];
+
+    /** Approximated confidence value for this transcription, see :js:func:`CandidateTranscript.confidence`. */
+    confidence: number;
+}
+
+/**
+ * An array of WordTranscript objects computed by the model.
+ */
+export interface WordMetadataList {
+    transcripts: WordTranscript[];
+}
+
 /**
  * Provides an interface to a DeepSpeech stream. The constructor cannot be called
  * directly, use :js:func:`Model.createStream`.
@@ -86,6 +129,30 @@ class StreamImpl {
         binding.FeedAudioContent(this._impl, aBuffer);
     }
 
+    /**
+     * Feed audio samples at any sample rate and channel count to an ongoing
+     * streaming inference. The audio is downmixed and resampled to the model
+     * sample rate as it is fed.
+     *
+     * @param aBuffer Interleaved raw audio samples, 16-bit integers or 32-bit floats in native byte order.
+     * @param aSampleRate Sample rate of the audio.
+     * @param aChannels Number of interleaved channels. Default value is 1 if not specified.
+     * @param aFloat Whether the samples are 32-bit floats rather than 16-bit integers. Default value is false if not specified.
+     *
+     * @throws on error
+     */
+    feedAudioContentEx(aBuffer: Buffer, aSampleRate: number, aChannels: number = 1, aFloat: boolean = false): void {
+        const frameSize = aChannels * (aFloat ? 4 : 2);
+        if (aChannels < 1 || aBuffer.length % frameSize !== 0) {
+            throw `FeedAudioContentEx failed: buffer length must be a multiple of ${frameSize} bytes`;
+        }
+        const status = binding.FeedAudioContentEx(this._impl, aBuffer, aBuffer.length / frameSize, aSampleRate, aChannels,
+                                                  aFloat ? binding.SAMPLE_FORMAT_F32 : binding.SAMPLE_FORMAT_S16);
+        if (status !== 0) {
+            throw `FeedAudioContentEx failed: ${binding.ErrorCodeToErrorMessage(status)} (0x${status.toString(16)})`;
+        }
+    }
+
     /**
      * Compute the intermediate decoding of an ongoing streaming inference.
      *
@@ -106,6 +173,32 @@ class StreamImpl {
         return binding.IntermediateDecodeWithMetadata(this._impl, aNumResults);
     }
 
+    /**
+     * Compute the intermediate decoding of an ongoing streaming inference, return word-level results.
+     *
+     * @param aNumResults Maximum number of candidate transcripts to return. Returned list might be smaller than this. Default value is 1 if not specified.
+     *
+     * @return :js:func:`WordMetadataList` object containing multiple candidate transcripts split into words. The user is responsible for freeing it by calling :js:func:`FreeWordMetadata`. Returns undefined on error.
+     */
+    intermediateDecodeWithWords(aNumResults: number = 1): WordMetadataList {
+        return binding.IntermediateDecodeWithWords(this._impl, aNumResults);
+    }
+
+    /**
+     * Save the state of the stream to a snapshot, from which :js:func:`Model.restoreStream` continues decoding, e.g. in another process. The stream is not changed.
+     *
+     * @return The snapshot.
+     *
+     * @throws on error
+     */
+    saveState(): Buffer {
+        const [status, snapshot] = binding.SaveStream(this._impl);
+        if (status !== 0) {
+            throw `SaveStream failed: ${binding.ErrorCodeToErrorMessage(status)} (0x${status.toString(16)})`;
+        }
+        return snapshot;
+    }
+
     /**
      * Compute the final decoding of an ongoing streaming inference and return the result. Signals the end of an ongoing streaming inference.
      *
@@ -133,6 +226,21 @@ class StreamImpl {
         this._impl = null;
         return result;
     }
+
+    /**
+     * Compute the final decoding of an ongoing streaming inference and return word-level results. Signals the end of an ongoing streaming inference.
+     *
+     * @param aNumResults Maximum number of candidate transcripts to return. Returned list might be smaller than this. Default value is 1 if not specified.
+     *
+     * @return :js:func:`WordMetadataList` object containing multiple candidate transcripts split into words. The user is responsible for freeing it by calling :js:func:`FreeWordMetadata`.
+     *
+     * This method will free the stream, it must not be used after this method is called.
+     */
+    finishStreamWithWords(aNumResults: number = 1): WordMetadataList {
+        const result = binding.FinishStreamWithWords(this._impl, aNumResults);
+        this._impl = null;
+        return result;
+    }
 }
 /**
  * Exposes the type of Stream without actually exposing the class.
@@ -307,6 +415,22 @@ export class Model {
         return binding.SpeechToTextWithMetadata(this._impl, aBuffer, aNumResults);
     }
 
+    /**
+     * Use the DeepSpeech model to perform Speech-To-Text and return word-level
+     * results, with the timing and the acoustic and language model scores of
+     * each word.
+     *
+     * @param aBuffer A 16-bit, mono raw audio signal at the appropriate sample rate (matching what the model was trained on).
+     * @param aNumResults Maximum number of candidate transcripts to return. Returned list might be smaller than this.
+     * Default value is 1 if not specified.
+     *
+     * @return :js:func:`WordMetadataList` object containing multiple candidate transcripts split into words.
+     * The user is responsible for freeing it by calling :js:func:`FreeWordMetadata`. Returns undefined on error.
+     */
+    sttWithWords(aBuffer: Buffer, aNumResults: number = 1): WordMetadataList {
+        return binding.SpeechToTextWithWords(this._impl, aBuffer, aNumResults);
+    }
+
     /**
      * Create a new streaming inference state. One can then call :js:func:`StreamImpl.feedAudioContent` and :js:func:`StreamImpl.finishStream` on the returned stream object.
      *
@@ -321,6 +445,23 @@ export class Model {
         }
         return new StreamImpl(ctx);
     }
+
+    /**
+     * Create a stream from a snapshot taken with :js:func:`StreamImpl.saveState`, which continues decoding exactly where the saved stream was. The model and scorer must be the same as the saved stream's.
+     *
+     * @param aSnapshot The snapshot.
+     *
+     * @return a :js:func:`StreamImpl` object that represents the restored streaming state.
+     *
+     * @throws on error
+     */
+    restoreStream(aSnapshot: Buffer): StreamImpl {
+        const [status, ctx] = binding.RestoreStream(this._impl, aSnapshot);
+        if (status !== 0) {
+            throw `RestoreStream failed: ${binding.ErrorCodeToErrorMessage(status)} (0x${status.toString(16)})`;
+        }
+        return new StreamImpl(ctx);
+    }
 }
 
 /**
@@ -342,6 +483,15 @@ export function FreeMetadata(metadata: Metadata): void {
     binding.FreeMetadata(metadata);
 }
 
+/**
+ * Free memory allocated for word-level results.
+ *
+ * @param metadata Object containing word-level results as returned by :js:func:`Model.sttWithWords` or :js:func:`StreamImpl.finishStreamWithWords`
+ */
+export function FreeWordMetadata(metadata: WordMetadataList): void {
+    binding.FreeWordMetadata(metadata);
+}
+
 /**
  * Destroy a streaming state without decoding the computed logits. This
  * can be used if you no longer need the result of an ongoing streaming
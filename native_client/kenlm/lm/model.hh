@@ -104,6 +104,17 @@ template <class Search, class VocabularyT> class GenericModel : public base::Mod
 
     uint64_t GetEndOfSearchOffset() const;
 
+    /* Prefetch the memory that FullScore(in_state, new_word, ...) reads
+     * first.  See the search's Prefetch for what that covers.
+     */
+    void Prefetch(const State &in_state, const WordIndex new_word) const {
+      search_.Prefetch(in_state.words, in_state.words + in_state.length, new_word);
+    }
+
+    void BasePrefetch(const void *in_state, const WordIndex new_word) const {
+      Prefetch(*reinterpret_cast<const State*>(in_state), new_word);
+    }
+
   private:
     FullScoreReturn ScoreExceptBackoff(const WordIndex *const context_rbegin, const WordIndex *const context_rend, const WordIndex new_word, State &out_state) const;
 
@@ -8,6 +8,7 @@
 #include "lm/weights.hh"
 
 #include "util/bit_packing.hh"
+#include "util/prefetch.hh"
 #include "util/probing_hash_table.hh"
 
 #include <algorithm>
@@ -125,6 +126,23 @@ template <class Value> class HashedSearch {
       return LongestPointer(found->value.prob);
     }
 
+    // Prefetch the unigram of new_word and the ideal bucket of each n-gram
+    // extending it with the context, in reverse order.  The hash of an n-gram
+    // only depends on its words, so every order can be prefetched before any
+    // lookup is made.
+    void Prefetch(const WordIndex *context_rbegin, const WordIndex *context_rend, WordIndex new_word) const {
+      util::Prefetch(&unigram_.Lookup(new_word));
+      Node node = static_cast<Node>(new_word);
+      const WordIndex *i = context_rbegin;
+      for (unsigned char order_minus_2 = 0; i != context_rend && order_minus_2 < middle_.size(); ++i, ++order_minus_2) {
+        node = CombineWordHash(node, *i);
+        util::Prefetch(&*middle_[order_minus_2].Ideal(node));
+      }
+      if (i != context_rend) {
+        util::Prefetch(&*longest_.Ideal(CombineWordHash(node, *i)));
+      }
+    }
+
     // Generate a node without necessarily checking that it actually exists.
     // Optionally return false if it's know to not exist.
     bool FastMakeNode(const WordIndex *begin, const WordIndex *end, Node &node) const {
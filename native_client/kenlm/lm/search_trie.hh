@@ -9,6 +9,7 @@
 
 #include "util/file.hh"
 #include "util/file_piece.hh"
+#include "util/prefetch.hh"
 
 #include <vector>
 #include <cstdlib>
@@ -74,6 +75,12 @@ template <class Quant, class Bhiksha> class TrieSearch {
       return ret;
     }
 
+    // Each level of the trie is searched in the range found by the level
+    // below, so only the unigram can be fetched ahead of the lookup.
+    void Prefetch(const WordIndex * /*context_rbegin*/, const WordIndex * /*context_rend*/, WordIndex new_word) const {
+      util::Prefetch(&unigram_.Lookup(new_word));
+    }
+
     MiddlePointer Unpack(uint64_t extend_pointer, unsigned char extend_length, Node &node) const {
       return MiddlePointer(quant_, extend_length - 2, middle_begin_[extend_length - 2].ReadEntry(extend_pointer, node));
     }
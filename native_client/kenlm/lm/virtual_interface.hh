@@ -133,6 +133,11 @@ class Model {
     // Prefer to use FullScore.  The context words should be provided in reverse order.
     virtual FullScoreReturn BaseFullScoreForgotState(const WordIndex *context_rbegin, const WordIndex *context_rend, const WordIndex new_word, void *out_state) const = 0;
 
+    // Prefetch the memory that BaseScore(in_state, new_word, ...) reads first,
+    // so that the lookups of independent queries can overlap.  Does nothing
+    // unless the model overrides it.
+    virtual void BasePrefetch(const void * /*in_state*/, const WordIndex /*new_word*/) const {}
+
     unsigned char Order() const { return order_; }
 
     const Vocabulary &BaseVocabulary() const { return *base_vocab_; }
@@ -0,0 +1,23 @@
+#ifndef UTIL_PREFETCH_H
+#define UTIL_PREFETCH_H
+
+#if defined(_MSC_VER)
+#include <xmmintrin.h>
+#endif
+
+namespace util {
+
+// Hint that the cache line holding address will be read soon.
+inline void Prefetch(const void *address) {
+#if defined(__GNUC__) || defined(__clang__)
+  __builtin_prefetch(address);
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+  _mm_prefetch(static_cast<const char*>(address), _MM_HINT_T0);
+#else
+  (void)address;
+#endif
+}
+
+} // namespace util
+
+#endif // UTIL_PREFETCH_H
@@ -1,3 +1,5 @@
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "ctcdecode/ctc_beam_search_decoder.h"
@@ -16,6 +18,9 @@ ModelState::ModelState()
   , audio_win_len_(-1)
   , audio_win_step_(-1)
   , state_size_(-1)
+  , stream_pool_max_size_(0)
+  , stream_pool_hits_(0)
+  , stream_pool_misses_(0)
 {
 }
 
@@ -40,17 +45,57 @@ Metadata*
 ModelState::decode_metadata(const DecoderState& state, 
                             size_t num_results)
 {
-  vector<Output> out = state.decode(num_results);
+  return outputs_to_metadata(state.decode(num_results));
+}
+
+// Round offset up to the alignment required by T
+template<typename T>
+static size_t
+align_for(size_t offset)
+{
+  return (offset + alignof(T) - 1) / alignof(T) * alignof(T);
+}
+
+Metadata*
+ModelState::outputs_to_metadata(const vector<Output>& out) const
+{
+  // The whole result lives in a single block so that DS_FreeMetadata() is a
+  // single free(): the Metadata struct comes first, followed by the
+  // CandidateTranscript array, the TokenMetadata arrays of all transcripts,
+  // and the text of every distinct label used, stored once.
   unsigned int num_returned = out.size();
 
-  CandidateTranscript* transcripts = (CandidateTranscript*)malloc(sizeof(CandidateTranscript)*num_returned);
+  size_t num_tokens = 0;
+  std::string texts;
+  std::unordered_map<unsigned int, size_t> text_offsets;
+  for (const Output& output : out) {
+    num_tokens += output.tokens.size();
+    for (unsigned int label : output.tokens) {
+      if (text_offsets.emplace(label, texts.size()).second) {
+        texts += alphabet_.DecodeSingle(label);
+        texts += '\0';
+      }
+    }
+  }
+
+  const size_t transcripts_offset = align_for<CandidateTranscript>(sizeof(Metadata));
+  const size_t tokens_offset = align_for<TokenMetadata>(
+    transcripts_offset + sizeof(CandidateTranscript)*num_returned);
+  const size_t texts_offset = tokens_offset + sizeof(TokenMetadata)*num_tokens;
 
-  for (int i = 0; i < num_returned; ++i) {
-    TokenMetadata* tokens = (TokenMetadata*)malloc(sizeof(TokenMetadata)*out[i].tokens.size());
+  char* block = (char*)malloc(texts_offset + texts.size());
+  if (!block) {
+    return nullptr;
+  }
+  CandidateTranscript* transcripts = (CandidateTranscript*)(block + transcripts_offset);
+  TokenMetadata* tokens = (TokenMetadata*)(block + tokens_offset);
+  char* text_table = block + texts_offset;
+  memcpy(text_table, texts.data(), texts.size());
 
+  for (int i = 0; i < num_returned; ++i) {
     for (int j = 0; j < out[i].tokens.size(); ++j) {
       TokenMetadata token {
-        strdup(alphabet_.DecodeSingle(out[i].tokens[j]).c_str()),   // text
+        text_table + text_offsets[out[i].tokens[j]],                   // text
         static_cast<unsigned int>(out[i].timesteps[j]),                // timestep
         out[i].timesteps[j] * ((float)audio_win_step_ / sample_rate_), // start_time
       };
@@ -63,9 +108,10 @@ ModelState::decode_metadata(const DecoderState& state,
       out[i].confidence,                               // confidence
     };
     memcpy(&transcripts[i], &transcript, sizeof(CandidateTranscript));
+    tokens += out[i].tokens.size();
   }
 
-  Metadata* ret = (Metadata*)malloc(sizeof(Metadata));
+  Metadata* ret = (Metadata*)block;
   Metadata metadata {
     transcripts,  // transcripts
     num_returned, // num_transcripts
@@ -73,3 +119,76 @@ ModelState::decode_metadata(const DecoderState& state,
   memcpy(ret, &metadata, sizeof(Metadata));
   return ret;
 }
+
+WordMetadataList*
+ModelState::decode_words(const DecoderState& state,
+                         size_t num_results) const
+{
+  vector<Output> out = state.decode_words(num_results);
+  unsigned int num_returned = out.size();
+
+  // Single block, as in outputs_to_metadata(): the WordMetadataList struct,
+  // the WordTranscript array, the WordMetadata arrays, then the text of all
+  // words.
+  size_t num_words = 0;
+  std::string texts;
+  vector<size_t> text_offsets;
+  for (const Output& output : out) {
+    num_words += output.words.size();
+    for (const WordOutput& word : output.words) {
+      text_offsets.push_back(texts.size());
+      for (unsigned int t = 0; t < word.num_tokens; ++t) {
+        texts += alphabet_.DecodeSingle(output.tokens[word.first_token + t]);
+      }
+      texts += '\0';
+    }
+  }
+
+  const size_t transcripts_offset = align_for<WordTranscript>(sizeof(WordMetadataList));
+  const size_t words_offset = align_for<WordMetadata>(
+    transcripts_offset + sizeof(WordTranscript)*num_returned);
+  const size_t texts_offset = words_offset + sizeof(WordMetadata)*num_words;
+
+  char* block = (char*)malloc(texts_offset + texts.size());
+  if (!block) {
+    return nullptr;
+  }
+  WordTranscript* transcripts = (WordTranscript*)(block + transcripts_offset);
+  WordMetadata* words = (WordMetadata*)(block + words_offset);
+  char* text_table = block + texts_offset;
+  memcpy(text_table, texts.data(), texts.size());
+
+  const float seconds_per_timestep = (float)audio_win_step_ / sample_rate_;
+  size_t word_index = 0;
+  for (int i = 0; i < num_returned; ++i) {
+    for (int j = 0; j < out[i].words.size(); ++j, ++word_index) {
+      const WordOutput& w = out[i].words[j];
+      WordMetadata word {
+        text_table + text_offsets[word_index],                         // text
+        w.start_timestep,                                              // start_timestep
+        w.end_timestep,                                                // end_timestep
+        w.start_timestep * seconds_per_timestep,                       // start_time
+        (w.end_timestep - w.start_timestep) * seconds_per_timestep,    // duration
+        w.acoustic_score,                                              // acoustic_score
+        w.lm_score,                                                    // lm_score
+      };
+      memcpy(&words[j], &word, sizeof(WordMetadata));
+    }
+
+    WordTranscript transcript {
+      words,                                          // words
+      static_cast<unsigned int>(out[i].words.size()), // num_words
+      out[i].confidence,                              // confidence
+    };
+    memcpy(&transcripts[i], &transcript, sizeof(WordTranscript));
+    words += out[i].words.size();
+  }
+
+  WordMetadataList* ret = (WordMetadataList*)block;
+  WordMetadataList list {
+    transcripts,  // transcripts
+    num_returned, // num_transcripts
+  };
+  memcpy(ret, &list, sizeof(WordMetadataList));
+  return ret;
+}
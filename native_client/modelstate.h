@@ -1,10 +1,12 @@
 #ifndef MODELSTATE_H
 #define MODELSTATE_H
 
+#include <mutex>
 #include <vector>
 
 #include "deepspeech.h"
 #include "alphabet.h"
+#include "stats.h"
 
 #include "ctcdecode/scorer.h"
 #include "ctcdecode/output.h"
@@ -28,6 +30,16 @@ struct ModelState {
   unsigned int audio_win_step_;
   unsigned int state_size_;
 
+  // Freed streams kept for reuse by DS_CreateStream(), managed in deepspeech.cc
+  std::vector<StreamingState*> stream_pool_;
+  mutable std::mutex stream_pool_mutex_;
+  unsigned int stream_pool_max_size_;
+  unsigned int stream_pool_hits_;
+  unsigned int stream_pool_misses_;
+
+  // Figures of the freed streams, merged by DS_FreeStream()
+  StatsCollector stats_;
+
   ModelState();
   virtual ~ModelState();
 
@@ -75,6 +87,29 @@ struct ModelState {
    */
   virtual Metadata* decode_metadata(const DecoderState& state,
                                     size_t num_results);
+
+  /**
+   * @brief Convert decoder outputs into character-level metadata.
+   *
+   * @param out Decoder outputs, with the first ranked most probable.
+   *
+   * @return A Metadata struct containing one CandidateTranscript per output.
+   * The user is responsible for freeing Result by calling DS_FreeMetadata().
+   */
+  Metadata* outputs_to_metadata(const std::vector<Output>& out) const;
+
+  /**
+   * @brief Return word-level results including word timings and scores.
+   *
+   * @param state Decoder state to use when decoding.
+   * @param num_results Maximum number of candidate results to return.
+   *
+   * @return A WordMetadataList struct containing WordTranscript structs, with
+   * the first ranked most probable. The user is responsible for freeing
+   * Result by calling DS_FreeWordMetadata().
+   */
+  WordMetadataList* decode_words(const DecoderState& state,
+                                 size_t num_results) const;
 };
 
 #endif // MODELSTATE_H
@@ -1,3 +1,4 @@
+import json
 import os
 import platform
 
@@ -151,6 +152,40 @@ class Model(object):
         """
         return deepspeech.impl.SetScorerAlphaBeta(self._impl, alpha, beta)
 
+    def setStreamPoolSize(self, max_size):
+        """
+        Set the maximum number of finished streams kept for reuse by :func:`createStream()`.
+        Reusing a stream avoids most of the allocations and setup of a new one.
+
+        :param max_size: Maximum number of pooled streams, 0 to disable pooling.
+        :type max_size: int
+
+        :return: Zero on success, non-zero on failure.
+        :type: int
+        """
+        return deepspeech.impl.SetStreamPoolSize(self._impl, max_size)
+
+    def streamPoolStats(self):
+        """
+        Return the number of streams reused from and allocated despite the stream pool.
+
+        :return: A tuple of (hits, misses).
+        :type: tuple
+        """
+        return (deepspeech.impl.GetStreamPoolHits(self._impl),
+                deepspeech.impl.GetStreamPoolMisses(self._impl))
+
+    def stats(self):
+        """
+        Return the time spent in each stage of the pipeline, and the amount of
+        audio processed, by all the freed streams of this model.
+
+        :return: The parsed JSON object returned by ``DS_GetStatsJSON``, or None if the library was built without statistics.
+        :type: dict
+        """
+        stats = deepspeech.impl.GetStatsJSON(self._impl, None)
+        return json.loads(stats) if stats is not None else None
+
     def stt(self, audio_buffer):
         """
         Use the DeepSpeech model to perform Speech-To-Text.
@@ -178,6 +213,21 @@ class Model(object):
         """
         return deepspeech.impl.SpeechToTextWithMetadata(self._impl, audio_buffer, num_results)
 
+    def sttWithWords(self, audio_buffer, num_results=1):
+        """
+        Use the DeepSpeech model to perform Speech-To-Text and return word-level results.
+
+        :param audio_buffer: A 16-bit, mono raw audio signal at the appropriate sample rate (matching what the model was trained on).
+        :type audio_buffer: numpy.int16 array
+
+        :param num_results: Maximum number of candidate transcripts to return. Returned list might be smaller than this.
+        :type num_results: int
+
+        :return: WordMetadataList object containing multiple candidate transcripts. Each transcript has per-word timings and scores.
+        :type: :func:`WordMetadataList`
+        """
+        return deepspeech.impl.SpeechToTextWithWords(self._impl, audio_buffer, num_results)
+
     def createStream(self):
         """
         Create a new streaming inference state. The streaming state returned by
@@ -191,7 +241,26 @@ class Model(object):
         status, ctx = deepspeech.impl.CreateStream(self._impl)
         if status != 0:
             raise RuntimeError("CreateStream failed with '{}' (0x{:X})".format(deepspeech.impl.ErrorCodeToErrorMessage(status),status))
-        return Stream(ctx)
+        return Stream(ctx, self)
+
+    def restoreStream(self, snapshot):
+        """
+        Create a stream from a snapshot taken with :func:`Stream.saveState()`,
+        which continues decoding exactly where the saved stream was. The model
+        and scorer must be the same as the saved stream's.
+
+        :param snapshot: Snapshot of a stream
+        :type snapshot: bytes
+
+        :return: Stream object representing the restored stream
+        :type: :func:`Stream`
+
+        :throws: RuntimeError if the snapshot is invalid or was saved with another model
+        """
+        status, ctx = deepspeech.impl.RestoreStream(self._impl, snapshot)
+        if status != 0:
+            raise RuntimeError("RestoreStream failed with '{}' (0x{:X})".format(deepspeech.impl.ErrorCodeToErrorMessage(status),status))
+        return Stream(ctx, self)
 
 
 class Stream(object):
@@ -199,8 +268,10 @@ class Stream(object):
     Class wrapping a DeepSpeech stream. The constructor cannot be called directly.
     Use :func:`Model.createStream()`
     """
-    def __init__(self, native_stream):
+    def __init__(self, native_stream, model):
         self._impl = native_stream
+        # Freed streams go back to the model's pool, so it must outlive them
+        self._model = model
 
     def __del__(self):
         if self._impl:
@@ -219,6 +290,38 @@ class Stream(object):
             raise RuntimeError("Stream object is not valid. Trying to feed an already finished stream?")
         deepspeech.impl.FeedAudioContent(self._impl, audio_buffer)
 
+    def feedAudioContentEx(self, audio_buffer, sample_rate):
+        """
+        Feed audio samples at any sample rate and channel count to an ongoing
+        streaming inference. The audio is downmixed and resampled to the model
+        sample rate as it is fed.
+
+        :param audio_buffer: Raw audio signal, a one dimensional array for mono audio or an array of shape (frames, channels) for interleaved multichannel audio.
+        :type audio_buffer: numpy.int16 or numpy.float32 array
+
+        :param sample_rate: Sample rate of the audio signal.
+        :type sample_rate: int
+
+        :throws: RuntimeError if the stream object is not valid or the audio format is not supported
+        """
+        if not self._impl:
+            raise RuntimeError("Stream object is not valid. Trying to feed an already finished stream?")
+        if audio_buffer.dtype.name == 'int16':
+            sample_format = deepspeech.impl.SAMPLE_FORMAT_S16
+        elif audio_buffer.dtype.name == 'float32':
+            sample_format = deepspeech.impl.SAMPLE_FORMAT_F32
+        else:
+            raise RuntimeError("Unsupported sample format {}, use int16 or float32".format(audio_buffer.dtype.name))
+        if audio_buffer.ndim == 1:
+            channels = 1
+        elif audio_buffer.ndim == 2:
+            channels = audio_buffer.shape[1]
+        else:
+            raise RuntimeError("audio_buffer must have one or two dimensions")
+        status = deepspeech.impl.FeedAudioContentEx(self._impl, audio_buffer, audio_buffer.shape[0], sample_rate, channels, sample_format)
+        if status != 0:
+            raise RuntimeError("FeedAudioContentEx failed with '{}' (0x{:X})".format(deepspeech.impl.ErrorCodeToErrorMessage(status),status))
+
     def intermediateDecode(self):
         """
         Compute the intermediate decoding of an ongoing streaming inference.
@@ -248,6 +351,252 @@ class Stream(object):
             raise RuntimeError("Stream object is not valid. Trying to decode an already finished stream?")
         return deepspeech.impl.IntermediateDecodeWithMetadata(self._impl, num_results)
 
+    def intermediateDecodeWithWords(self, num_results=1):
+        """
+        Compute the intermediate decoding of an ongoing streaming inference and return word-level results.
+
+        :param num_results: Maximum number of candidate transcripts to return. Returned list might be smaller than this.
+        :type num_results: int
+
+        :return: WordMetadataList object containing multiple candidate transcripts. Each transcript has per-word timings and scores.
+        :type: :func:`WordMetadataList`
+
+        :throws: RuntimeError if the stream object is not valid
+        """
+        if not self._impl:
+            raise RuntimeError("Stream object is not valid. Trying to decode an already finished stream?")
+        return deepspeech.impl.IntermediateDecodeWithWords(self._impl, num_results)
+
+    def enablePrefixCommitment(self):
+        """
+        Enable prefix commitment. The beginning of the transcription that all
+        decoder beams agree on is then finalized and dropped from the decoder
+        state, keeping memory use bounded on long streams. Finalized text is
+        included in decoding results until retrieved with :func:`takeCommittedText()`
+        or :func:`takeCommittedMetadata()`.
+
+        :throws: RuntimeError if the stream object is not valid
+        """
+        if not self._impl:
+            raise RuntimeError("Stream object is not valid. Trying to configure an already finished stream?")
+        status = deepspeech.impl.EnableStreamPrefixCommitment(self._impl)
+        if status != 0:
+            raise RuntimeError("EnableStreamPrefixCommitment failed with '{}' (0x{:X})".format(deepspeech.impl.ErrorCodeToErrorMessage(status),status))
+
+    def takeCommittedText(self):
+        """
+        Retrieve the text finalized by prefix commitment since the last call.
+
+        :return: The finalized text, possibly empty.
+        :type: str
+
+        :throws: RuntimeError if the stream object is not valid
+        """
+        if not self._impl:
+            raise RuntimeError("Stream object is not valid. Trying to decode an already finished stream?")
+        return deepspeech.impl.TakeCommittedText(self._impl)
+
+    def takeCommittedMetadata(self):
+        """
+        Retrieve the text finalized by prefix commitment since the last call, including metadata.
+
+        :return: Metadata object containing a single transcript with per-token metadata including timing information.
+        :type: :func:`Metadata`
+
+        :throws: RuntimeError if the stream object is not valid
+        """
+        if not self._impl:
+            raise RuntimeError("Stream object is not valid. Trying to decode an already finished stream?")
+        return deepspeech.impl.TakeCommittedMetadata(self._impl)
+
+    def enableEndpointing(self, min_silence_ms, energy_threshold=0.0):
+        """
+        Enable endpointing. Whenever the acoustic model detects a long enough
+        silence after some speech, the current transcript is finalized as a
+        segment and decoding restarts for the next utterance. Finalized segments
+        are retrieved with :func:`takeSegment()` or :func:`takeSegmentWithMetadata()`.
+
+        :param min_silence_ms: Minimum duration of silence, in milliseconds, that ends a segment.
+        :type min_silence_ms: int
+
+        :param energy_threshold: Level in dBFS under which audio is considered quiet. When negative, audio must also stay quiet for min_silence_ms. 0 disables the check.
+        :type energy_threshold: float
+
+        :throws: RuntimeError if the stream object is not valid
+        """
+        if not self._impl:
+            raise RuntimeError("Stream object is not valid. Trying to configure an already finished stream?")
+        status = deepspeech.impl.EnableStreamEndpointing(self._impl, min_silence_ms, energy_threshold)
+        if status != 0:
+            raise RuntimeError("EnableStreamEndpointing failed with '{}' (0x{:X})".format(deepspeech.impl.ErrorCodeToErrorMessage(status),status))
+
+    def enableFrameSkipping(self, blank_threshold, skip_silence=False):
+        """
+        Enable frame skipping. Timesteps where the acoustic model is nearly
+        certain of a blank only get a cheap decoder update, and stretches of
+        digital silence can skip acoustic model inference.
+
+        :param blank_threshold: Blank probability at or above which a timestep is decoded as blank only, e.g. 0.999. 0 disables it.
+        :type blank_threshold: float
+
+        :param skip_silence: Whether to skip inference on batches made of digital silence only.
+        :type skip_silence: bool
+
+        :throws: RuntimeError if the stream object is not valid
+        """
+        if not self._impl:
+            raise RuntimeError("Stream object is not valid. Trying to configure an already finished stream?")
+        status = deepspeech.impl.EnableStreamFrameSkipping(self._impl, blank_threshold, int(skip_silence))
+        if status != 0:
+            raise RuntimeError("EnableStreamFrameSkipping failed with '{}' (0x{:X})".format(deepspeech.impl.ErrorCodeToErrorMessage(status),status))
+
+    def enableLMLookahead(self):
+        """
+        Enable language model look-ahead. Characters are scored with the best
+        unigram probability of the words they can still become, so unlikely
+        words are pruned early and a smaller beam width gives the same
+        accuracy. Call before feeding audio.
+
+        :throws: RuntimeError if the stream object is not valid, or the scorer is missing or has no look-ahead scores
+        """
+        if not self._impl:
+            raise RuntimeError("Stream object is not valid. Trying to configure an already finished stream?")
+        status = deepspeech.impl.EnableStreamLMLookahead(self._impl)
+        if status != 0:
+            raise RuntimeError("EnableStreamLMLookahead failed with '{}' (0x{:X})".format(deepspeech.impl.ErrorCodeToErrorMessage(status),status))
+
+    def enableGreedyDecoding(self):
+        """
+        Decode with greedy CTC decoding instead of the beam search: keep the
+        most probable label of each timestep and collapse repeats and blanks.
+        Only one candidate transcript is returned. Call before feeding audio.
+
+        :throws: RuntimeError if the stream object is not valid, or an external scorer is enabled
+        """
+        if not self._impl:
+            raise RuntimeError("Stream object is not valid. Trying to configure an already finished stream?")
+        status = deepspeech.impl.EnableStreamGreedyDecoding(self._impl)
+        if status != 0:
+            raise RuntimeError("EnableStreamGreedyDecoding failed with '{}' (0x{:X})".format(deepspeech.impl.ErrorCodeToErrorMessage(status),status))
+
+    def setTimingMode(self, mode):
+        """
+        Set the timing information tracked while decoding. Word or no timing
+        saves memory and time on long audio. Call before feeding audio.
+
+        :param mode: 'tokens' for exact timing of every token (default), 'words' for timing enough for word start and end times, 'none' for no timing
+        :type mode: str
+
+        :throws: RuntimeError if the stream object is not valid, or the mode is unknown
+        """
+        if not self._impl:
+            raise RuntimeError("Stream object is not valid. Trying to configure an already finished stream?")
+        modes = {
+            'tokens': deepspeech.impl.TIMING_TOKENS,
+            'words': deepspeech.impl.TIMING_WORDS,
+            'none': deepspeech.impl.TIMING_NONE,
+        }
+        if mode not in modes:
+            raise RuntimeError("Unknown timing mode {}, use tokens, words or none".format(mode))
+        status = deepspeech.impl.SetStreamTimingMode(self._impl, modes[mode])
+        if status != 0:
+            raise RuntimeError("SetStreamTimingMode failed with '{}' (0x{:X})".format(deepspeech.impl.ErrorCodeToErrorMessage(status),status))
+
+    def enableBeamPruning(self, beam_threshold, mass_coverage=0.0, min_beam_width=1):
+        """
+        Prune the beam search beyond the beam width: drop hypotheses far below
+        the best one, and keep only the best ones holding most of the
+        probability mass. Call before feeding audio.
+
+        :param beam_threshold: Largest log probability difference to the best hypothesis, 0 to disable
+        :type beam_threshold: float
+
+        :param mass_coverage: Share of the probability mass kept by the adaptive beam, 0 to disable
+        :type mass_coverage: float
+
+        :param min_beam_width: Fewest hypotheses kept by the adaptive beam
+        :type min_beam_width: int
+
+        :throws: RuntimeError if the stream object is not valid, or the parameters are out of range
+        """
+        if not self._impl:
+            raise RuntimeError("Stream object is not valid. Trying to configure an already finished stream?")
+        status = deepspeech.impl.EnableStreamBeamPruning(self._impl, beam_threshold, mass_coverage, min_beam_width)
+        if status != 0:
+            raise RuntimeError("EnableStreamBeamPruning failed with '{}' (0x{:X})".format(deepspeech.impl.ErrorCodeToErrorMessage(status),status))
+
+    def saveState(self):
+        """
+        Save the state of the stream to a snapshot, from which
+        :func:`Model.restoreStream()` continues decoding, e.g. in another
+        process. The stream is not changed.
+
+        :return: Snapshot of the stream
+        :type: bytes
+
+        :throws: RuntimeError if the stream object is not valid
+        """
+        if not self._impl:
+            raise RuntimeError("Stream object is not valid. Trying to save an already finished stream?")
+        status, snapshot = deepspeech.impl.SaveStream(self._impl)
+        if status != 0:
+            raise RuntimeError("SaveStream failed with '{}' (0x{:X})".format(deepspeech.impl.ErrorCodeToErrorMessage(status),status))
+        return snapshot
+
+    def skippedFrames(self):
+        """
+        Get the number of timesteps skipped by frame skipping.
+
+        :return: Number of timesteps that did not go through a full decoding step.
+        :type: int
+
+        :throws: RuntimeError if the stream object is not valid
+        """
+        if not self._impl:
+            raise RuntimeError("Stream object is not valid. Trying to query an already finished stream?")
+        return deepspeech.impl.GetStreamSkippedFrames(self._impl)
+
+    def stats(self):
+        """
+        Return the time spent in each stage of the pipeline, and the amount of
+        audio processed, by this stream so far.
+
+        :return: The parsed JSON object returned by ``DS_GetStatsJSON``, or None if the library was built without statistics.
+        :type: dict
+
+        :throws: RuntimeError if the stream object is not valid
+        """
+        if not self._impl:
+            raise RuntimeError("Stream object is not valid. Trying to query an already finished stream?")
+        stats = deepspeech.impl.GetStatsJSON(self._model._impl, self._impl)
+        return json.loads(stats) if stats is not None else None
+
+    def takeSegment(self):
+        """
+        Retrieve the oldest segment finalized by endpointing.
+
+        :return: The text of the segment, or None if no segment is pending.
+        :type: str
+
+        :throws: RuntimeError if the stream object is not valid
+        """
+        if not self._impl:
+            raise RuntimeError("Stream object is not valid. Trying to decode an already finished stream?")
+        return deepspeech.impl.TakeSegment(self._impl)
+
+    def takeSegmentWithMetadata(self):
+        """
+        Retrieve the oldest segment finalized by endpointing, including metadata.
+
+        :return: Metadata object containing a single transcript with per-token metadata including timing information, or None if no segment is pending.
+        :type: :func:`Metadata`
+
+        :throws: RuntimeError if the stream object is not valid
+        """
+        if not self._impl:
+            raise RuntimeError("Stream object is not valid. Trying to decode an already finished stream?")
+        return deepspeech.impl.TakeSegmentWithMetadata(self._impl)
+
     def finishStream(self):
         """
         Compute the final decoding of an ongoing streaming inference and return
@@ -286,6 +635,26 @@ class Stream(object):
         self._impl = None
         return result
 
+    def finishStreamWithWords(self, num_results=1):
+        """
+        Compute the final decoding of an ongoing streaming inference and return
+        word-level results. Signals the end of an ongoing streaming inference.
+        The underlying stream object must not be used after this method is called.
+
+        :param num_results: Maximum number of candidate transcripts to return. Returned list might be smaller than this.
+        :type num_results: int
+
+        :return: WordMetadataList object containing multiple candidate transcripts. Each transcript has per-word timings and scores.
+        :type: :func:`WordMetadataList`
+
+        :throws: RuntimeError if the stream object is not valid
+        """
+        if not self._impl:
+            raise RuntimeError("Stream object is not valid. Trying to finish an already finished stream?")
+        result = deepspeech.impl.FinishStreamWithWords(self._impl, num_results)
+        self._impl = None
+        return result
+
     def freeStream(self):
         """
         Destroy a streaming state without decoding the computed logits. This can
@@ -353,3 +722,79 @@ class Metadata(object):
         :return: A list of :func:`CandidateTranscript` objects
         :type: list
         """
+
+
+class WordMetadata(object):
+    """
+    Stores each individual word, along with its timing information and scores
+    """
+
+    def text(self):
+        """
+        The text of the word
+        """
+
+
+    def start_timestep(self):
+        """
+        Position of the first token of the word in units of 20ms
+        """
+
+
+    def end_timestep(self):
+        """
+        Position of the space following the word, or the end of the word if it is the last one, in units of 20ms
+        """
+
+
+    def start_time(self):
+        """
+        Position of the word in seconds
+        """
+
+
+    def duration(self):
+        """
+        Duration of the word in seconds
+        """
+
+
+    def acoustic_score(self):
+        """
+        Sum of the acoustic model log probabilities of the tokens of the word
+        """
+
+
+    def lm_score(self):
+        """
+        Log probability of the word given by the external scorer, 0 without one
+        """
+
+
+class WordTranscript(object):
+    """
+    Stores a transcript as an array of word metadata objects
+    """
+    def words(self):
+        """
+        List of words
+
+        :return: A list of :func:`WordMetadata` elements
+        :type: list
+        """
+
+
+    def confidence(self):
+        """
+        Approximated confidence value for this transcription, see :func:`CandidateTranscript.confidence()`.
+        """
+
+
+class WordMetadataList(object):
+    def transcripts(self):
+        """
+        List of candidate transcripts split into words
+
+        :return: A list of :func:`WordTranscript` objects
+        :type: list
+        """
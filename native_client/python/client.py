@@ -35,44 +35,15 @@ def metadata_to_string(metadata):
     return ''.join(token.text for token in metadata.tokens)
 
 
-def words_from_candidate_transcript(metadata):
-    word = ""
-    word_list = []
-    word_start_time = 0
-    # Loop through each character
-    for i, token in enumerate(metadata.tokens):
-        # Append character to word if it's not a space
-        if token.text != " ":
-            if len(word) == 0:
-                # Log the start time of the new word
-                word_start_time = token.start_time
-
-            word = word + token.text
-        # Word boundary is either a space or the last character in the array
-        if token.text == " " or i == len(metadata.tokens) - 1:
-            word_duration = token.start_time - word_start_time
-
-            if word_duration < 0:
-                word_duration = 0
-
-            each_word = dict()
-            each_word["word"] = word
-            each_word["start_time"] = round(word_start_time, 4)
-            each_word["duration"] = round(word_duration, 4)
-
-            word_list.append(each_word)
-            # Reset
-            word = ""
-            word_start_time = 0
-
-    return word_list
-
-
-def metadata_json_output(metadata):
+def words_json_output(metadata):
     json_result = dict()
     json_result["transcripts"] = [{
         "confidence": transcript.confidence,
-        "words": words_from_candidate_transcript(transcript),
+        "words": [{
+            "word": word.text,
+            "start_time": round(word.start_time, 4),
+            "duration": round(word.duration, 4),
+        } for word in transcript.words],
     } for transcript in metadata.transcripts]
     return json.dumps(json_result, indent=2)
 
@@ -159,7 +130,7 @@ def main():
     if args.extended:
         print(metadata_to_string(ds.sttWithMetadata(audio, 1).transcripts[0]))
     elif args.json:
-        print(metadata_json_output(ds.sttWithMetadata(audio, args.candidate_transcripts)))
+        print(words_json_output(ds.sttWithWords(audio, args.candidate_transcripts)))
     else:
         print(ds.stt(audio))
     # sphinx-doc: python_ref_inference_stop
@@ -13,6 +13,40 @@ import_array();
 // apply NumPy conversion typemap to DS_FeedAudioContent and DS_SpeechToText
 %apply (short* IN_ARRAY1, int DIM1) {(const short* aBuffer, unsigned int aBufferSize)};
 
+// DS_FeedAudioContentEx takes int16 or float32 samples, the Python wrapper
+// derives the frame count, channel count and format from the array itself
+%typemap(in, fragment="NumPy_Fragments") (const void* aBuffer)
+{
+  if (!is_array($input) || !array_is_contiguous($input) || !array_is_native($input)) {
+    PyErr_SetString(PyExc_ValueError, "audio_buffer must be a contiguous NumPy array in native byte order");
+    SWIG_fail;
+  }
+  $1 = array_data($input);
+}
+
+// DS_SaveStream returns the snapshot as bytes, DS_RestoreStream takes bytes
+%typemap(in, numinputs=0) (char** aSnapshot, unsigned int* aSize) (char* snapshot, unsigned int size) {
+  snapshot = NULL;
+  size = 0;
+  $1 = &snapshot;
+  $2 = &size;
+}
+
+%typemap(argout) (char** aSnapshot, unsigned int* aSize) {
+  %append_output(PyBytes_FromStringAndSize(*$1, *$2));
+  DS_FreeSnapshot(*$1);
+}
+
+%typemap(in) (const char* aSnapshot, unsigned int aSize) {
+  char* data;
+  Py_ssize_t size;
+  if (PyBytes_AsStringAndSize($input, &data, &size) < 0) {
+    SWIG_fail;
+  }
+  $1 = data;
+  $2 = (unsigned int)size;
+}
+
 %typemap(in, numinputs=0) ModelState **retval (ModelState *ret) {
   ret = NULL;
   $1 = &ret;
@@ -38,6 +72,11 @@ import_array();
   %append_output(SWIG_NewPointerObj(%as_voidptr($1), $1_descriptor, SWIG_POINTER_OWN));
 }
 
+%typemap(out) WordMetadataList* {
+  // owned, extended destructor needs to be called by SWIG
+  %append_output(SWIG_NewPointerObj(%as_voidptr($1), $1_descriptor, SWIG_POINTER_OWN));
+}
+
 %fragment("parent_reference_init", "init") {
   // Thread-safe initialization - initialize during Python module initialization
   parent_reference();
@@ -74,6 +113,28 @@ static PyObject *parent_reference() {
   }
 %}
 
+%typemap(out, fragment="parent_reference_function") WordTranscript* %{
+  $result = PyList_New(arg1->num_transcripts);
+  for (int i = 0; i < arg1->num_transcripts; ++i) {
+    PyObject* o = SWIG_NewPointerObj(SWIG_as_voidptr(&arg1->transcripts[i]), SWIGTYPE_p_WordTranscript, 0);
+    // Add a reference to WordMetadataList in the returned elements to avoid
+    // premature garbage collection
+    PyObject_SetAttr(o, parent_reference(), $self);
+    PyList_SetItem($result, i, o);
+  }
+%}
+
+%typemap(out, fragment="parent_reference_function") WordMetadata* %{
+  $result = PyList_New(arg1->num_words);
+  for (int i = 0; i < arg1->num_words; ++i) {
+    PyObject* o = SWIG_NewPointerObj(SWIG_as_voidptr(&arg1->words[i]), SWIGTYPE_p_WordMetadata, 0);
+    // Add a reference to WordTranscript in the returned elements to avoid
+    // premature garbage collection
+    PyObject_SetAttr(o, parent_reference(), $self);
+    PyList_SetItem($result, i, o);
+  }
+%}
+
 %extend struct TokenMetadata {
 %pythoncode %{
   def __repr__(self):
@@ -99,8 +160,35 @@ static PyObject *parent_reference() {
 %}
 }
 
+%extend struct WordMetadata {
+%pythoncode %{
+  def __repr__(self):
+    return 'WordMetadata(text=\'{}\', start_time={}, duration={}, acoustic_score={}, lm_score={})'.format(self.text, self.start_time, self.duration, self.acoustic_score, self.lm_score)
+%}
+}
+
+%extend struct WordTranscript {
+%pythoncode %{
+  def __repr__(self):
+    words_repr = ',\n'.join(repr(i) for i in self.words)
+    words_repr = '\n'.join('  ' + l for l in words_repr.split('\n'))
+    return 'WordTranscript(confidence={}, words=[\n{}\n])'.format(self.confidence, words_repr)
+%}
+}
+
+%extend struct WordMetadataList {
+%pythoncode %{
+  def __repr__(self):
+    transcripts_repr = ',\n'.join(repr(i) for i in self.transcripts)
+    transcripts_repr = '\n'.join('  ' + l for l in transcripts_repr.split('\n'))
+    return 'WordMetadataList(transcripts=[\n{}\n])'.format(transcripts_repr)
+%}
+}
+
 %ignore Metadata::num_transcripts;
 %ignore CandidateTranscript::num_tokens;
+%ignore WordMetadataList::num_transcripts;
+%ignore WordTranscript::num_words;
 
 %extend struct Metadata {
   ~Metadata() {
@@ -108,20 +196,35 @@ static PyObject *parent_reference() {
   }
 }
 
+%extend struct WordMetadataList {
+  ~WordMetadataList() {
+    DS_FreeWordMetadata($self);
+  }
+}
+
 %nodefaultctor Metadata;
 %nodefaultdtor Metadata;
 %nodefaultctor CandidateTranscript;
 %nodefaultdtor CandidateTranscript;
 %nodefaultctor TokenMetadata;
 %nodefaultdtor TokenMetadata;
+%nodefaultctor WordMetadataList;
+%nodefaultdtor WordMetadataList;
+%nodefaultctor WordTranscript;
+%nodefaultdtor WordTranscript;
+%nodefaultctor WordMetadata;
+%nodefaultdtor WordMetadata;
 
 %typemap(newfree) char* "DS_FreeString($1);";
 
 %newobject DS_SpeechToText;
 %newobject DS_IntermediateDecode;
 %newobject DS_FinishStream;
+%newobject DS_TakeCommittedText;
+%newobject DS_TakeSegment;
 %newobject DS_Version;
 %newobject DS_ErrorCodeToErrorMessage;
+%newobject DS_GetStatsJSON;
 
 %rename ("%(strip:[DS_])s") "";
 
@@ -0,0 +1,226 @@
+#include "resampler.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Zero crossings of the sinc on each side of its center, at the lower of the
+// two sample rates
+const unsigned int kHalfZeroCrossings = 16;
+
+// Fraction of the lower Nyquist frequency kept by the filter
+const double kRolloff = 0.95;
+
+// Number of partial sums kept by the dot product, the number of taps is a
+// multiple of it
+const unsigned int kLanes = 8;
+
+const double kPi = 3.14159265358979323846;
+
+// Largest filter accepted, in coefficients. Rates sharing a large factor with
+// the other rate, like 44.1 kHz or 48 kHz, need far less than this, rates
+// that share none, like 96001 Hz, need millions of coefficients.
+const double kMaxCoefficients = 1 << 20;
+
+unsigned int
+gcd(unsigned int a, unsigned int b)
+{
+  while (b != 0) {
+    unsigned int t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+double
+sinc(double x)
+{
+  if (x == 0.0) {
+    return 1.0;
+  }
+  return std::sin(kPi * x) / (kPi * x);
+}
+
+// Coefficients per phase of the filter converting with the reduced ratio
+// up/down. When downsampling the zero crossings are further apart in input
+// samples. Computed in floating point, as it can overflow for rates the
+// caller then rejects.
+double
+filter_taps(unsigned int up, unsigned int down)
+{
+  const double ratio = std::max(1.0, (double)down / up);
+  const double taps = 2 * std::ceil(kHalfZeroCrossings * ratio);
+  return std::ceil(taps / kLanes) * kLanes;
+}
+
+} // namespace
+
+bool
+Resampler::supports(unsigned int in_rate, unsigned int out_rate)
+{
+  if (in_rate == 0 || out_rate == 0) {
+    return false;
+  }
+  const unsigned int g = gcd(in_rate, out_rate);
+  const unsigned int up = out_rate / g;
+  const unsigned int down = in_rate / g;
+  return (double)up * filter_taps(up, down) <= kMaxCoefficients;
+}
+
+Resampler::Resampler()
+  : in_rate_(0)
+  , out_rate_(0)
+  , up_(1)
+  , down_(1)
+  , taps_(0)
+  , pos_(0)
+  , phase_(0)
+{
+}
+
+void
+Resampler::init(unsigned int in_rate, unsigned int out_rate)
+{
+  in_rate_ = in_rate;
+  out_rate_ = out_rate;
+  const unsigned int g = gcd(in_rate, out_rate);
+  up_ = out_rate / g;
+  down_ = in_rate / g;
+  taps_ = (unsigned int)filter_taps(up_, down_);
+
+  // Prototype filter at the upsampled rate in_rate * up_, with the gain of
+  // up_ lost to zero stuffing added back
+  const size_t length = (size_t)up_ * taps_;
+  const double cutoff = kRolloff * 0.5 / std::max(up_, down_);
+  // Centered on a whole sample, so that integer ratios do not shift the
+  // output by half a sample
+  const double center = (double)((length - 1) / 2);
+  coeffs_.resize(length);
+  for (size_t n = 0; n < length; ++n) {
+    const double t = (n - center) / (center + 1);
+    const double w = 0.42 + 0.5 * std::cos(kPi * t) + 0.08 * std::cos(2 * kPi * t);
+    const double h = up_ * 2 * cutoff * sinc(2 * cutoff * (n - center)) * w;
+    // Phase p uses taps n = p + j*up_, stored from the oldest input sample
+    // to the newest
+    const size_t p = n % up_;
+    const size_t j = n / up_;
+    coeffs_[p * taps_ + (taps_ - 1 - j)] = (float)h;
+  }
+
+  reset();
+}
+
+void
+Resampler::reset()
+{
+  if (taps_ == 0) {
+    input_.clear();
+    return;
+  }
+  // Start with an empty history, and the first output aligned with the first
+  // input sample rather than delayed by half the filter
+  input_.assign(taps_ - 1, 0.0f);
+  const size_t delay = ((size_t)up_ * taps_ - 1) / 2;
+  pos_ = delay / up_;
+  phase_ = delay % up_;
+}
+
+void
+Resampler::set_rates(unsigned int in_rate, unsigned int out_rate,
+                     std::vector<float>& output)
+{
+  if (in_rate == in_rate_ && out_rate == out_rate_) {
+    return;
+  }
+  if (in_rate_ != 0) {
+    flush(output);
+  }
+  if (in_rate == out_rate) {
+    *this = Resampler();
+  } else {
+    init(in_rate, out_rate);
+  }
+}
+
+void
+Resampler::process(std::vector<float>& output)
+{
+  const size_t available = input_.size();
+  if (pos_ + taps_ <= available) {
+    output.reserve(output.size() +
+                   ((available - pos_ - taps_) * up_) / down_ + 1);
+  }
+
+  while (pos_ + taps_ <= available) {
+    const float* x = &input_[pos_];
+    const float* h = &coeffs_[(size_t)phase_ * taps_];
+    float acc[kLanes] = {0};
+    for (unsigned int m = 0; m < taps_; m += kLanes) {
+      for (unsigned int k = 0; k < kLanes; ++k) {
+        acc[k] += x[m + k] * h[m + k];
+      }
+    }
+    float sum = 0.0f;
+    for (unsigned int k = 0; k < kLanes; ++k) {
+      sum += acc[k];
+    }
+    output.push_back(sum);
+
+    phase_ += down_;
+    pos_ += phase_ / up_;
+    phase_ %= up_;
+  }
+
+  const size_t consumed = std::min(pos_, available);
+  input_.erase(input_.begin(), input_.begin() + consumed);
+  pos_ -= consumed;
+}
+
+void
+Resampler::flush(std::vector<float>& output)
+{
+  input_.resize(input_.size() + taps_ / 2 + 1, 0.0f);
+  process(output);
+  reset();
+}
+
+void
+Resampler::save(SnapshotWriter& writer) const
+{
+  writer.put(in_rate_);
+  writer.put(out_rate_);
+  writer.put_vector(input_);
+  writer.put<uint64_t>(pos_);
+  writer.put(phase_);
+}
+
+bool
+Resampler::load(SnapshotReader& reader)
+{
+  unsigned int in_rate, out_rate;
+  uint64_t pos = 0;
+  reader.get(in_rate);
+  reader.get(out_rate);
+  if (reader.failed() || (in_rate == 0) != (out_rate == 0)) {
+    return reader.fail();
+  }
+  // The filter only depends on the rates
+  if (in_rate == 0) {
+    *this = Resampler();
+  } else if (!supports(in_rate, out_rate)) {
+    return reader.fail();
+  } else if (in_rate != in_rate_ || out_rate != out_rate_) {
+    init(in_rate, out_rate);
+  }
+  reader.get_vector(input_);
+  reader.get(pos);
+  reader.get(phase_);
+  pos_ = pos;
+  if (reader.failed() || pos > input_.size() ||
+      (in_rate != 0 && phase_ >= up_)) {
+    return reader.fail();
+  }
+  return true;
+}
@@ -0,0 +1,79 @@
+#ifndef RESAMPLER_H
+#define RESAMPLER_H
+
+#include <cstddef>
+#include <vector>
+
+#include "ctcdecode/snapshot.h"
+
+/*
+ * Streaming polyphase resampler for mono float audio, converting between two
+ * integer sample rates whose ratio is reduced to L/M. Audio can be pushed in
+ * chunks of any size: the filter history is carried over from one chunk to
+ * the next, so the output does not depend on how the input was split.
+ *
+ * The prototype filter is a Blackman-windowed sinc with its cutoff just below
+ * the lower of the two Nyquist frequencies. Each output sample is the dot
+ * product of a contiguous run of input samples with the coefficients of one
+ * phase, stored in that order so the inner loop can be vectorized.
+ */
+class Resampler {
+public:
+  Resampler();
+
+  // Whether converting from in_rate to out_rate needs a filter of at most
+  // 2^20 coefficients, which init() requires.
+  static bool supports(unsigned int in_rate, unsigned int out_rate);
+
+  // Prepare to convert from in_rate to out_rate, dropping any buffered audio.
+  void init(unsigned int in_rate, unsigned int out_rate);
+
+  // Forget buffered audio, keeping the filter.
+  void reset();
+
+  // Switch a stream to input at in_rate. Audio buffered for another input
+  // rate is flushed to output first, so that it comes before the audio at
+  // the new rate. When in_rate equals out_rate the resampler is left unused,
+  // with in_rate() 0, and the caller passes the audio through.
+  void set_rates(unsigned int in_rate, unsigned int out_rate,
+                 std::vector<float>& output);
+
+  unsigned int in_rate() const { return in_rate_; }
+  unsigned int out_rate() const { return out_rate_; }
+
+  // Buffer where the caller writes input samples before calling process(),
+  // which lets input conversion be fused with the copy into the history.
+  std::vector<float>& input() { return input_; }
+
+  // Resample everything buffered in input(), appending to output. Samples
+  // that do not have enough context yet are kept for the next call.
+  void process(std::vector<float>& output);
+
+  // Push zeros through the filter so the last input samples reach the output.
+  void flush(std::vector<float>& output);
+
+  // Write the rates and the buffered audio to a snapshot.
+  void save(SnapshotWriter& writer) const;
+
+  // Restore a resampler written by save(), false if the snapshot is invalid.
+  bool load(SnapshotReader& reader);
+
+private:
+  unsigned int in_rate_;
+  unsigned int out_rate_;
+  unsigned int up_;    // L
+  unsigned int down_;  // M
+  unsigned int taps_;  // coefficients per phase
+
+  // taps_ coefficients per phase, phase after phase
+  std::vector<float> coeffs_;
+
+  // Input samples not consumed yet, the next output sample is computed from
+  // the taps_ samples starting at input_[pos_] with the coefficients of
+  // phase phase_
+  std::vector<float> input_;
+  size_t pos_;
+  unsigned int phase_;
+};
+
+#endif // RESAMPLER_H
@@ -0,0 +1,136 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "resampler.h"
+
+/* Switching the input rate of a stream: audio buffered at the previous rate
+ * must come out before audio at the new rate, as if each run of audio at one
+ * rate had been resampled on its own. Also loads snapshots with a read
+ * position past the buffered audio.
+ */
+
+namespace {
+
+int failures = 0;
+
+void
+expect(bool condition, const char* what)
+{
+  if (!condition && ++failures <= 10) {
+    fprintf(stderr, "check failed: %s\n", what);
+  }
+}
+
+const unsigned int kModelRate = 16000;
+
+std::vector<float>
+make_audio(size_t num_samples, unsigned int seed)
+{
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<float> sample(-1.f, 1.f);
+  std::vector<float> audio(num_samples);
+  for (float& s : audio) {
+    s = sample(rng);
+  }
+  return audio;
+}
+
+// Audio at rate as a fresh stream outputs it, flushed at its end
+std::vector<float>
+resample_alone(const std::vector<float>& audio, unsigned int rate)
+{
+  if (rate == kModelRate) {
+    return audio;
+  }
+  Resampler resampler;
+  resampler.init(rate, kModelRate);
+  std::vector<float> output;
+  resampler.input().insert(resampler.input().end(), audio.begin(), audio.end());
+  resampler.process(output);
+  resampler.flush(output);
+  return output;
+}
+
+// Feed runs of audio at the given rates through one resampler, in chunks, the
+// way StreamingState::feedAudioContentEx does
+void
+check_rate_switches(const std::vector<unsigned int>& rates, const char* name)
+{
+  Resampler resampler;
+  std::vector<float> output, expected;
+  for (size_t r = 0; r < rates.size(); ++r) {
+    const std::vector<float> audio = make_audio(3000 + 517 * r, r + 1);
+    std::vector<float> part = resample_alone(audio, rates[r]);
+    expected.insert(expected.end(), part.begin(), part.end());
+
+    for (size_t start = 0; start < audio.size(); start += 700) {
+      const size_t end = std::min(audio.size(), start + 700);
+      resampler.set_rates(rates[r], kModelRate, output);
+      if (rates[r] == kModelRate) {
+        output.insert(output.end(), audio.begin() + start, audio.begin() + end);
+      } else {
+        resampler.input().insert(resampler.input().end(),
+                                 audio.begin() + start, audio.begin() + end);
+        resampler.process(output);
+      }
+    }
+  }
+  if (resampler.in_rate() != 0) {
+    resampler.flush(output);
+  }
+
+  if (output != expected) {
+    expect(false, name);
+  }
+}
+
+void
+check_invalid_position()
+{
+  Resampler resampler;
+  resampler.init(44100, kModelRate);
+  std::vector<float> output;
+  std::vector<float> audio = make_audio(1000, 7);
+  resampler.input().insert(resampler.input().end(), audio.begin(), audio.end());
+  resampler.process(output);
+
+  SnapshotWriter writer;
+  resampler.save(writer);
+  std::string data = writer.data();
+  {
+    SnapshotReader reader(data.data(), data.size());
+    Resampler loaded;
+    expect(loaded.load(reader) && reader.done(), "valid snapshot loads");
+  }
+
+  // The position follows the rates and the buffered samples
+  const size_t pos_offset = 2 * sizeof(unsigned int) + sizeof(uint32_t) +
+                            resampler.input().size() * sizeof(float);
+  const uint64_t pos = resampler.input().size() + 1;
+  memcpy(&data[pos_offset], &pos, sizeof(pos));
+  SnapshotReader reader(data.data(), data.size());
+  Resampler loaded;
+  expect(!loaded.load(reader), "position past the buffered audio is rejected");
+}
+
+} // namespace
+
+int
+main()
+{
+  check_rate_switches({44100, 16000, 44100}, "back to the model rate and out");
+  check_rate_switches({8000, 48000, 11025}, "between resampled rates");
+  check_rate_switches({16000, 8000, 16000, 16000}, "from the model rate");
+  check_invalid_position();
+
+  if (failures > 0) {
+    fprintf(stderr, "%d checks failed\n", failures);
+    return 1;
+  }
+  printf("Rate switches keep the audio in order\n");
+  return 0;
+}
@@ -0,0 +1,259 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+/*
+ * Timing and counters for the stages of the inference pipeline.
+ *
+ * Each stream has its own StatsCollector, written only by the thread feeding
+ * the stream, so recording is a handful of relaxed loads and stores with no
+ * read-modify-write or lock. Other threads can read a collector at any time.
+ * Collectors of finished streams are merged into their model's collector
+ * with atomic additions.
+ *
+ * Durations go to a histogram of power of two buckets: bucket i counts
+ * durations in [2^i, 2^(i+1)) nanoseconds, the first bucket also counts
+ * shorter ones and the last bucket longer ones.
+ *
+ * Stages are timed at a coarse grain, per item work in the hot loops of the
+ * decoder is only counted.
+ *
+ * Building with DS_DISABLE_STATS defined turns the DS_STATS_* macros into
+ * no-ops, removing all instrumentation from the hot paths.
+ */
+
+enum StatsStage {
+  STATS_STAGE_MFCC = 0,    // StreamingState::processAudioWindow, compute_mfcc
+  STATS_STAGE_INFERENCE,   // ModelState::infer
+  STATS_STAGE_DECODE,      // DecoderState::next, includes the LM and extend stages
+  STATS_STAGE_LM_QUERY,    // Decoder LM scoring, a batch per timestep and one per get_top_prefixes
+  STATS_STAGE_EXTEND,      // Candidate extension passes of a DecoderState::next call
+  STATS_STAGE_RESULT,      // Building transcripts and metadata
+  STATS_NUM_STAGES
+};
+
+enum StatsCounter {
+  STATS_COUNTER_AUDIO_SAMPLES = 0,  // Samples at the model sample rate
+  STATS_COUNTER_TIMESTEPS,          // Acoustic model timesteps decoded
+  STATS_COUNTER_STREAMS,            // Streams merged into a model collector
+  STATS_COUNTER_LM_CACHE_HITS,      // LM queries answered by the decoder's cache
+  STATS_COUNTER_LM_CACHE_MISSES,    // LM queries that went to the LM
+  STATS_COUNTER_FST_LOOKUPS,        // PathTrie::get_path_trie calls from the decoder
+  STATS_NUM_COUNTERS
+};
+
+class StatsCollector {
+public:
+  static const int kHistogramBuckets = 32;
+
+  StatsCollector() { clear(); }
+
+  // Disallow copying
+  StatsCollector(const StatsCollector&) = delete;
+  StatsCollector& operator=(const StatsCollector&) = delete;
+
+  void clear()
+  {
+    for (int s = 0; s < STATS_NUM_STAGES; ++s) {
+      Stage& stage = stages_[s];
+      stage.count.store(0, std::memory_order_relaxed);
+      stage.total_ns.store(0, std::memory_order_relaxed);
+      stage.max_ns.store(0, std::memory_order_relaxed);
+      for (int b = 0; b < kHistogramBuckets; ++b) {
+        stage.histogram[b].store(0, std::memory_order_relaxed);
+      }
+    }
+    for (int c = 0; c < STATS_NUM_COUNTERS; ++c) {
+      counters_[c].store(0, std::memory_order_relaxed);
+    }
+  }
+
+  // Record one run of a stage. Only one thread may record at a time.
+  void record(StatsStage s, uint64_t ns)
+  {
+    Stage& stage = stages_[s];
+    bump(stage.count, 1);
+    bump(stage.total_ns, ns);
+    if (ns > stage.max_ns.load(std::memory_order_relaxed)) {
+      stage.max_ns.store(ns, std::memory_order_relaxed);
+    }
+    bump(stage.histogram[bucket(ns)], 1);
+  }
+
+  // Increment a counter. Only one thread may record at a time.
+  void add(StatsCounter c, uint64_t value)
+  {
+    bump(counters_[c], value);
+  }
+
+  // Increment a counter of collector, if it is not null.
+  static void add_to(StatsCollector* collector, StatsCounter c, uint64_t value)
+  {
+    if (collector) {
+      collector->add(c, value);
+    }
+  }
+
+  // Add everything recorded by other to this collector, which can be shared
+  // by several threads merging at the same time.
+  void merge(const StatsCollector& other)
+  {
+    for (int s = 0; s < STATS_NUM_STAGES; ++s) {
+      Stage& stage = stages_[s];
+      const Stage& from = other.stages_[s];
+      stage.count.fetch_add(load(from.count), std::memory_order_relaxed);
+      stage.total_ns.fetch_add(load(from.total_ns), std::memory_order_relaxed);
+      uint64_t max_ns = load(from.max_ns);
+      uint64_t cur = load(stage.max_ns);
+      while (max_ns > cur &&
+             !stage.max_ns.compare_exchange_weak(cur, max_ns, std::memory_order_relaxed)) {
+      }
+      for (int b = 0; b < kHistogramBuckets; ++b) {
+        stage.histogram[b].fetch_add(load(from.histogram[b]), std::memory_order_relaxed);
+      }
+    }
+    for (int c = 0; c < STATS_NUM_COUNTERS; ++c) {
+      counters_[c].fetch_add(load(other.counters_[c]), std::memory_order_relaxed);
+    }
+  }
+
+  uint64_t count(StatsStage s) const { return load(stages_[s].count); }
+  uint64_t total_ns(StatsStage s) const { return load(stages_[s].total_ns); }
+  uint64_t max_ns(StatsStage s) const { return load(stages_[s].max_ns); }
+  uint64_t histogram(StatsStage s, int b) const { return load(stages_[s].histogram[b]); }
+  uint64_t counter(StatsCounter c) const { return load(counters_[c]); }
+
+  static uint64_t now_ns()
+  {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+private:
+  struct Stage {
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> total_ns;
+    std::atomic<uint64_t> max_ns;
+    std::atomic<uint64_t> histogram[kHistogramBuckets];
+  };
+
+  Stage stages_[STATS_NUM_STAGES];
+  std::atomic<uint64_t> counters_[STATS_NUM_COUNTERS];
+
+  static uint64_t load(const std::atomic<uint64_t>& value)
+  {
+    return value.load(std::memory_order_relaxed);
+  }
+
+  // Single writer increment, readers see either the old or the new value
+  static void bump(std::atomic<uint64_t>& value, uint64_t amount)
+  {
+    value.store(value.load(std::memory_order_relaxed) + amount,
+                std::memory_order_relaxed);
+  }
+
+  static int bucket(uint64_t ns)
+  {
+    int b = 0;
+    while (ns > 1 && b < kHistogramBuckets - 1) {
+      ns >>= 1;
+      ++b;
+    }
+    return b;
+  }
+};
+
+// Times the enclosing scope as a run of stage, if collector is not null. Use
+// DS_STATS_SCOPE, at most once per scope.
+class StatsScope {
+public:
+  StatsScope(StatsCollector* collector, StatsStage stage)
+    : collector_(collector)
+    , stage_(stage)
+    , start_ns_(collector ? StatsCollector::now_ns() : 0)
+  {
+  }
+
+  ~StatsScope()
+  {
+    if (collector_) {
+      collector_->record(stage_, StatsCollector::now_ns() - start_ns_);
+    }
+  }
+
+  StatsScope(const StatsScope&) = delete;
+  StatsScope& operator=(const StatsScope&) = delete;
+
+private:
+  StatsCollector* collector_;
+  StatsStage stage_;
+  uint64_t start_ns_;
+};
+
+// Adds up the time between start() and stop() calls and records it as a
+// single run of stage when going out of scope, if it was started and
+// collector is not null. Use DS_STATS_TIMER, DS_STATS_START and
+// DS_STATS_STOP.
+class StatsTimer {
+public:
+  StatsTimer(StatsCollector* collector, StatsStage stage)
+    : collector_(collector)
+    , stage_(stage)
+    , started_(false)
+    , start_ns_(0)
+    , total_ns_(0)
+  {
+  }
+
+  ~StatsTimer()
+  {
+    if (collector_ && started_) {
+      collector_->record(stage_, total_ns_);
+    }
+  }
+
+  void start()
+  {
+    if (collector_) {
+      started_ = true;
+      start_ns_ = StatsCollector::now_ns();
+    }
+  }
+
+  void stop()
+  {
+    if (collector_) {
+      total_ns_ += StatsCollector::now_ns() - start_ns_;
+    }
+  }
+
+  StatsTimer(const StatsTimer&) = delete;
+  StatsTimer& operator=(const StatsTimer&) = delete;
+
+private:
+  StatsCollector* collector_;
+  StatsStage stage_;
+  bool started_;
+  uint64_t start_ns_;
+  uint64_t total_ns_;
+};
+
+#ifndef DS_DISABLE_STATS
+#define DS_STATS_SCOPE(collector, stage) StatsScope stats_scope_((collector), (stage))
+#define DS_STATS_ADD(collector, counter, value) \
+  StatsCollector::add_to((collector), (counter), (value))
+#define DS_STATS_TIMER(timer, collector, stage) StatsTimer timer((collector), (stage))
+#define DS_STATS_START(timer) (timer).start()
+#define DS_STATS_STOP(timer) (timer).stop()
+#else
+#define DS_STATS_SCOPE(collector, stage) do {} while (0)
+#define DS_STATS_ADD(collector, counter, value) do {} while (0)
+#define DS_STATS_TIMER(timer, collector, stage) do {} while (0)
+#define DS_STATS_START(timer) do {} while (0)
+#define DS_STATS_STOP(timer) do {} while (0)
+#endif // DS_DISABLE_STATS
+
+#endif // STATS_H
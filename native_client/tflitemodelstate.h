@@ -2,6 +2,7 @@
 #define TFLITEMODELSTATE_H
 
 #include <memory>
+#include <mutex>
 #include <vector>
 
 #include "tensorflow/lite/model.h"
@@ -28,6 +29,10 @@ struct TFLiteModelState : public ModelState
   std::vector<int> acoustic_exec_plan_;
   std::vector<int> mfcc_exec_plan_;
 
+  // Streams of one model may run on different threads, but the interpreter
+  // can only run one graph at a time
+  std::mutex interpreter_mutex_;
+
   TFLiteModelState();
   virtual ~TFLiteModelState();
 
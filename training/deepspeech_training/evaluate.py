@@ -12,7 +12,7 @@ import progressbar
 import tensorflow as tf
 import tensorflow.compat.v1 as tfv1
 
-from ds_ctcdecoder import ctc_beam_search_decoder_batch, Scorer
+from ds_ctcdecoder import DecoderPool, Scorer
 from six.moves import zip
 
 from .util.config import Config, initialize_globals
@@ -83,6 +83,9 @@ def evaluate(test_csvs, create_model):
     except NotImplementedError:
         num_processes = 1
 
+    # Keep the decoding threads alive across batches
+    decoder_pool = DecoderPool(num_processes)
+
     with tfv1.Session(config=Config.session_config) as session:
         load_graph_for_evaluation(session)
 
@@ -109,9 +112,9 @@ def evaluate(test_csvs, create_model):
                 except tf.errors.OutOfRangeError:
                     break
 
-                decoded = ctc_beam_search_decoder_batch(batch_logits, batch_lengths, Config.alphabet, FLAGS.beam_width,
-                                                        num_processes=num_processes, scorer=scorer,
-                                                        cutoff_prob=FLAGS.cutoff_prob, cutoff_top_n=FLAGS.cutoff_top_n)
+                decoded = decoder_pool.decode_batch(batch_logits, batch_lengths, Config.alphabet, FLAGS.beam_width,
+                                                    scorer=scorer,
+                                                    cutoff_prob=FLAGS.cutoff_prob, cutoff_top_n=FLAGS.cutoff_top_n)
                 predictions.extend(d[0][1] for d in decoded)
                 ground_truths.extend(sparse_tensor_value_to_texts(batch_transcripts, Config.alphabet))
                 wav_filenames.extend(wav_filename.decode('UTF-8') for wav_filename in batch_wav_filenames)